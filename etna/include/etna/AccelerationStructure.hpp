@@ -0,0 +1,61 @@
+#pragma once
+#ifndef ETNA_ACCELERATION_STRUCTURE_HPP_INCLUDED
+#define ETNA_ACCELERATION_STRUCTURE_HPP_INCLUDED
+
+#include <string_view>
+
+#include <etna/Vulkan.hpp>
+#include <etna/Buffer.hpp>
+#include <etna/BindingItems.hpp>
+
+
+namespace etna
+{
+
+/**
+ * A BLAS or TLAS along with the buffer it lives in. Barriers for builds and
+ * traces are tracked on that buffer, see AccelerationStructureBuilder.
+ * Requires VK_KHR_acceleration_structure and the accelerationStructure and
+ * bufferDeviceAddress features.
+ */
+class AccelerationStructure
+{
+public:
+  AccelerationStructure() = default;
+
+  struct CreateInfo
+  {
+    vk::AccelerationStructureTypeKHR type;
+    // As reported by vkGetAccelerationStructureBuildSizesKHR
+    vk::DeviceSize size;
+    // Name of the structure for debugging tools
+    std::string_view name;
+  };
+
+  explicit AccelerationStructure(CreateInfo info);
+
+  AccelerationStructure(const AccelerationStructure&) = delete;
+  AccelerationStructure& operator=(const AccelerationStructure&) = delete;
+  AccelerationStructure(AccelerationStructure&&) noexcept = default;
+  AccelerationStructure& operator=(AccelerationStructure&&) noexcept;
+
+  [[nodiscard]] vk::AccelerationStructureKHR get() const { return structure.get(); }
+  [[nodiscard]] vk::AccelerationStructureTypeKHR getType() const { return type; }
+  [[nodiscard]] vk::DeviceAddress getDeviceAddress() const { return deviceAddress; }
+  [[nodiscard]] vk::DeviceSize getSize() const { return size; }
+  [[nodiscard]] const Buffer& getBuffer() const { return buffer; }
+
+  AccelerationStructureBinding genBinding() const;
+
+private:
+  vk::AccelerationStructureTypeKHR type{};
+  vk::DeviceSize size = 0;
+  vk::DeviceAddress deviceAddress = 0;
+  // Declared before the structure, so that it outlives it
+  Buffer buffer;
+  vk::UniqueAccelerationStructureKHR structure;
+};
+
+} // namespace etna
+
+#endif // ETNA_ACCELERATION_STRUCTURE_HPP_INCLUDED
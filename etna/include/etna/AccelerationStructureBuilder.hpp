@@ -0,0 +1,196 @@
+#pragma once
+#ifndef ETNA_ACCELERATION_STRUCTURE_BUILDER_HPP_INCLUDED
+#define ETNA_ACCELERATION_STRUCTURE_BUILDER_HPP_INCLUDED
+
+#include <array>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+#include <etna/Buffer.hpp>
+#include <etna/AccelerationStructure.hpp>
+#include <etna/GpuSharedResource.hpp>
+
+
+namespace etna
+{
+
+enum class BlasId : uint32_t
+{
+  Invalid = ~uint32_t{0}
+};
+
+enum class TlasId : uint32_t
+{
+  Invalid = ~uint32_t{0}
+};
+
+/**
+ * Builds and owns bottom and top level acceleration structures.
+ *
+ * BLASes are queued with addBlas and all of them are built by the next
+ * recordBuilds call with as few vkCmdBuildAccelerationStructuresKHR calls as
+ * the scratch budget allows, all suballocating a single scratch buffer.
+ * Structures that allow compaction get their compacted size queried during
+ * the build, and once the batch of the main work stream that recorded the
+ * build has completed, a later recordBuilds call copies them into smaller
+ * structures. The ids stay the same, so TLASes built after that use the
+ * compacted version. TLASes built before that refer to the original by its
+ * address, so it is kept alive and they are marked outdated until they are
+ * rebuilt, see isTlasOutdated.
+ *
+ * TLASes are rebuilt from instances every time they are updated, or only refit
+ * when the instance count didn't change and the structure allows updates,
+ * which is what per-frame animation wants.
+ *
+ * Builds are synchronized through ResourceStates on the buffers of the
+ * structures, and descriptor sets binding a TLAS make traces wait for its build.
+ *
+ * Geometry buffers need eShaderDeviceAddress and
+ * eAccelerationStructureBuildInputReadOnlyKHR usages, and have to stay alive
+ * until the builds using them are done on the GPU.
+ */
+class AccelerationStructureBuilder
+{
+public:
+  struct CreateInfo
+  {
+    // Builds that need more scratch memory than this in total are split
+    // into several batches. A single larger build still gets all it needs.
+    vk::DeviceSize scratchBudget = 64 * 1024 * 1024;
+  };
+
+  explicit AccelerationStructureBuilder(CreateInfo info);
+  ~AccelerationStructureBuilder();
+
+  AccelerationStructureBuilder(const AccelerationStructureBuilder&) = delete;
+  AccelerationStructureBuilder& operator=(const AccelerationStructureBuilder&) = delete;
+
+  struct BlasCreateInfo
+  {
+    // Indexed triangles or AABBs, with a build range for every geometry
+    std::vector<vk::AccelerationStructureGeometryKHR> geometries;
+    std::vector<vk::AccelerationStructureBuildRangeInfoKHR> ranges;
+    vk::BuildAccelerationStructureFlagsKHR flags =
+      vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace |
+      vk::BuildAccelerationStructureFlagBitsKHR::eAllowCompaction;
+    std::string name;
+  };
+
+  // Built by the next recordBuilds call
+  BlasId addBlas(BlasCreateInfo info);
+  void destroyBlas(BlasId id);
+  const AccelerationStructure& getBlas(BlasId id) const;
+
+  // Row-major 3x4 matrix
+  using Transform = std::array<float, 12>;
+  static constexpr Transform IDENTITY_TRANSFORM{1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0};
+
+  struct Instance
+  {
+    BlasId blas;
+    Transform transform = IDENTITY_TRANSFORM;
+    // gl_InstanceCustomIndexEXT, only the lower 24 bits are available
+    uint32_t customIndex = 0;
+    uint8_t mask = 0xFF;
+    // Added to the index of the hit group, only the lower 24 bits are available
+    uint32_t hitGroupOffset = 0;
+    vk::GeometryInstanceFlagsKHR flags = {};
+  };
+
+  struct TlasCreateInfo
+  {
+    uint32_t maxInstances;
+    vk::BuildAccelerationStructureFlagsKHR flags =
+      vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace |
+      vk::BuildAccelerationStructureFlagBitsKHR::eAllowUpdate;
+    std::string name;
+  };
+
+  TlasId createTlas(TlasCreateInfo info);
+  void destroyTlas(TlasId id);
+  const AccelerationStructure& getTlas(TlasId id) const;
+
+  // Records pending compactions and builds of the BLASes added so far. The
+  // command buffer must be submitted as part of the current batch of the main
+  // work stream.
+  void recordBuilds(vk::CommandBuffer cmd);
+
+  // Records a build of the TLAS from the instances, or a refit of the previous
+  // build if `refit` is set and possible. Call after recordBuilds, so that new
+  // and compacted BLASes are used. Instances are written into a buffer that is
+  // multi-buffered across frames in flight, so this can be done every frame.
+  void recordTlasBuild(
+    vk::CommandBuffer cmd, TlasId id, std::span<const Instance> instances, bool refit = true);
+
+  // Whether some BLAS the TLAS was built with got compacted since then. Such
+  // TLASes keep working, but the original BLAS is only freed once every TLAS
+  // using it is rebuilt, so scenes that don't rebuild every frame should.
+  bool isTlasOutdated(TlasId id) const;
+
+private:
+  struct Blas
+  {
+    AccelerationStructure structure;
+    std::string name;
+    vk::DeviceSize scratchSize = 0;
+    bool compactable = false;
+    // Only kept until the build is recorded
+    std::optional<BlasCreateInfo> pending;
+    // Versions replaced by compaction that outdated TLASes still refer to
+    std::vector<AccelerationStructure> superseded;
+  };
+
+  struct Tlas
+  {
+    AccelerationStructure structure;
+    TlasCreateInfo info;
+    GpuSharedResource<Buffer> instances;
+    Buffer scratch;
+    // Instances of the last build, a refit requires the same count
+    std::optional<uint32_t> builtInstanceCount;
+    // Sorted BLASes referenced by the last build
+    std::vector<BlasId> blases;
+    // Some of them were compacted since the build
+    bool outdated = false;
+  };
+
+  // Compacted sizes of structures built together, available once the GPU is done
+  struct CompactionQuery
+  {
+    vk::UniqueQueryPool pool;
+    std::vector<BlasId> structures;
+    // The queries are only reset on the GPU, so reading them before this batch
+    // of the main work stream completes is invalid
+    std::uint64_t batch;
+  };
+
+  void recordCompactions(vk::CommandBuffer cmd);
+  void recordBlasBuilds(vk::CommandBuffer cmd);
+  Buffer& getScratch(vk::DeviceSize size);
+  // Retires superseded versions of the BLASes no outdated TLAS refers to anymore
+  void releaseSuperseded(std::span<const BlasId> ids);
+  Blas& getBlasSlot(BlasId id);
+  Tlas& getTlasSlot(TlasId id);
+
+private:
+  vk::Device device;
+  CreateInfo params;
+  vk::PhysicalDeviceAccelerationStructurePropertiesKHR properties;
+
+  // Destroyed ids are not reused, as TLAS instances might still refer to them
+  std::vector<std::optional<Blas>> blases;
+  std::vector<BlasId> pendingBuilds;
+  std::vector<CompactionQuery> compactionQueries;
+
+  std::vector<std::optional<Tlas>> tlases;
+
+  Buffer blasScratch;
+  vk::DeviceSize blasScratchSize = 0;
+};
+
+} // namespace etna
+
+#endif // ETNA_ACCELERATION_STRUCTURE_BUILDER_HPP_INCLUDED
@@ -10,6 +10,7 @@ namespace etna
 
 class Buffer;
 class Image;
+class AccelerationStructure;
 
 struct BufferBinding
 {
@@ -28,6 +29,12 @@ struct SamplerBinding
   vk::DescriptorImageInfo descriptor_info;
 };
 
+struct AccelerationStructureBinding
+{
+  const AccelerationStructure* structure;
+  vk::AccelerationStructureKHR handle;
+};
+
 } // namespace etna
 
 #endif // ETNA_BINDING_ITEMS_HPP_INCLUDED
@@ -39,6 +39,10 @@ public:
     // https://gpuopen-librariesandsdks.github.io/VulkanMemoryAllocator/html/usage_patterns.html
     VmaAllocationCreateFlags allocationCreate = 0;
 
+    // Minimal alignment of the start of the buffer on top of what Vulkan requires
+    // for its usage, e.g. shaderGroupBaseAlignment for shader binding tables
+    vk::DeviceSize minAlignment = 0;
+
     // Name of the image for debugging tools
     std::string_view name;
   };
@@ -54,6 +58,8 @@ public:
 
   [[nodiscard]] vk::Buffer get() const { return buffer; }
   [[nodiscard]] std::byte* data() { return mapped; }
+  // Requires vk::BufferUsageFlagBits::eShaderDeviceAddress
+  [[nodiscard]] vk::DeviceAddress getDeviceAddress() const;
 
   BufferBinding genBinding(vk::DeviceSize offset = 0, vk::DeviceSize range = vk::WholeSize) const;
 
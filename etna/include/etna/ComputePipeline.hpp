@@ -2,9 +2,13 @@
 #ifndef ETNA_COMPUTE_PIPELINE_HPP_INCLUDED
 #define ETNA_COMPUTE_PIPELINE_HPP_INCLUDED
 
+#include <array>
+
 #include <etna/Vulkan.hpp>
+#include <etna/Buffer.hpp>
 #include <etna/VertexInput.hpp>
 #include <etna/PipelineBase.hpp>
+#include <etna/SpecializationConstants.hpp>
 
 
 namespace etna
@@ -25,7 +29,25 @@ public:
   ComputePipeline() = default;
   struct CreateInfo
   {
+    // Values for `layout(constant_id = N)` constants of the shader program,
+    // e.g. workgroup sizes. Constants that are not set here keep their defaults.
+    SpecializationConstants specializationConstants{};
   };
+
+  // The `local_size` of the shader with specialization constants applied
+  std::array<uint32_t, 3> getWorkgroupSize() const;
+
+  // Dispatches enough workgroups to cover the given amount of invocations,
+  // so the shader has to discard the ones outside of the range itself
+  void dispatchThreads(
+    vk::CommandBuffer cmd, uint32_t threads_x, uint32_t threads_y = 1, uint32_t threads_z = 1)
+    const;
+
+  // Reads workgroup counts as a vk::DispatchIndirectCommand from the buffer,
+  // which is synchronized with the commands that wrote it. Use getWorkgroupSize
+  // to pass the size to the shader computing the counts.
+  void dispatchIndirect(vk::CommandBuffer cmd, const Buffer& buffer, vk::DeviceSize offset = 0)
+    const;
 };
 
 } // namespace etna
@@ -0,0 +1,95 @@
+#pragma once
+#ifndef ETNA_COMPUTE_TUNER_HPP_INCLUDED
+#define ETNA_COMPUTE_TUNER_HPP_INCLUDED
+
+#include <array>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+#include <etna/ComputePipeline.hpp>
+#include <etna/SpecializationConstants.hpp>
+
+
+namespace etna
+{
+
+/**
+ * Picks the fastest of several specialization constant sets for a compute
+ * program, usually different workgroup sizes. Every candidate is compiled,
+ * a representative dispatch is timed on the GPU with timestamp queries, and
+ * the winner is remembered per device and driver, so later launches only
+ * compile the chosen variant.
+ *
+ * Timing submits and waits on one-shot command buffers, so tune at startup
+ * or in an offline tool, never inside the frame loop.
+ */
+class ComputeTuner
+{
+public:
+  struct CreateInfo
+  {
+    // Results of all devices are kept in one file. When empty, the results are
+    // kept next to the pipeline cache, or not persisted if there is none.
+    std::filesystem::path resultsPath{};
+    // Timed dispatches per candidate, the median of them is compared
+    uint32_t iterations = 5;
+  };
+
+  explicit ComputeTuner(CreateInfo info);
+
+  ComputeTuner(const ComputeTuner&) = delete;
+  ComputeTuner& operator=(const ComputeTuner&) = delete;
+
+  struct TuneInfo
+  {
+    // Identifies the result in the file, so it has to be unique and stable
+    std::string name;
+    const char* shaderProgramName;
+    // Complete sets of constants for the pipeline, one per variant
+    std::vector<SpecializationConstants> candidates;
+    // Binds resources and records the dispatch to time, the pipeline is bound
+    // already. Use ComputePipeline::dispatchThreads so that the amount of
+    // work stays the same for every workgroup size.
+    std::function<void(vk::CommandBuffer, const ComputePipeline&)> recordDispatch;
+  };
+
+  // Returns a pipeline built with the fastest candidate. Known results are
+  // reused without timing anything, unless the candidates have changed.
+  ComputePipeline tune(const TuneInfo& info);
+
+  // Writes the results to disk if anything was tuned
+  void save();
+
+private:
+  // Index of the fastest candidate
+  uint32_t measure(const TuneInfo& info);
+
+private:
+  std::filesystem::path path;
+  uint32_t iterations;
+  // Only results matching this are used, but all of them are saved
+  std::array<uint8_t, vk::UuidSize> deviceUuid{};
+  uint32_t driverVersion = 0;
+  float timestampPeriod = 0;
+  // Timestamps only have this many valid bits, zero if they are not supported
+  uint32_t timestampValidBits = 0;
+
+  struct Result
+  {
+    std::array<uint8_t, vk::UuidSize> deviceUuid;
+    uint32_t driverVersion;
+    std::string name;
+    // Detects changed candidate lists
+    uint64_t candidatesHash;
+    uint32_t chosen;
+  };
+  std::vector<Result> results;
+  bool dirty = false;
+};
+
+} // namespace etna
+
+#endif // ETNA_COMPUTE_TUNER_HPP_INCLUDED
@@ -0,0 +1,74 @@
+#pragma once
+#ifndef ETNA_DYNAMIC_STATE_HPP_INCLUDED
+#define ETNA_DYNAMIC_STATE_HPP_INCLUDED
+
+#include <array>
+#include <span>
+#include <string_view>
+
+#include <etna/Vulkan.hpp>
+#include <etna/VertexInput.hpp>
+#include <etna/GraphicsPipeline.hpp>
+
+
+namespace etna
+{
+
+/**
+ * Every state listed in GraphicsPipeline::CreateInfo::dynamicStates is left out
+ * of the pipeline: CreateInfos that only differ in dynamic fields share a single
+ * pipeline, and the values are recorded into the command buffer instead, see
+ * set_dynamic_state. Making the commonly toggled states dynamic collapses most
+ * material permutations into a handful of pipelines.
+ */
+
+// Core since Vulkan 1.3, so these are always available
+inline constexpr std::array CORE_EXTENDED_DYNAMIC_STATES{
+  vk::DynamicState::eCullMode,
+  vk::DynamicState::eFrontFace,
+  vk::DynamicState::ePrimitiveTopology,
+  vk::DynamicState::eDepthTestEnable,
+  vk::DynamicState::eDepthWriteEnable,
+  vk::DynamicState::eDepthCompareOp,
+  vk::DynamicState::eDepthBoundsTestEnable,
+  vk::DynamicState::eStencilTestEnable,
+  vk::DynamicState::eStencilOp,
+  vk::DynamicState::eRasterizerDiscardEnable,
+  vk::DynamicState::eDepthBiasEnable,
+  vk::DynamicState::ePrimitiveRestartEnable,
+};
+
+// Require VK_EXT_extended_dynamic_state3 in InitParams::deviceExtensions and the
+// corresponding vk::PhysicalDeviceExtendedDynamicState3FeaturesEXT features
+inline constexpr std::array EXTENDED_DYNAMIC_STATES_3{
+  vk::DynamicState::eDepthClampEnableEXT,
+  vk::DynamicState::ePolygonModeEXT,
+  vk::DynamicState::eRasterizationSamplesEXT,
+  vk::DynamicState::eSampleMaskEXT,
+  vk::DynamicState::eAlphaToCoverageEnableEXT,
+  vk::DynamicState::eAlphaToOneEnableEXT,
+  vk::DynamicState::eLogicOpEnableEXT,
+  vk::DynamicState::eColorBlendEnableEXT,
+  vk::DynamicState::eColorBlendEquationEXT,
+  vk::DynamicState::eColorWriteMaskEXT,
+};
+
+// Adds the states to info.dynamicStates, skipping the ones already there
+void add_dynamic_states(
+  GraphicsPipeline::CreateInfo& info, std::span<const vk::DynamicState> states);
+
+// The device extension a dynamic state needs, empty for core ones
+std::string_view get_dynamic_state_extension(vk::DynamicState state);
+
+// Records the values from `state` for everything listed in state.dynamicStates,
+// call it after binding the pipeline. Viewport and scissor are skipped, they are
+// set by RenderTargetState. eVertexInputBindingStride is skipped as well, strides
+// are passed to vkCmdBindVertexBuffers2 along with the buffers themselves.
+void set_dynamic_state(vk::CommandBuffer cmd, const GraphicsPipeline::CreateInfo& state);
+
+// Requires vk::DynamicState::eVertexInputEXT from VK_EXT_vertex_input_dynamic_state
+void set_vertex_input(vk::CommandBuffer cmd, const VertexShaderInputDescription& input);
+
+} // namespace etna
+
+#endif // ETNA_DYNAMIC_STATE_HPP_INCLUDED
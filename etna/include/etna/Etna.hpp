@@ -43,6 +43,44 @@ struct InitParams
 
   /// Whether things like createDescriptorSet or renderTarget should auto-create barriers
   bool generateBarriersAutomatically = true;
+
+  /// Amount of background threads used for loading shaders and similar work.
+  /// By default, one less than the amount of hardware threads.
+  std::optional<uint32_t> workerThreadCount = std::nullopt;
+
+  /// Where to cache shader reflection results between launches.
+  /// Empty path disables the cache.
+  std::filesystem::path shaderReflectionCachePath{};
+
+  /// Whether to watch loaded shader files for changes, which makes
+  /// etna::reload_changed_shaders only look at the files that were modified.
+  bool watchShaderFiles = false;
+
+  /// Where to cache SPIR-V compiled from GLSL/HLSL sources between launches.
+  /// Empty path disables the cache. Compiling sources at runtime requires
+  /// building etna with ETNA_ENABLE_SHADER_COMPILER, but cached results can be
+  /// used even without it.
+  std::filesystem::path compiledShaderCachePath{};
+  /// Least recently used entries are deleted on shutdown once the cache grows
+  /// larger than this many bytes
+  std::uintmax_t compiledShaderCacheSizeLimit = 256 * 1024 * 1024;
+  /// Shader sources and include directories are stored in the compiled shader
+  /// cache relative to this directory, so that the cache stays valid when it is
+  /// moved together with them. Defaults to the directory containing the cache.
+  std::filesystem::path shaderSourceRoot{};
+
+  /// Directories to look for `#include <...>` files in shader sources
+  std::vector<std::filesystem::path> shaderIncludeDirectories{};
+
+  /// Where to keep the driver's pipeline cache between launches, which makes
+  /// creating pipelines on subsequent launches much faster. It is discarded when
+  /// the GPU or driver version changes. Empty path disables the cache.
+  std::filesystem::path pipelineCachePath{};
+
+  /// Where to record every distinct pipeline that gets created, so that
+  /// PipelineManager::prewarmCapturedPipelines can compile all of them at
+  /// startup on the next launch. Empty path disables capturing.
+  std::filesystem::path pipelineStateCapturePath{};
 };
 
 bool is_initilized();
@@ -57,14 +95,40 @@ void end_frame();
  * use the shader program by it's name to create pipelines.
  *
  * \param name The name to give this shader program.
- * \param shaders_path Paths to shaders to use in this program.
+ * \param shaders_path Paths to shaders to use in this program, either compiled
+ * SPIR-V or GLSL/HLSL sources (see InitParams::compiledShaderCachePath).
  * \return ID of the newly created shader program.
  */
 ShaderProgramId create_program(
   const char* name, std::initializer_list<std::filesystem::path> shaders_path);
 
+/**
+ * \brief Batch version of etna::create_program. Shader files are read, reflected
+ * and turned into Vulkan modules on worker threads, while the resulting layouts
+ * are merged on the calling thread in the order of the descriptions, so the
+ * result is exactly the same as calling create_program for each of them.
+ *
+ * \param programs Names and shader paths of the programs to create.
+ * \return IDs of the newly created shader programs, in the same order.
+ */
+std::vector<ShaderProgramId> create_programs(std::span<const ShaderProgramDescription> programs);
+
 ShaderProgramId get_program_id(const char* name);
 
+/**
+ * \brief Makes programs created afterwards take their shaders from a pack built
+ * with etna_shader_packer (see etna_add_shader_pack in CMake) instead of separate
+ * SPIR-V files. The pack is mapped into memory once and already contains
+ * reflection, so loading shaders from it is nearly free.
+ * Shaders missing from the pack are still loaded from files.
+ *
+ * \param pack_path Path to the pack file.
+ * \param root Directory that shader paths are relative to, same as the one
+ * passed to the packer. Defaults to the directory containing the pack.
+ * \return Whether the pack was mounted successfully.
+ */
+bool mount_shader_pack(const std::filesystem::path& pack_path, std::filesystem::path root = {});
+
 /**
  * \brief Reload shader files.
  * \warning
@@ -73,6 +137,18 @@ ShaderProgramId get_program_id(const char* name);
  */
 void reload_shaders();
 
+/**
+ * \brief Reloads only shader files that were modified, and only recreates programs
+ * and pipelines that use them. Does not require the GPU to be idle, replaced
+ * objects are destroyed once in-flight frames are done with them.
+ * Cheap enough to be called every frame when InitParams::watchShaderFiles is set,
+ * otherwise rehashes every loaded shader file.
+ * \note Descriptor sets allocated for the reloaded programs might become invalid
+ * if their layouts changed.
+ * \return Whether anything was reloaded.
+ */
+bool reload_changed_shaders();
+
 // Access information required for executing a pipeline.
 ShaderProgramInfo get_shader_program(ShaderProgramId id);
 
@@ -3,6 +3,9 @@
 #define ETNA_GLOBAL_CONTEXT_HPP_INCLUDED
 
 #include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_set>
 
 #include <etna/Vulkan.hpp>
 #include <etna/GpuWorkCount.hpp>
@@ -25,6 +28,8 @@ struct PersistentDescriptorPool;
 class ResourceStates;
 class PerFrameCmdMgr;
 class OneShotCmdMgr;
+class WorkerPool;
+class DeferredDestroyQueue;
 
 class GlobalContext
 {
@@ -39,6 +44,8 @@ public:
   std::unique_ptr<PerFrameCmdMgr> createPerFrameCmdMgr();
   std::unique_ptr<OneShotCmdMgr> createOneShotCmdMgr();
   bool shouldGenerateBarriersWhen(BarrierBehavior behavior) const;
+  // Optional functionality is enabled by listing its extension in InitParams::deviceExtensions
+  bool isDeviceExtensionEnabled(std::string_view name) const;
 
   vk::Device getDevice() const { return vkDevice.get(); }
   vk::PhysicalDevice getPhysicalDevice() const { return vkPhysDevice; }
@@ -52,6 +59,8 @@ public:
   DynamicDescriptorPool& getDescriptorPool();
   PersistentDescriptorPool& getPersistentDescriptorPool();
   ResourceStates& getResourceTracker();
+  WorkerPool& getWorkerPool();
+  DeferredDestroyQueue& getDeferredDestroyQueue();
   GpuWorkCount& getMainWorkCount() { return mainWorkStream; }
   const GpuWorkCount& getMainWorkCount() const { return mainWorkStream; }
 
@@ -71,6 +80,7 @@ private:
   vk::UniqueDebugUtilsMessengerEXT vkDebugCallback{};
   vk::PhysicalDevice vkPhysDevice{};
   vk::UniqueDevice vkDevice{};
+  std::unordered_set<std::string> enabledDeviceExtensions;
 
   // We use a single queue for all purposes.
   // Async compute/transfer is too complicated for demos.
@@ -79,12 +89,15 @@ private:
 
   std::unique_ptr<VmaAllocator_T, void (*)(VmaAllocator)> vmaAllocator{nullptr, nullptr};
 
+  std::unique_ptr<DeferredDestroyQueue> deferredDestroyQueue;
   std::unique_ptr<DescriptorSetLayoutCache> descriptorSetLayouts;
   std::unique_ptr<ShaderProgramManager> shaderPrograms;
   std::unique_ptr<PipelineManager> pipelineManager;
   std::unique_ptr<DynamicDescriptorPool> perFrameDescriptorPool;
   std::unique_ptr<PersistentDescriptorPool> persistentDescriptorPool;
   std::unique_ptr<ResourceStates> resourceTracking;
+  // Declared after everything tasks might reference, so that it is joined first
+  std::unique_ptr<WorkerPool> workerPool;
   std::unique_ptr<void, void (*)(void*)> tracyCtx;
 
   bool shouldGenerateBarriersFlag;
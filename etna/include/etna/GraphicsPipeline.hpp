@@ -5,6 +5,7 @@
 #include <etna/Vulkan.hpp>
 #include <etna/VertexInput.hpp>
 #include <etna/PipelineBase.hpp>
+#include <etna/SpecializationConstants.hpp>
 
 
 namespace etna
@@ -111,10 +112,16 @@ public:
       vk::Format stencilAttachmentFormat = vk::Format::eUndefined;
     } fragmentShaderOutput;
 
+    // Fields covered by dynamic states do not take part in pipeline creation and have
+    // to be recorded into the command buffer, see etna/DynamicState.hpp
     std::vector<vk::DynamicState> dynamicStates = {
       vk::DynamicState::eViewport,
       vk::DynamicState::eScissor,
     };
+
+    // Values for `layout(constant_id = N)` constants of the shader program.
+    // Constants that are not set here keep their defaults from the shaders.
+    SpecializationConstants specializationConstants{};
   };
 };
 
@@ -0,0 +1,71 @@
+#pragma once
+#ifndef ETNA_MESH_PIPELINE_HPP_INCLUDED
+#define ETNA_MESH_PIPELINE_HPP_INCLUDED
+
+#include <etna/Vulkan.hpp>
+#include <etna/PipelineBase.hpp>
+#include <etna/GraphicsPipeline.hpp>
+#include <etna/SpecializationConstants.hpp>
+
+
+namespace etna
+{
+
+class PipelineManager;
+
+// A graphics pipeline where an optional task shader and a mesh shader replace
+// vertex input and all of the vertex processing stages. Draw with
+// vkCmdDrawMeshTasksEXT. Requires VK_EXT_mesh_shader in InitParams::deviceExtensions
+// and vk::PhysicalDeviceMeshShaderFeaturesEXT::meshShader (and taskShader if used).
+class MeshPipeline : public PipelineBase
+{
+  friend class PipelineManager;
+  MeshPipeline(PipelineManager* in_owner, PipelineId in_id, ShaderProgramId in_shader_program_id)
+    : PipelineBase(in_owner, in_id, in_shader_program_id)
+  {
+  }
+
+public:
+  // Use PipelineManager to create pipelines
+  MeshPipeline() = default;
+
+  // Same as the corresponding parts of GraphicsPipeline::CreateInfo, topology
+  // is declared by the mesh shader itself
+  struct CreateInfo
+  {
+    vk::PipelineRasterizationStateCreateInfo rasterizationConfig = {
+      .polygonMode = vk::PolygonMode::eFill,
+      .cullMode = vk::CullModeFlagBits::eNone,
+      .frontFace = vk::FrontFace::eClockwise,
+      .lineWidth = 1.f,
+    };
+
+    vk::PipelineMultisampleStateCreateInfo multisampleConfig = {
+      .rasterizationSamples = vk::SampleCountFlagBits::e1,
+      .sampleShadingEnable = vk::False,
+      .minSampleShading = 0.f,
+    };
+
+    GraphicsPipeline::CreateInfo::Blending blendingConfig = {};
+
+    vk::PipelineDepthStencilStateCreateInfo depthConfig = {
+      .depthTestEnable = vk::True,
+      .depthWriteEnable = vk::True,
+      .depthCompareOp = vk::CompareOp::eLessOrEqual,
+      .maxDepthBounds = 1.f,
+    };
+
+    GraphicsPipeline::CreateInfo::FragmentShaderOutputDescription fragmentShaderOutput;
+
+    std::vector<vk::DynamicState> dynamicStates = {
+      vk::DynamicState::eViewport,
+      vk::DynamicState::eScissor,
+    };
+
+    SpecializationConstants specializationConstants{};
+  };
+};
+
+} // namespace etna
+
+#endif // ETNA_MESH_PIPELINE_HPP_INCLUDED
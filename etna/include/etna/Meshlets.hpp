@@ -0,0 +1,70 @@
+#pragma once
+#ifndef ETNA_MESHLETS_HPP_INCLUDED
+#define ETNA_MESHLETS_HPP_INCLUDED
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+
+namespace etna
+{
+
+// Matches the layout that mesh shaders read from a storage buffer, so the
+// vector can be uploaded as is
+struct Meshlet
+{
+  // Into MeshletData::vertexIndices
+  uint32_t vertexOffset;
+  // Into MeshletData::triangles, in bytes, always a multiple of 4
+  uint32_t triangleOffset;
+  uint32_t vertexCount;
+  uint32_t triangleCount;
+};
+
+/**
+ * Indexed geometry split into small clusters for mesh shaders. A mesh shader
+ * workgroup processes a single meshlet: it reads `vertexCount` entries of
+ * vertexIndices starting at vertexOffset, which point into the original vertex
+ * buffer, and `triangleCount * 3` local indices starting at triangleOffset,
+ * which point into the meshlet's own vertices.
+ */
+struct MeshletData
+{
+  std::vector<Meshlet> meshlets;
+  std::vector<uint32_t> vertexIndices;
+  // Local vertex indices, 3 per triangle. The triangles of each meshlet are
+  // padded to 4 bytes, so a shader can read them as uints.
+  std::vector<uint8_t> triangles;
+};
+
+// Should match max_vertices and max_primitives declared by the mesh shader,
+// see ShaderProgramInfo::getMeshOutput. 64 and 124 are a good fit for most
+// hardware, both have to be at most 256 so that local indices fit into a byte.
+struct MeshletLimits
+{
+  uint32_t maxVertices = 64;
+  uint32_t maxTriangles = 124;
+};
+
+// Greedily packs consecutive triangles into meshlets, starting a new one as
+// soon as a triangle doesn't fit. The result is only as coherent as the input,
+// so optimize the index buffer for vertex cache locality beforehand.
+MeshletData build_meshlets(std::span<const uint32_t> indices, MeshletLimits limits = {});
+
+struct MeshletBounds
+{
+  std::array<float, 3> center;
+  float radius;
+};
+
+// Bounding spheres for culling meshlets on the GPU. `positions` is the vertex
+// buffer viewed as floats, with the position at the start of each vertex and
+// `stride` floats between consecutive vertices.
+std::vector<MeshletBounds> compute_meshlet_bounds(
+  const MeshletData& data, std::span<const float> positions, uint32_t stride = 3);
+
+} // namespace etna
+
+#endif // ETNA_MESHLETS_HPP_INCLUDED
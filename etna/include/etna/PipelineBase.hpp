@@ -4,6 +4,7 @@
 
 #include <etna/Vulkan.hpp>
 #include <etna/Forward.hpp>
+#include <etna/PipelineStatistics.hpp>
 
 
 namespace etna
@@ -11,9 +12,16 @@ namespace etna
 
 class PipelineBase
 {
+  friend class PipelineManager;
+
 public:
   vk::PipelineLayout getVkPipelineLayout() const;
+  // Null while an asynchronously created pipeline is still compiling
   vk::Pipeline getVkPipeline() const;
+  bool isReady() const;
+  // Creation time, cache hits and, if enabled, driver statistics of the pipeline.
+  // Refers to the latest version, which changes when the pipeline is recreated.
+  const PipelineStatistics& getStatistics() const;
 
   PipelineBase(const PipelineBase&) = delete;
   PipelineBase& operator=(const PipelineBase&) = delete;
@@ -26,6 +34,9 @@ protected:
   PipelineBase() = default;
   ~PipelineBase();
 
+  PipelineManager* getOwner() const { return owner; }
+  PipelineId getId() const { return id; }
+
 private:
   PipelineManager* owner{nullptr};
   PipelineId id{PipelineId::Invalid};
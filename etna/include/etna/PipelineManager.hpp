@@ -2,62 +2,236 @@
 #ifndef ETNA_PIPELINE_MANAGER_HPP_INCLUDED
 #define ETNA_PIPELINE_MANAGER_HPP_INCLUDED
 
+#include <array>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
 #include <unordered_map>
+#include <variant>
+#include <vector>
 
 #include <etna/Vulkan.hpp>
+#include <etna/Buffer.hpp>
 #include <etna/PipelineBase.hpp>
 #include <etna/GraphicsPipeline.hpp>
 #include <etna/ComputePipeline.hpp>
+#include <etna/MeshPipeline.hpp>
+#include <etna/RaytracePipeline.hpp>
+#include <etna/PipelineStatistics.hpp>
+#include <etna/RenderTargetStates.hpp>
 
 
 namespace etna
 {
 
 struct ShaderProgramManager;
+class GraphicsLibraryCache;
+struct PipelineCompiler;
+class PipelineStateCapture;
+
+// A pipeline along with what the driver reported while creating it
+struct CompiledPipeline
+{
+  vk::UniquePipeline pipeline;
+  PipelineStatistics statistics;
+};
 
 class PipelineManager
 {
   friend class PipelineBase;
+  friend class RaytracePipeline;
+  friend class ComputePipeline;
 
 public:
-  PipelineManager(vk::Device dev, ShaderProgramManager& shader_manager);
+  struct CreateInfo
+  {
+    vk::PhysicalDeviceProperties deviceProperties{};
+    // The pipeline cache is loaded from here if it was written for the same
+    // device and driver, an empty path disables persisting it
+    std::filesystem::path pipelineCachePath{};
+    // Graphics pipelines are linked from cached parts, which makes creating them
+    // almost instant. Optimized versions are then linked in the background.
+    // Requires VK_EXT_graphics_pipeline_library and VK_KHR_pipeline_library.
+    bool useGraphicsPipelineLibrary = false;
+    // Register and instruction counts and other vendor specific statistics are
+    // queried for every pipeline. Requires VK_KHR_pipeline_executable_properties
+    // and its pipelineExecutableInfo feature.
+    bool captureExecutableStatistics = false;
+    // Zeroes unless VK_KHR_ray_tracing_pipeline is enabled
+    vk::PhysicalDeviceRayTracingPipelinePropertiesKHR rayTracingProperties{};
+    // Every distinct pipeline that is created gets recorded here, so that the
+    // next launch can prewarm them. An empty path disables capturing.
+    std::filesystem::path pipelineStateCapturePath{};
+  };
 
+  PipelineManager(vk::Device dev, ShaderProgramManager& shader_manager, CreateInfo create_info);
+  ~PipelineManager();
+
+  // Creating a pipeline identical to an existing one (same program and equivalent
+  // CreateInfo) does not compile anything and returns another handle to it
   GraphicsPipeline createGraphicsPipeline(
     const char* shader_program_name, GraphicsPipeline::CreateInfo info);
 
   ComputePipeline createComputePipeline(
     const char* shader_program_name, ComputePipeline::CreateInfo info);
 
-  // TODO: createRaytracePipeline, createMeshletPipeline
+  // These return right away and compile the pipeline on a worker thread. Until
+  // the pipeline is ready, its getVkPipeline returns a null handle, so check
+  // PipelineBase::isReady before binding it or wait for it explicitly.
+  GraphicsPipeline createGraphicsPipelineAsync(
+    const char* shader_program_name, GraphicsPipeline::CreateInfo info);
+  ComputePipeline createComputePipelineAsync(
+    const char* shader_program_name, ComputePipeline::CreateInfo info);
 
+  // Blocks until the pipelines are compiled, e.g. at the end of a loading screen
+  void waitForPipelines(std::span<const PipelineBase* const> batch);
+  void waitForAllPipelines();
+  // Makes pipelines that finished compiling available without blocking,
+  // called by etna::begin_frame
+  void collectCompiledPipelines();
+
+  // Attachment formats and the sample count in the CreateInfo are ignored.
+  // Instead, a variant of the pipeline is compiled for the formats of every
+  // RenderTargetState it is bound in, the first time it is bound there. This
+  // requires filling in RenderTargetState::AttachmentParams::format.
+  GraphicsPipeline createFormatAgnosticGraphicsPipeline(
+    const char* shader_program_name, GraphicsPipeline::CreateInfo info);
+  // Starts compiling variants for the formats on worker threads, so that
+  // binding the pipeline with them later does not stall the frame
+  void prewarmFormatVariants(
+    const GraphicsPipeline& pipeline, std::span<const RenderTargetFormats> formats);
+
+  // Requires VK_EXT_mesh_shader, see MeshPipeline
+  MeshPipeline createMeshPipeline(const char* shader_program_name, MeshPipeline::CreateInfo info);
+  MeshPipeline createMeshPipelineAsync(
+    const char* shader_program_name, MeshPipeline::CreateInfo info);
+
+  // Requires VK_KHR_ray_tracing_pipeline, see RaytracePipeline. The shader binding
+  // table is rebuilt every time the pipeline is recreated.
+  RaytracePipeline createRaytracePipeline(
+    const char* shader_program_name, RaytracePipeline::CreateInfo info);
+  RaytracePipeline createRaytracePipelineAsync(
+    const char* shader_program_name, RaytracePipeline::CreateInfo info);
+
+  // Pipelines are recreated in batches on worker threads. Until the new ones are
+  // collected by begin_frame, the old ones keep being used, and then they are
+  // destroyed after the frames in flight grace period.
   void recreate();
+  // Only recreates pipelines using the specified programs
+  void recreate(std::span<ShaderProgramId const> programs);
+  // Blocks until pipelines using the programs are recreated. Needed when the
+  // layout of a program changes, as its old pipelines can not be used anymore.
+  void waitForPrograms(std::span<ShaderProgramId const> programs);
+
+  // Writes everything the driver has compiled so far to the cache path
+  void savePipelineCache();
+  // Writes pipelines recorded since the launch along with the previous captures
+  void savePipelineStateCapture();
+
+  // Starts compiling every captured pipeline on worker threads, so call it after
+  // loading all the programs. Records that don't match the loaded programs or
+  // the enabled extensions anymore are dropped from the capture. Prewarmed
+  // pipelines are kept alive, and creating an identical pipeline later returns
+  // one of them without compiling anything. waitForAllPipelines blocks until
+  // all are done.
+  void prewarmCapturedPipelines();
+  // Drops the references kept by prewarming, pipelines nobody else requested
+  // are destroyed
+  void releasePrewarmedPipelines();
+  const std::filesystem::path& getPipelineCachePath() const { return pipelineCachePath; }
 
 private:
+  // Variants are regular graphics pipelines holding a reference of their own
+  struct FormatAgnosticInfo
+  {
+    GraphicsPipeline::CreateInfo info;
+    std::vector<std::pair<RenderTargetFormats, PipelineId>> variants;
+  };
+
+  using PipelineInfo = std::variant<
+    std::monostate,
+    GraphicsPipeline::CreateInfo,
+    ComputePipeline::CreateInfo,
+    RaytracePipeline::CreateInfo,
+    FormatAgnosticInfo>;
+  struct PipelineSlot;
+
   void destroyPipeline(PipelineId id);
-  vk::Pipeline getVkPipeline(PipelineId id) const;
+  void waitForAbandonedPipelines();
+  void installPipeline(PipelineId id, CompiledPipeline compiled);
+  // Takes a reference to an existing identical pipeline, if there is one
+  std::optional<PipelineId> acquireShared(const std::string& key, bool wait);
+  PipelineId registerShared(std::string key, ShaderProgramId program, PipelineInfo info);
+  PipelineSlot& getSlot(PipelineId id);
+  const PipelineSlot& getSlot(PipelineId id) const;
+  PipelineCompiler getCompiler() const;
+  // Shared by graphics and mesh pipelines
+  PipelineId createGraphics(ShaderProgramId program, GraphicsPipeline::CreateInfo info, bool async);
+  PipelineId createCompute(ShaderProgramId program, ComputePipeline::CreateInfo info, bool async);
+  PipelineId createRaytrace(ShaderProgramId program, RaytracePipeline::CreateInfo info, bool async);
+  PipelineId getFormatVariant(PipelineId id, const RenderTargetFormats& formats, bool async);
+  // Returns a pipeline that is usable right away, might queue a better one
+  CompiledPipeline buildGraphicsPipeline(
+    PipelineId id, ShaderProgramId program, const GraphicsPipeline::CreateInfo& info);
+  bool isPipelineReady(PipelineId id) const;
+  const PipelineStatistics& getStatistics(PipelineId id) const;
+  void buildShaderBindingTable(PipelineSlot& slot);
+  std::array<uint32_t, 3> getWorkgroupSize(PipelineId id) const;
+  RaytracePipeline::ShaderBindingTable getShaderBindingTable(
+    PipelineId id, uint32_t raygen_index) const;
+  vk::Pipeline getVkPipeline(PipelineId id);
   vk::PipelineLayout getVkPipelineLayout(ShaderProgramId id) const;
 
 private:
   vk::Device device;
   ShaderProgramManager& shaderManager;
 
-
-  std::underlying_type_t<PipelineId> pipelineIdCounter{0};
-
-  struct PipelineParameters
+  std::filesystem::path pipelineCachePath;
+  vk::PhysicalDeviceProperties deviceProperties;
+  vk::PhysicalDeviceRayTracingPipelinePropertiesKHR rayTracingProperties;
+  vk::UniquePipelineCache pipelineCache;
+  bool captureStatistics;
+  // Only present when graphics pipeline libraries are used
+  std::unique_ptr<GraphicsLibraryCache> graphicsLibraries;
+  // Only present when capturing is enabled
+  std::unique_ptr<PipelineStateCapture> stateCapture;
+  std::vector<PipelineId> prewarmedPipelines;
+
+  // A PipelineId is an index into `slots` combined with the generation of the
+  // slot, so looking a pipeline up on bind is a plain array access, and ids
+  // that outlived their pipeline are caught instead of aliasing a new one.
+  struct PipelineSlot
   {
-    ShaderProgramId shaderProgram;
-    GraphicsPipeline::CreateInfo info;
+    // Bumped every time the slot is freed
+    uint32_t generation = 0;
+    // Handles of identical pipelines share a slot, zero means the slot is free
+    uint32_t refCount = 0;
+    std::string key;
+    ShaderProgramId shaderProgram{ShaderProgramId::Invalid};
+    PipelineInfo info;
+    // Null while the pipeline is being compiled
+    vk::UniquePipeline pipeline;
+    PipelineStatistics statistics;
+    // Only used by ray tracing pipelines, rebuilt along with the pipeline
+    Buffer shaderBindingTable;
+    RaytracePipeline::ShaderBindingTable sbtRegions;
+    uint32_t raygenCount = 0;
+    // Only used by compute pipelines, with specialization constants applied
+    std::array<uint32_t, 3> workgroupSize{};
   };
+  std::vector<PipelineSlot> slots;
+  std::vector<uint32_t> freeSlots;
 
-  struct ComputeParameters
-  {
-    ShaderProgramId shaderProgram;
-    ComputePipeline::CreateInfo info;
-  };
-  std::unordered_map<PipelineId, vk::UniquePipeline> pipelines;
-  std::unordered_multimap<PipelineId, ComputeParameters> computePipelineParameters;
-  std::unordered_multimap<PipelineId, PipelineParameters> graphicsPipelineParameters;
+  std::unordered_map<std::string, PipelineId> pipelineIdsByKey;
+
+  // Pipelines that are being compiled on worker threads
+  std::unordered_map<PipelineId, std::future<CompiledPipeline>> pendingPipelines;
+  // Compilations of pipelines destroyed in the meantime. The workers still use
+  // the shaders and graphics libraries, so these have to finish before those go.
+  std::vector<std::future<CompiledPipeline>> abandonedPipelines;
 };
 
 } // namespace etna
@@ -0,0 +1,59 @@
+#pragma once
+#ifndef ETNA_PIPELINE_STATISTICS_HPP_INCLUDED
+#define ETNA_PIPELINE_STATISTICS_HPP_INCLUDED
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+
+
+namespace etna
+{
+
+// What the driver reports about a compiled pipeline, see PipelineBase::getStatistics
+struct PipelineStatistics
+{
+  // Reported by the driver through VkPipelineCreationFeedback, zero if it could not tell
+  std::chrono::nanoseconds creationTime{0};
+  // The pipeline came out of the pipeline cache without compiling anything
+  bool cacheHit = false;
+
+  struct Stage
+  {
+    vk::ShaderStageFlagBits stage;
+    std::chrono::nanoseconds creationTime{0};
+    bool cacheHit = false;
+  };
+  // Not reported for pipelines linked from libraries
+  std::vector<Stage> stages;
+
+  // A compiled piece of the pipeline, e.g. the code of a single stage. Register
+  // counts, instruction counts and the like are vendor specific, so they are kept
+  // as the named values the driver reports.
+  struct Executable
+  {
+    std::string name;
+    std::string description;
+    vk::ShaderStageFlags stages;
+    uint32_t subgroupSize = 0;
+
+    struct Value
+    {
+      std::string name;
+      std::string description;
+      std::variant<bool, int64_t, uint64_t, double> value;
+    };
+    std::vector<Value> values;
+  };
+  // Only filled when VK_KHR_pipeline_executable_properties is enabled along with
+  // its pipelineExecutableInfo feature, chained into InitParams::features
+  std::vector<Executable> executables;
+};
+
+} // namespace etna
+
+#endif // ETNA_PIPELINE_STATISTICS_HPP_INCLUDED
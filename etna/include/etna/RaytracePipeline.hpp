@@ -0,0 +1,83 @@
+#pragma once
+#ifndef ETNA_RAYTRACE_PIPELINE_HPP_INCLUDED
+#define ETNA_RAYTRACE_PIPELINE_HPP_INCLUDED
+
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+#include <etna/PipelineBase.hpp>
+#include <etna/SpecializationConstants.hpp>
+
+
+namespace etna
+{
+
+class PipelineManager;
+
+/**
+ * A ray tracing pipeline along with its shader binding table. Shader groups are
+ * laid out in the table in the following order: a general group for every ray
+ * generation shader, then one for every miss shader, then the hit groups, then
+ * one for every callable shader, each kind in the order of the program's shaders.
+ * So the index of a miss or hit group used in traceRayEXT is the index among
+ * the shaders (or hit groups) of the same kind.
+ *
+ * Requires VK_KHR_ray_tracing_pipeline and VK_KHR_acceleration_structure in
+ * InitParams::deviceExtensions along with the rayTracingPipeline and
+ * bufferDeviceAddress features.
+ */
+class RaytracePipeline : public PipelineBase
+{
+  friend class PipelineManager;
+  RaytracePipeline(
+    PipelineManager* in_owner, PipelineId in_id, ShaderProgramId in_shader_program_id)
+    : PipelineBase(in_owner, in_id, in_shader_program_id)
+  {
+  }
+
+public:
+  // Use PipelineManager to create pipelines
+  RaytracePipeline() = default;
+
+  struct HitGroup
+  {
+    // Indices into the list of shaders the program was loaded from,
+    // vk::ShaderUnusedKHR for the stages the group doesn't have
+    uint32_t closestHit = vk::ShaderUnusedKHR;
+    uint32_t anyHit = vk::ShaderUnusedKHR;
+    // Groups with an intersection shader are for procedural geometry
+    uint32_t intersection = vk::ShaderUnusedKHR;
+  };
+
+  struct CreateInfo
+  {
+    // When empty, every closest hit shader gets a triangle hit group of its own
+    std::vector<HitGroup> hitGroups{};
+    uint32_t maxRayRecursionDepth = 1;
+    SpecializationConstants specializationConstants{};
+  };
+
+  // Regions of the shader binding table for vkCmdTraceRaysKHR. They change
+  // when the pipeline is recreated, so don't keep them across frames.
+  struct ShaderBindingTable
+  {
+    vk::StridedDeviceAddressRegionKHR raygen{};
+    vk::StridedDeviceAddressRegionKHR miss{};
+    vk::StridedDeviceAddressRegionKHR hit{};
+    vk::StridedDeviceAddressRegionKHR callable{};
+  };
+
+  // Only a single ray generation shader can be used per trace, selected by its index
+  ShaderBindingTable getShaderBindingTable(uint32_t raygen_index = 0) const;
+
+  void traceRays(
+    vk::CommandBuffer cmd,
+    uint32_t width,
+    uint32_t height,
+    uint32_t depth = 1,
+    uint32_t raygen_index = 0) const;
+};
+
+} // namespace etna
+
+#endif // ETNA_RAYTRACE_PIPELINE_HPP_INCLUDED
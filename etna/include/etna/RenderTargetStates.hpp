@@ -11,10 +11,24 @@
 namespace etna
 {
 
+// Everything a graphics pipeline has to know about the attachments it renders to
+struct RenderTargetFormats
+{
+  std::vector<vk::Format> colorAttachmentFormats = {};
+  vk::Format depthAttachmentFormat = vk::Format::eUndefined;
+  vk::Format stencilAttachmentFormat = vk::Format::eUndefined;
+  vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1;
+
+  bool operator==(const RenderTargetFormats&) const = default;
+};
+
 class RenderTargetState
 {
   vk::CommandBuffer commandBuffer;
   static bool inScope;
+  static RenderTargetFormats currentFormats;
+  // False if some attachment with a view has no format specified
+  static bool currentFormatsDefined;
 
 public:
   struct AttachmentParams
@@ -22,6 +36,10 @@ public:
     vk::Image image = {};
     vk::ImageView view = {};
     std::optional<vk::ImageAspectFlags> imageAspect{};
+    // Format and sample count of the view. Only required when binding pipelines
+    // created with PipelineManager::createFormatAgnosticGraphicsPipeline.
+    vk::Format format = vk::Format::eUndefined;
+    vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1;
     vk::AttachmentLoadOp loadOp = vk::AttachmentLoadOp::eClear;
     vk::AttachmentStoreOp storeOp = vk::AttachmentStoreOp::eStore;
     vk::ClearColorValue clearColorValue = std::array<float, 4>({0.0f, 0.0f, 0.0f, 1.0f});
@@ -78,6 +96,10 @@ public:
   }
 
   ~RenderTargetState();
+
+  // Formats of the attachments of the current scope, panics outside of one or
+  // if some attachment with a view has no format specified
+  static const RenderTargetFormats& getCurrentFormats();
 };
 
 } // namespace etna
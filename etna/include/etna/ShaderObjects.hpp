@@ -0,0 +1,39 @@
+#pragma once
+#ifndef ETNA_SHADER_OBJECTS_HPP_INCLUDED
+#define ETNA_SHADER_OBJECTS_HPP_INCLUDED
+
+#include <etna/Vulkan.hpp>
+#include <etna/Forward.hpp>
+#include <etna/GraphicsPipeline.hpp>
+#include <etna/ComputePipeline.hpp>
+
+
+namespace etna
+{
+
+/**
+ * An alternative to pipelines based on VK_EXT_shader_object: shaders of a program
+ * are bound directly and all of the state a pipeline would have baked in is
+ * recorded into the command buffer. Nothing depends on render target formats,
+ * so a program works with any RenderTargetState without creating pipelines.
+ *
+ * To use this, add VK_EXT_shader_object to InitParams::deviceExtensions and
+ * enable vk::PhysicalDeviceShaderObjectFeaturesEXT::shaderObject in the
+ * features chain before loading any programs. Viewport and scissor are set
+ * by RenderTargetState, descriptor sets and push constants are bound with
+ * ShaderProgramInfo::getPipelineLayout as usual.
+ */
+
+// Binds the shaders of a graphics program, unbinds all stages it does not have
+// and records the state described by `state`. `fragmentShaderOutput` and
+// `dynamicStates` are ignored, as everything is dynamic with shader objects.
+void bind_shader_objects(
+  vk::CommandBuffer cmd, ShaderProgramId program, const GraphicsPipeline::CreateInfo& state);
+
+// Binds the shader of a compute program, nothing else is needed for dispatches
+void bind_shader_objects(
+  vk::CommandBuffer cmd, ShaderProgramId program, const ComputePipeline::CreateInfo& info = {});
+
+} // namespace etna
+
+#endif // ETNA_SHADER_OBJECTS_HPP_INCLUDED
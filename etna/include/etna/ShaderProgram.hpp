@@ -4,6 +4,8 @@
 
 #include <array>
 #include <bitset>
+#include <span>
+#include <string>
 #include <vector>
 #include <unordered_map>
 #include <memory>
@@ -12,43 +14,182 @@
 #include <etna/Vulkan.hpp>
 #include <etna/Forward.hpp>
 #include <etna/DescriptorSetLayout.hpp>
+#include <etna/SpecializationConstants.hpp>
+#include <etna/VertexInput.hpp>
 
 
 namespace etna
 {
 
-struct ShaderModule
+// A `layout(location = N) in` variable of a vertex shader. Matrices and arrays
+// occupy several consecutive locations and are reported once per location.
+struct VertexInputInfo
 {
-  ShaderModule(vk::Device device, std::filesystem::path shader_path);
+  std::string name;
+  uint32_t location;
+  // The format matching the variable exactly, e.g. R32G32B32_SFLOAT for a vec3,
+  // or undefined for exotic types
+  vk::Format format;
+};
+
+// 64-bit three and four component inputs take two locations, others one
+uint32_t get_vertex_input_location_count(vk::Format format);
+
+// What a mesh shader declares about the output of a single workgroup. Meshlets
+// fed to the shader must fit into these limits.
+struct MeshOutputInfo
+{
+  uint32_t maxVertices = 0;
+  uint32_t maxPrimitives = 0;
+  // Point, line or triangle list
+  vk::PrimitiveTopology topology = vk::PrimitiveTopology::eTriangleList;
+};
+
+// The `local_size` a compute shader declares. Dimensions that are set through
+// specialization constants report their ids, as pipelines might override them.
+struct WorkgroupSizeInfo
+{
+  static constexpr uint32_t NO_CONSTANT_ID = ~uint32_t{0};
+
+  // Default sizes, used unless specialized
+  std::array<uint32_t, 3> size{1, 1, 1};
+  std::array<uint32_t, 3> constantIds{NO_CONSTANT_ID, NO_CONSTANT_ID, NO_CONSTANT_ID};
+};
+
+// Everything we extract from a SPIR-V module via reflection
+struct ShaderReflection
+{
+  vk::ShaderStageFlagBits stage{};
+  std::string entryPoint{};
+  std::vector<std::pair<uint32_t, DescriptorSetInfo>> resources{}; /*set index - set resources*/
+  vk::PushConstantRange pushConst{};
+  std::vector<SpecializationConstantInfo> specializationConstants{};
+  // Only filled in for vertex shaders, sorted by location
+  std::vector<VertexInputInfo> vertexInputs{};
+  // Only filled in for mesh shaders
+  MeshOutputInfo meshOutput{};
+  // Only filled in for compute shaders
+  WorkgroupSizeInfo workgroupSize{};
+};
 
-  void reload(vk::Device device);
+class ShaderReflectionCache;
+class ShaderFileWatcher;
+class ShaderPack;
+class ShaderCompiler;
 
-  const auto& getResources() const { return resources; }
+struct ShaderModule
+{
+  // Optional helpers for loading modules, owned by ShaderProgramManager
+  struct Loaders
+  {
+    ShaderReflectionCache* reflectionCache = nullptr;
+    // Required for GLSL/HLSL sources, SPIR-V files are loaded directly
+    const ShaderCompiler* compiler = nullptr;
+    // Shader objects are created from SPIR-V rather than from modules
+    bool keepCode = false;
+  };
+
+  // Defines only matter for shader sources
+  ShaderModule(
+    vk::Device device,
+    std::filesystem::path shader_path,
+    std::vector<std::string> defines,
+    Loaders loaders);
+
+  // Creates a module from code that was already read and reflected, e.g. from
+  // a shader pack. Such modules are immutable and never get reloaded.
+  ShaderModule(
+    vk::Device device,
+    std::filesystem::path shader_path,
+    std::span<std::byte const> packed_code,
+    uint64_t content_hash,
+    ShaderReflection precomputed_reflection);
+
+  // Returns false and does nothing if the resulting SPIR-V did not change since the
+  // last load. Sources that fail to compile keep the previous code.
+  bool reload(vk::Device device, Loaders loaders);
+
+  const auto& getResources() const { return reflection.resources; }
   vk::ShaderModule getVkModule() const { return vkModule.get(); }
-  vk::ShaderStageFlagBits getStage() const { return stage; }
-  const std::string& getName() const { return entryPoint; }
-  vk::PushConstantRange getPushConst() const { return pushConst; }
+  vk::ShaderStageFlagBits getStage() const { return reflection.stage; }
+  const std::string& getName() const { return reflection.entryPoint; }
+  vk::PushConstantRange getPushConst() const { return reflection.pushConst; }
+  const auto& getSpecializationConstants() const { return reflection.specializationConstants; }
+  const auto& getVertexInputs() const { return reflection.vertexInputs; }
+  const MeshOutputInfo& getMeshOutput() const { return reflection.meshOutput; }
+  const WorkgroupSizeInfo& getWorkgroupSize() const { return reflection.workgroupSize; }
+  uint64_t getContentHash() const { return contentHash; }
+  bool isImmutable() const { return immutable; }
+  const std::filesystem::path& getPath() const { return path; }
+  const std::vector<std::string>& getDefines() const { return defines; }
+  // Files included by the source, empty for SPIR-V modules
+  const std::vector<std::filesystem::path>& getDependencies() const { return dependencies; }
+  // SPIR-V of the module, empty unless the loaders asked to keep it
+  std::span<std::byte const> getCode() const { return code; }
 
   ShaderModule(const ShaderModule& mod) = delete;
   ShaderModule& operator=(const ShaderModule& mod) = delete;
 
+private:
+  bool setCode(vk::Device device, std::span<std::byte const> code, Loaders loaders);
+
 private:
   std::filesystem::path path{};
-  std::string entryPoint{};
-  vk::ShaderStageFlagBits stage;
+  std::vector<std::string> defines{};
+  std::vector<std::filesystem::path> dependencies{};
+  uint64_t contentHash{};
+  bool immutable = false;
+
+  // Either points into ownedCode or into the shader pack
+  std::vector<std::byte> ownedCode{};
+  std::span<std::byte const> code{};
 
   vk::UniqueShaderModule vkModule;
-  std::vector<std::pair<uint32_t, DescriptorSetInfo>> resources{}; /*set index - set resources*/
-  vk::PushConstantRange pushConst{};
-  /*Todo: add vertex input info*/
+  ShaderReflection reflection{};
+};
+
+// Everything needed to create a shader program, used for creating programs in bulk
+struct ShaderProgramDescription
+{
+  std::string name;
+  // Either compiled SPIR-V files or GLSL/HLSL sources, see ShaderCompiler
+  std::vector<std::filesystem::path> shaders;
+  // "NAME" or "NAME=VALUE" preprocessor defines for sources, which makes it
+  // easy to create several permutations of the same shaders
+  std::vector<std::string> defines = {};
+};
+
+// Linked VK_EXT_shader_object objects for all stages of a program, in pipeline order
+struct ShaderObjects
+{
+  std::vector<vk::ShaderStageFlagBits> stages;
+  std::vector<vk::ShaderEXT> shaders;
 };
 
 struct ShaderProgramInfo
 {
   ShaderProgramId getId() const { return id; }
+  const std::string& getName() const;
 
+  // The single push constant range shared by all stages, can be used directly
+  // with vkCmdPushConstants. Panics if stages use separate parts of the space.
   vk::PushConstantRange getPushConst() const;
+  // Disjoint ranges with the stages using them, overlapping blocks are merged
+  std::span<const vk::PushConstantRange> getPushConstRanges() const;
+  // Stage flags that have to be passed to vkCmdPushConstants for updating these bytes
+  vk::ShaderStageFlags getPushConstStages(uint32_t offset, uint32_t size) const;
   vk::PipelineLayout getPipelineLayout() const;
+  // Union of the constants declared in all stages
+  std::span<const SpecializationConstantInfo> getSpecializationConstants() const;
+  // Inputs of the vertex stage, empty if there is none
+  std::span<const VertexInputInfo> getVertexInputs() const;
+  // A single tightly packed per-vertex binding with attributes in the exact
+  // formats the vertex shader expects, in the order of their locations
+  VertexShaderInputDescription getDefaultVertexShaderInput() const;
+  // Output limits of the mesh stage, all zeroes if there is none
+  MeshOutputInfo getMeshOutput() const;
+  // Workgroup size of the compute stage, 1x1x1 if there is none
+  WorkgroupSizeInfo getWorkgroupSize() const;
 
   bool isDescriptorSetUsed(uint32_t set) const;
   vk::DescriptorSetLayout getDescriptorSetLayout(uint32_t set) const;
@@ -70,11 +211,29 @@ private:
 
 struct ShaderProgramManager
 {
-  ShaderProgramManager() {}
-  ~ShaderProgramManager() { clear(); }
+  struct CreateInfo
+  {
+    // An empty path disables the on-disk reflection cache
+    std::filesystem::path reflectionCachePath{};
+    // An empty path disables caching of SPIR-V compiled from sources
+    std::filesystem::path compiledShaderCachePath{};
+    std::uintmax_t compiledShaderCacheSizeLimit = 256 * 1024 * 1024;
+    // Cached paths are relative to it, the cache's parent directory by default
+    std::filesystem::path shaderSourceRoot{};
+    std::vector<std::filesystem::path> shaderIncludeDirectories{};
+    bool watchFiles = false;
+    // Required for getShaderObjects
+    bool keepShaderCode = false;
+  };
+
+  explicit ShaderProgramManager(CreateInfo info);
+  ~ShaderProgramManager();
 
   ShaderProgramId loadProgram(
     const char* name, std::span<std::filesystem::path const> shaders_path);
+  // Loads and reflects all new modules in parallel, then creates programs in order
+  std::vector<ShaderProgramId> loadPrograms(
+    std::span<ShaderProgramDescription const> descriptions);
   ShaderProgramId tryGetProgram(const char* name) const;
   ShaderProgramId getProgram(const char* name) const;
 
@@ -88,9 +247,33 @@ struct ShaderProgramManager
     return getProgramInfo(getProgram(name));
   }
 
-  void reloadPrograms();
+  struct ReloadedPrograms
+  {
+    // Programs whose code changed, their pipelines have to be recreated
+    std::vector<ShaderProgramId> programs;
+    // Descriptor set layouts or push constant ranges of these changed as well, so
+    // their old pipelines must not be bound with descriptor sets allocated now
+    std::vector<ShaderProgramId> layoutChanged;
+  };
+
+  // Reloads every module and program
+  ReloadedPrograms reloadPrograms();
+  // Reloads only modules whose contents changed (as reported by the file watcher,
+  // if enabled) and the programs using them. Old pipeline layouts are destroyed
+  // after the frames in flight grace period, so the GPU does not need to be idle.
+  ReloadedPrograms reloadChangedPrograms();
   void clear();
 
+  // Writes reflection results of all modules loaded so far to disk
+  void saveReflectionCache();
+  // Deletes least recently used compiled shaders until the cache fits into its limit
+  void trimCompiledShaderCache();
+
+  // Modules loaded after this call are taken from the pack when it contains
+  // them, paths are resolved relative to `root` (the pack's directory by default).
+  // Returns false and keeps loading from separate files if the pack is unusable.
+  bool mountShaderPack(const std::filesystem::path& pack_path, std::filesystem::path root = {});
+
   vk::PipelineLayout getProgramLayout(ShaderProgramId id) const
   {
     return getProgInternal(id).progLayout.get();
@@ -108,23 +291,54 @@ struct ShaderProgramManager
   // for pipeline creation
   std::vector<vk::PipelineShaderStageCreateInfo> getShaderStages(ShaderProgramId id) const;
 
+  // Creates shader objects for the program on first use with these constants.
+  // The objects are recreated when the program is reloaded, so the result
+  // should not be stored across frames. Not thread-safe.
+  const ShaderObjects& getShaderObjects(
+    ShaderProgramId id, const SpecializationConstants& constants);
+
   ShaderProgramManager(const ShaderProgramManager&) = delete;
   ShaderProgramManager& operator=(const ShaderProgramManager&) = delete;
 
 private:
+  // The same file compiled with different defines results in different modules
+  struct ModuleKey
+  {
+    std::filesystem::path path;
+    std::vector<std::string> defines;
+    bool operator==(const ModuleKey&) const = default;
+  };
+
   // See https://cplusplus.github.io/LWG/issue3657
-  struct PathHash
+  struct ModuleKeyHash
   {
-    std::size_t operator()(const std::filesystem::path& p) const noexcept
+    std::size_t operator()(const ModuleKey& key) const noexcept
     {
-      return std::filesystem::hash_value(p);
+      std::size_t hash = std::filesystem::hash_value(key.path);
+      for (const auto& define : key.defines)
+        hash = hash * 31 + std::hash<std::string>{}(define);
+      return hash;
     }
   };
 
-  std::unordered_map<std::filesystem::path, uint32_t, PathHash> shaderModuleNames;
+  std::unique_ptr<ShaderReflectionCache> reflectionCache;
+  std::unique_ptr<ShaderCompiler> compiler;
+  std::unique_ptr<ShaderFileWatcher> fileWatcher;
+  // Searched in mount order
+  std::vector<std::unique_ptr<ShaderPack>> shaderPacks;
+
+  bool keepShaderCode = false;
+
+  ShaderModule::Loaders getLoaders() const
+  {
+    return {reflectionCache.get(), compiler.get(), keepShaderCode};
+  }
+  std::unique_ptr<ShaderModule> createModule(vk::Device device, const ModuleKey& key);
+  void watchModule(const ShaderModule& shader_module);
+
+  std::unordered_map<ModuleKey, uint32_t, ModuleKeyHash> shaderModuleNames;
   std::vector<std::unique_ptr<ShaderModule>> shaderModules;
 
-  uint32_t registerModule(std::filesystem::path path);
   const ShaderModule& getModule(uint32_t id) const { return *shaderModules.at(id); }
 
   struct ShaderProgramInternal
@@ -142,9 +356,25 @@ private:
     std::array<DescriptorLayoutId, MAX_PROGRAM_DESCRIPTORS> descriptorIds;
 
     vk::PushConstantRange pushConst{};
+    std::vector<vk::PushConstantRange> pushConstRanges;
+    std::vector<SpecializationConstantInfo> specConstants;
+    std::vector<VertexInputInfo> vertexInputs;
+    MeshOutputInfo meshOutput;
+    WorkgroupSizeInfo workgroupSize;
+    std::vector<vk::DescriptorSetLayout> setLayouts;
     vk::UniquePipelineLayout progLayout;
 
-    void reload(ShaderProgramManager& manager);
+    struct ShaderObjectVariant
+    {
+      SpecializationConstants constants;
+      ShaderObjects objects;
+      std::vector<vk::UniqueShaderEXT> owned;
+    };
+    // Pointers, so that references returned by getShaderObjects stay valid
+    std::vector<std::unique_ptr<ShaderObjectVariant>> shaderObjects;
+
+    // Returns whether the layout differs from the one before the reload
+    bool reload(ShaderProgramManager& manager);
   };
 
   std::unordered_map<std::string, ShaderProgramId> programNames;
@@ -0,0 +1,126 @@
+#pragma once
+#ifndef ETNA_SPECIALIZATION_CONSTANTS_HPP_INCLUDED
+#define ETNA_SPECIALIZATION_CONSTANTS_HPP_INCLUDED
+
+#include <bit>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+
+
+namespace etna
+{
+
+// A `layout(constant_id = N) const T name = default;` declaration from a shader
+struct SpecializationConstantInfo
+{
+  std::string name;
+  uint32_t constantId;
+  // Byte width of the type, with bool being 4 bytes
+  uint32_t size;
+  // Value that is used when the constant is not specialized
+  uint64_t defaultValue;
+};
+
+/**
+ * Values of specialization constants for a pipeline. Constants are looked up
+ * by name (or id) in the reflection of the pipeline's shader program when the
+ * pipeline is (re)created, so this is independent from any particular shaders.
+ * The driver compiles the constants right into the shader code, which makes
+ * them a much cheaper alternative to runtime branches on uniforms.
+ */
+class SpecializationConstants
+{
+public:
+  template <class T>
+    requires std::is_arithmetic_v<T>
+  SpecializationConstants& set(std::string_view name, T value)
+  {
+    setRaw(std::string{name}, NO_CONSTANT_ID, encode(value), sizeof(Stored<T>));
+    return *this;
+  }
+
+  // For constants that have no name in SPIR-V
+  template <class T>
+    requires std::is_arithmetic_v<T>
+  SpecializationConstants& set(uint32_t constant_id, T value)
+  {
+    setRaw({}, constant_id, encode(value), sizeof(Stored<T>));
+    return *this;
+  }
+
+  bool empty() const { return values.empty(); }
+
+  struct Value
+  {
+    // Only one of these is used
+    std::string name;
+    uint32_t constantId;
+
+    uint64_t bits;
+    uint32_t size;
+
+    bool operator==(const Value&) const = default;
+  };
+
+  // Sorted by name and id, so that equal sets of constants compare equal
+  // regardless of the order in which they were set
+  std::span<const Value> getValues() const { return values; }
+
+  bool operator==(const SpecializationConstants&) const = default;
+
+  // Sets a value exactly as returned by getValues, e.g. when deserializing
+  SpecializationConstants& setValue(Value value)
+  {
+    setRaw(std::move(value.name), value.constantId, value.bits, value.size);
+    return *this;
+  }
+
+  // Matches the values against the reflected constants of a program and fills
+  // in the data for vk::SpecializationInfo. Panics on unknown constants,
+  // mismatched sizes, or a constant that is set both by name and by id.
+  // `program_name` is only used for error messages.
+  void resolve(
+    std::span<const SpecializationConstantInfo> reflected,
+    std::string_view program_name,
+    std::vector<vk::SpecializationMapEntry>& out_entries,
+    std::vector<std::byte>& out_data) const;
+  // Whether resolve would succeed for these reflected constants
+  bool matches(std::span<const SpecializationConstantInfo> reflected) const;
+
+  static constexpr uint32_t NO_CONSTANT_ID = ~uint32_t{0};
+
+private:
+  // SPIR-V booleans are 32 bits wide on the API side
+  template <class T>
+  using Stored = std::conditional_t<std::is_same_v<T, bool>, vk::Bool32, T>;
+
+  template <class T>
+  static uint64_t encode(T value)
+  {
+    const Stored<T> stored = static_cast<Stored<T>>(value);
+    if constexpr (sizeof(stored) == 8)
+      return std::bit_cast<uint64_t>(stored);
+    else if constexpr (sizeof(stored) == 4)
+      return std::bit_cast<uint32_t>(stored);
+    else if constexpr (sizeof(stored) == 2)
+      return std::bit_cast<uint16_t>(stored);
+    else
+      return std::bit_cast<uint8_t>(stored);
+  }
+
+  void setRaw(std::string name, uint32_t constant_id, uint64_t bits, uint32_t size);
+
+private:
+  std::vector<Value> values;
+};
+
+} // namespace etna
+
+#endif // ETNA_SPECIALIZATION_CONSTANTS_HPP_INCLUDED
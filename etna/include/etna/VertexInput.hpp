@@ -67,8 +67,11 @@ struct VertexShaderInputDescription
     // For every input variable inside your GLSL vertex shader with `location = i`,
     // you should have `attributeMapping[i]` saying which attribute from the
     // byte stream description should be used for this variable.
-    // Default is identity i -> i mapping.
+    // Default is identity i -> i mapping. Locations that should not be fed
+    // from this binding can be marked with UNUSED_LOCATION.
     std::vector<uint32_t> attributeMapping = byteStreamDescription.identityAttributeMapping();
+
+    static constexpr uint32_t UNUSED_LOCATION = ~uint32_t{0};
   };
 
   // Note that the `binding` annotation value that you specified in GLSL
@@ -0,0 +1,53 @@
+#include <etna/AccelerationStructure.hpp>
+
+#include <etna/GlobalContext.hpp>
+#include "DebugUtils.hpp"
+
+
+namespace etna
+{
+
+AccelerationStructure::AccelerationStructure(CreateInfo info)
+  : type{info.type}
+  , size{info.size}
+  , buffer{get_context().createBuffer(Buffer::CreateInfo{
+      .size = info.size,
+      .bufferUsage = vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR |
+        vk::BufferUsageFlagBits::eShaderDeviceAddress,
+      .memoryUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+      .name = info.name,
+    })}
+{
+  const vk::Device device = get_context().getDevice();
+  structure = unwrap_vk_result(
+    device.createAccelerationStructureKHRUnique(vk::AccelerationStructureCreateInfoKHR{
+      .buffer = buffer.get(),
+      .offset = 0,
+      .size = info.size,
+      .type = info.type,
+    }));
+  deviceAddress = device.getAccelerationStructureAddressKHR(
+    vk::AccelerationStructureDeviceAddressInfoKHR{.accelerationStructure = structure.get()});
+  etna::set_debug_name(structure.get(), info.name.data());
+}
+
+AccelerationStructure& AccelerationStructure::operator=(AccelerationStructure&& other) noexcept
+{
+  if (this == &other)
+    return *this;
+
+  // The structure has to go before the buffer it lives in
+  structure = std::move(other.structure);
+  buffer = std::move(other.buffer);
+  type = other.type;
+  size = other.size;
+  deviceAddress = other.deviceAddress;
+  return *this;
+}
+
+AccelerationStructureBinding AccelerationStructure::genBinding() const
+{
+  return AccelerationStructureBinding{this, get()};
+}
+
+} // namespace etna
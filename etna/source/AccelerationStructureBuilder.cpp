@@ -0,0 +1,524 @@
+#include <etna/AccelerationStructureBuilder.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include <tracy/Tracy.hpp>
+
+#include <etna/Etna.hpp>
+#include <etna/GlobalContext.hpp>
+#include "DeferredDestroyQueue.hpp"
+
+
+namespace etna
+{
+
+static vk::DeviceSize align_up(vk::DeviceSize value, vk::DeviceSize alignment)
+{
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+static vk::AccelerationStructureGeometryKHR get_instances_geometry(vk::DeviceAddress instances)
+{
+  vk::AccelerationStructureGeometryKHR geometry{
+    .geometryType = vk::GeometryTypeKHR::eInstances,
+  };
+  geometry.geometry.instances = vk::AccelerationStructureGeometryInstancesDataKHR{
+    .arrayOfPointers = vk::False,
+  };
+  geometry.geometry.instances.data.deviceAddress = instances;
+  return geometry;
+}
+
+// Scratch memory is both read and written by builds
+static constexpr vk::AccessFlags2 SCRATCH_ACCESS =
+  vk::AccessFlagBits2::eAccelerationStructureReadKHR |
+  vk::AccessFlagBits2::eAccelerationStructureWriteKHR;
+
+AccelerationStructureBuilder::AccelerationStructureBuilder(CreateInfo info)
+  : device{get_context().getDevice()}
+  , params{info}
+{
+  ETNA_VERIFYF(
+    get_context().isDeviceExtensionEnabled(vk::KHRAccelerationStructureExtensionName),
+    "Acceleration structures require {}, add it to InitParams::deviceExtensions",
+    vk::KHRAccelerationStructureExtensionName);
+
+  properties = get_context()
+                 .getPhysicalDevice()
+                 .getProperties2<
+                   vk::PhysicalDeviceProperties2,
+                   vk::PhysicalDeviceAccelerationStructurePropertiesKHR>()
+                 .get<vk::PhysicalDeviceAccelerationStructurePropertiesKHR>();
+}
+
+AccelerationStructureBuilder::~AccelerationStructureBuilder() = default;
+
+BlasId AccelerationStructureBuilder::addBlas(BlasCreateInfo info)
+{
+  ETNA_VERIFYF(
+    info.geometries.size() == info.ranges.size(),
+    "BLAS {} has {} geometries, but {} build ranges",
+    info.name,
+    info.geometries.size(),
+    info.ranges.size());
+
+  std::vector<uint32_t> primitiveCounts;
+  for (const auto& range : info.ranges)
+    primitiveCounts.push_back(range.primitiveCount);
+
+  vk::AccelerationStructureBuildGeometryInfoKHR buildInfo{
+    .type = vk::AccelerationStructureTypeKHR::eBottomLevel,
+    .flags = info.flags,
+    .mode = vk::BuildAccelerationStructureModeKHR::eBuild,
+  };
+  buildInfo.setGeometries(info.geometries);
+  const auto sizes = device.getAccelerationStructureBuildSizesKHR(
+    vk::AccelerationStructureBuildTypeKHR::eDevice, buildInfo, primitiveCounts);
+
+  const auto id = static_cast<BlasId>(blases.size());
+  blases.emplace_back(Blas{
+    .structure = AccelerationStructure{AccelerationStructure::CreateInfo{
+      .type = vk::AccelerationStructureTypeKHR::eBottomLevel,
+      .size = sizes.accelerationStructureSize,
+      .name = info.name,
+    }},
+    .name = info.name,
+    .scratchSize = sizes.buildScratchSize,
+    .compactable =
+      static_cast<bool>(info.flags & vk::BuildAccelerationStructureFlagBitsKHR::eAllowCompaction),
+    .pending = std::move(info),
+  });
+  pendingBuilds.push_back(id);
+  return id;
+}
+
+AccelerationStructureBuilder::Blas& AccelerationStructureBuilder::getBlasSlot(BlasId id)
+{
+  const auto index = static_cast<uint32_t>(id);
+  ETNA_VERIFYF(
+    index < blases.size() && blases[index].has_value(), "BLAS {} was already destroyed!", index);
+  return *blases[index];
+}
+
+const AccelerationStructure& AccelerationStructureBuilder::getBlas(BlasId id) const
+{
+  return const_cast<AccelerationStructureBuilder&>(*this).getBlasSlot(id).structure;
+}
+
+void AccelerationStructureBuilder::destroyBlas(BlasId id)
+{
+  // Frames in flight might still be tracing against it
+  auto& blas = getBlasSlot(id);
+  get_context().getDeferredDestroyQueue().retire(std::move(blas.structure));
+  if (!blas.superseded.empty())
+    get_context().getDeferredDestroyQueue().retire(std::move(blas.superseded));
+  blases[static_cast<uint32_t>(id)].reset();
+  std::erase(pendingBuilds, id);
+}
+
+AccelerationStructureBuilder::Tlas& AccelerationStructureBuilder::getTlasSlot(TlasId id)
+{
+  const auto index = static_cast<uint32_t>(id);
+  ETNA_VERIFYF(
+    index < tlases.size() && tlases[index].has_value(), "TLAS {} was already destroyed!", index);
+  return *tlases[index];
+}
+
+TlasId AccelerationStructureBuilder::createTlas(TlasCreateInfo info)
+{
+  const auto geometry = get_instances_geometry(0);
+  vk::AccelerationStructureBuildGeometryInfoKHR buildInfo{
+    .type = vk::AccelerationStructureTypeKHR::eTopLevel,
+    .flags = info.flags,
+    .mode = vk::BuildAccelerationStructureModeKHR::eBuild,
+  };
+  buildInfo.setGeometries(geometry);
+  const auto sizes = device.getAccelerationStructureBuildSizesKHR(
+    vk::AccelerationStructureBuildTypeKHR::eDevice, buildInfo, info.maxInstances);
+
+  auto& ctx = get_context();
+  const vk::DeviceSize instancesSize =
+    std::max(info.maxInstances, 1u) * sizeof(vk::AccelerationStructureInstanceKHR);
+
+  const auto id = static_cast<TlasId>(tlases.size());
+  tlases.emplace_back(Tlas{
+    .structure = AccelerationStructure{AccelerationStructure::CreateInfo{
+      .type = vk::AccelerationStructureTypeKHR::eTopLevel,
+      .size = sizes.accelerationStructureSize,
+      .name = info.name,
+    }},
+    .info = info,
+    .instances = GpuSharedResource<Buffer>{
+      ctx.getMainWorkCount(),
+      [&](std::size_t) {
+        return ctx.createBuffer(Buffer::CreateInfo{
+          .size = instancesSize,
+          .bufferUsage = vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR |
+            vk::BufferUsageFlagBits::eShaderDeviceAddress,
+          .memoryUsage = VMA_MEMORY_USAGE_AUTO,
+          .allocationCreate = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+          .minAlignment = 16,
+          .name = info.name,
+        });
+      }},
+    // Refits need less scratch memory than builds on most drivers, but not on all
+    .scratch = ctx.createBuffer(Buffer::CreateInfo{
+      .size = std::max(sizes.buildScratchSize, sizes.updateScratchSize),
+      .bufferUsage =
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+      .minAlignment = properties.minAccelerationStructureScratchOffsetAlignment,
+      .name = info.name,
+    }),
+    .builtInstanceCount = std::nullopt,
+  });
+  return id;
+}
+
+const AccelerationStructure& AccelerationStructureBuilder::getTlas(TlasId id) const
+{
+  return const_cast<AccelerationStructureBuilder&>(*this).getTlasSlot(id).structure;
+}
+
+void AccelerationStructureBuilder::destroyTlas(TlasId id)
+{
+  auto blasIds = std::move(getTlasSlot(id).blases);
+  get_context().getDeferredDestroyQueue().retire(std::move(getTlasSlot(id)));
+  tlases[static_cast<uint32_t>(id)].reset();
+  releaseSuperseded(blasIds);
+}
+
+bool AccelerationStructureBuilder::isTlasOutdated(TlasId id) const
+{
+  return const_cast<AccelerationStructureBuilder&>(*this).getTlasSlot(id).outdated;
+}
+
+void AccelerationStructureBuilder::releaseSuperseded(std::span<const BlasId> ids)
+{
+  for (auto id : ids)
+  {
+    auto& slot = blases[static_cast<uint32_t>(id)];
+    if (!slot.has_value() || slot->superseded.empty())
+      continue;
+    const bool referenced = std::any_of(tlases.begin(), tlases.end(), [id](const auto& tlas) {
+      return tlas.has_value() && tlas->outdated &&
+        std::binary_search(tlas->blases.begin(), tlas->blases.end(), id);
+    });
+    if (referenced)
+      continue;
+    // Traces recorded before the rebuilds might still use them
+    get_context().getDeferredDestroyQueue().retire(std::move(slot->superseded));
+    slot->superseded.clear();
+  }
+}
+
+Buffer& AccelerationStructureBuilder::getScratch(vk::DeviceSize size)
+{
+  if (blasScratchSize >= size)
+    return blasScratch;
+
+  // Builds recorded earlier might still be using the old one
+  if (blasScratch.get())
+    get_context().getDeferredDestroyQueue().retire(std::move(blasScratch));
+  blasScratch = get_context().createBuffer(Buffer::CreateInfo{
+    .size = size,
+    .bufferUsage =
+      vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+    .minAlignment = properties.minAccelerationStructureScratchOffsetAlignment,
+    .name = "blas_scratch",
+  });
+  blasScratchSize = size;
+  return blasScratch;
+}
+
+void AccelerationStructureBuilder::recordBuilds(vk::CommandBuffer cmd)
+{
+  ZoneScoped;
+
+  recordCompactions(cmd);
+  recordBlasBuilds(cmd);
+}
+
+void AccelerationStructureBuilder::recordCompactions(vk::CommandBuffer cmd)
+{
+  std::vector<std::pair<BlasId, AccelerationStructure>> compactions;
+
+  // Same grace period as the deferred destroy queue uses
+  const auto& workCount = get_context().getMainWorkCount();
+  const std::uint64_t gracePeriod = workCount.multiBufferingCount() + 1;
+
+  for (auto it = compactionQueries.begin(); it != compactionQueries.end();)
+  {
+    if (it->batch + gracePeriod > workCount.batchIndex())
+    {
+      ++it;
+      continue;
+    }
+
+    const auto count = static_cast<uint32_t>(it->structures.size());
+    auto [result, sizes] = device.getQueryPoolResults<vk::DeviceSize>(
+      it->pool.get(),
+      0,
+      count,
+      count * sizeof(vk::DeviceSize),
+      sizeof(vk::DeviceSize),
+      vk::QueryResultFlagBits::e64);
+    // The command buffer was submitted later than the batch it was recorded in
+    if (result == vk::Result::eNotReady)
+    {
+      ++it;
+      continue;
+    }
+    ETNA_VERIFYF(result == vk::Result::eSuccess, "Vulkan error: {}", vk::to_string(result));
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+      auto& slot = blases[static_cast<uint32_t>(it->structures[i])];
+      if (!slot.has_value())
+        continue;
+      compactions.emplace_back(
+        it->structures[i],
+        AccelerationStructure{AccelerationStructure::CreateInfo{
+          .type = vk::AccelerationStructureTypeKHR::eBottomLevel,
+          .size = sizes[i],
+          .name = slot->name,
+        }});
+    }
+    it = compactionQueries.erase(it);
+  }
+
+  if (compactions.empty())
+    return;
+
+  for (auto& [id, compacted] : compactions)
+  {
+    set_state(
+      cmd,
+      getBlasSlot(id).structure.getBuffer().get(),
+      vk::PipelineStageFlagBits2::eAccelerationStructureBuildKHR,
+      vk::AccessFlagBits2::eAccelerationStructureReadKHR);
+    set_state(
+      cmd,
+      compacted.getBuffer().get(),
+      vk::PipelineStageFlagBits2::eAccelerationStructureBuildKHR,
+      vk::AccessFlagBits2::eAccelerationStructureWriteKHR);
+  }
+  flush_barriers(cmd);
+
+  for (auto& [id, compacted] : compactions)
+  {
+    auto& blas = getBlasSlot(id);
+    cmd.copyAccelerationStructureKHR(vk::CopyAccelerationStructureInfoKHR{
+      .src = blas.structure.get(),
+      .dst = compacted.get(),
+      .mode = vk::CopyAccelerationStructureModeKHR::eCompact,
+    });
+
+    // TLASes built with the original refer to it by address until they are rebuilt
+    bool referenced = false;
+    for (auto& tlas : tlases)
+      if (tlas.has_value() && std::binary_search(tlas->blases.begin(), tlas->blases.end(), id))
+      {
+        tlas->outdated = true;
+        referenced = true;
+      }
+    if (referenced)
+      blas.superseded.push_back(std::move(blas.structure));
+    else
+      get_context().getDeferredDestroyQueue().retire(std::move(blas.structure));
+    blas.structure = std::move(compacted);
+  }
+}
+
+void AccelerationStructureBuilder::recordBlasBuilds(vk::CommandBuffer cmd)
+{
+  if (pendingBuilds.empty())
+    return;
+
+  // Builds are split into batches whose scratch memory fits into the budget,
+  // every build in a batch gets its own part of the scratch buffer
+  const vk::DeviceSize alignment = properties.minAccelerationStructureScratchOffsetAlignment;
+  std::vector<vk::DeviceSize> scratchOffsets;
+  std::vector<std::size_t> batchEnds;
+  vk::DeviceSize batchSize = 0;
+  vk::DeviceSize maxBatchSize = 0;
+  for (std::size_t i = 0; i < pendingBuilds.size(); ++i)
+  {
+    const vk::DeviceSize size = align_up(getBlasSlot(pendingBuilds[i]).scratchSize, alignment);
+    if (batchSize > 0 && batchSize + size > params.scratchBudget)
+    {
+      batchEnds.push_back(i);
+      batchSize = 0;
+    }
+    scratchOffsets.push_back(batchSize);
+    batchSize += size;
+    maxBatchSize = std::max(maxBatchSize, batchSize);
+  }
+  batchEnds.push_back(pendingBuilds.size());
+
+  const Buffer& scratch = getScratch(maxBatchSize);
+  const vk::DeviceAddress scratchAddress = scratch.getDeviceAddress();
+
+  std::size_t batchBegin = 0;
+  for (std::size_t batchEnd : batchEnds)
+  {
+    std::vector<vk::AccelerationStructureBuildGeometryInfoKHR> infos;
+    std::vector<const vk::AccelerationStructureBuildRangeInfoKHR*> ranges;
+
+    // The previous batch has to be done with the scratch memory
+    set_state(
+      cmd,
+      scratch.get(),
+      vk::PipelineStageFlagBits2::eAccelerationStructureBuildKHR,
+      SCRATCH_ACCESS,
+      ForceSetState::eTrue);
+    for (std::size_t i = batchBegin; i < batchEnd; ++i)
+    {
+      auto& blas = getBlasSlot(pendingBuilds[i]);
+      set_state(
+        cmd,
+        blas.structure.getBuffer().get(),
+        vk::PipelineStageFlagBits2::eAccelerationStructureBuildKHR,
+        vk::AccessFlagBits2::eAccelerationStructureWriteKHR);
+
+      auto& info = infos.emplace_back(vk::AccelerationStructureBuildGeometryInfoKHR{
+        .type = vk::AccelerationStructureTypeKHR::eBottomLevel,
+        .flags = blas.pending->flags,
+        .mode = vk::BuildAccelerationStructureModeKHR::eBuild,
+        .dstAccelerationStructure = blas.structure.get(),
+      });
+      info.setGeometries(blas.pending->geometries);
+      info.scratchData.deviceAddress = scratchAddress + scratchOffsets[i];
+      ranges.push_back(blas.pending->ranges.data());
+    }
+    flush_barriers(cmd);
+
+    cmd.buildAccelerationStructuresKHR(infos, ranges);
+    batchBegin = batchEnd;
+  }
+
+  // Compacted sizes are only known after the builds are done
+  std::vector<BlasId> compactable;
+  std::vector<vk::AccelerationStructureKHR> structures;
+  for (auto id : pendingBuilds)
+  {
+    auto& blas = getBlasSlot(id);
+    blas.pending.reset();
+    if (!blas.compactable)
+      continue;
+    compactable.push_back(id);
+    structures.push_back(blas.structure.get());
+    set_state(
+      cmd,
+      blas.structure.getBuffer().get(),
+      vk::PipelineStageFlagBits2::eAccelerationStructureBuildKHR,
+      vk::AccessFlagBits2::eAccelerationStructureReadKHR);
+  }
+  pendingBuilds.clear();
+
+  if (compactable.empty())
+    return;
+
+  flush_barriers(cmd);
+
+  const auto queryCount = static_cast<uint32_t>(compactable.size());
+  auto pool = unwrap_vk_result(device.createQueryPoolUnique(vk::QueryPoolCreateInfo{
+    .queryType = vk::QueryType::eAccelerationStructureCompactedSizeKHR,
+    .queryCount = queryCount,
+  }));
+  cmd.resetQueryPool(pool.get(), 0, queryCount);
+  cmd.writeAccelerationStructuresPropertiesKHR(
+    structures, vk::QueryType::eAccelerationStructureCompactedSizeKHR, pool.get(), 0);
+  compactionQueries.push_back(CompactionQuery{
+    std::move(pool), std::move(compactable), get_context().getMainWorkCount().batchIndex()});
+}
+
+void AccelerationStructureBuilder::recordTlasBuild(
+  vk::CommandBuffer cmd, TlasId id, std::span<const Instance> instances, bool refit)
+{
+  ZoneScoped;
+
+  auto& tlas = getTlasSlot(id);
+  ETNA_VERIFYF(
+    instances.size() <= tlas.info.maxInstances,
+    "TLAS {} was created for {} instances, but got {}",
+    tlas.info.name,
+    tlas.info.maxInstances,
+    instances.size());
+
+  Buffer& instanceBuffer = tlas.instances.get();
+  std::byte* data = instanceBuffer.map();
+  for (std::size_t i = 0; i < instances.size(); ++i)
+  {
+    const auto& instance = instances[i];
+    const auto& blas = getBlasSlot(instance.blas).structure;
+    vk::AccelerationStructureInstanceKHR vkInstance{
+      .instanceCustomIndex = instance.customIndex,
+      .mask = instance.mask,
+      .instanceShaderBindingTableRecordOffset = instance.hitGroupOffset,
+      .flags = static_cast<VkGeometryInstanceFlagsKHR>(instance.flags),
+      .accelerationStructureReference = blas.getDeviceAddress(),
+    };
+    std::memcpy(&vkInstance.transform, instance.transform.data(), sizeof(vkInstance.transform));
+    std::memcpy(data + i * sizeof(vkInstance), &vkInstance, sizeof(vkInstance));
+
+    set_state(
+      cmd,
+      blas.getBuffer().get(),
+      vk::PipelineStageFlagBits2::eAccelerationStructureBuildKHR,
+      vk::AccessFlagBits2::eAccelerationStructureReadKHR);
+  }
+  instanceBuffer.unmap();
+
+  // Updates have to keep the same amount of primitives, and compacted BLASes
+  // are better off with a proper build
+  const auto instanceCount = static_cast<uint32_t>(instances.size());
+  const bool update = refit && !tlas.outdated && tlas.builtInstanceCount == instanceCount &&
+    (tlas.info.flags & vk::BuildAccelerationStructureFlagBitsKHR::eAllowUpdate);
+
+  set_state(
+    cmd,
+    tlas.scratch.get(),
+    vk::PipelineStageFlagBits2::eAccelerationStructureBuildKHR,
+    SCRATCH_ACCESS,
+    ForceSetState::eTrue);
+  set_state(
+    cmd,
+    tlas.structure.getBuffer().get(),
+    vk::PipelineStageFlagBits2::eAccelerationStructureBuildKHR,
+    update ? SCRATCH_ACCESS : vk::AccessFlagBits2::eAccelerationStructureWriteKHR,
+    ForceSetState::eTrue);
+  flush_barriers(cmd);
+
+  const auto geometry = get_instances_geometry(instanceBuffer.getDeviceAddress());
+  vk::AccelerationStructureBuildGeometryInfoKHR buildInfo{
+    .type = vk::AccelerationStructureTypeKHR::eTopLevel,
+    .flags = tlas.info.flags,
+    .mode = update ? vk::BuildAccelerationStructureModeKHR::eUpdate
+                   : vk::BuildAccelerationStructureModeKHR::eBuild,
+    .srcAccelerationStructure = update ? tlas.structure.get() : vk::AccelerationStructureKHR{},
+    .dstAccelerationStructure = tlas.structure.get(),
+  };
+  buildInfo.setGeometries(geometry);
+  buildInfo.scratchData.deviceAddress = tlas.scratch.getDeviceAddress();
+
+  const vk::AccelerationStructureBuildRangeInfoKHR range{.primitiveCount = instanceCount};
+  const vk::AccelerationStructureBuildRangeInfoKHR* rangePtr = &range;
+  cmd.buildAccelerationStructuresKHR(buildInfo, rangePtr);
+
+  tlas.builtInstanceCount = instanceCount;
+
+  std::vector<BlasId> blasIds;
+  blasIds.reserve(instances.size());
+  for (const auto& instance : instances)
+    blasIds.push_back(instance.blas);
+  std::sort(blasIds.begin(), blasIds.end());
+  blasIds.erase(std::unique(blasIds.begin(), blasIds.end()), blasIds.end());
+
+  auto previous = std::exchange(tlas.blases, std::move(blasIds));
+  tlas.outdated = false;
+  releaseSuperseded(previous);
+}
+
+} // namespace etna
@@ -0,0 +1,55 @@
+#include "BinaryIo.hpp"
+
+#include <fstream>
+
+
+namespace etna
+{
+
+std::optional<std::vector<std::byte>> read_binary_file(const std::filesystem::path& path)
+{
+  std::ifstream file(path, std::ios::ate | std::ios::binary);
+  if (!file.is_open())
+    return std::nullopt;
+
+  const auto size = static_cast<std::size_t>(file.tellg());
+  std::vector<std::byte> result(size);
+
+  file.seekg(0);
+  file.read(reinterpret_cast<char*>(result.data()), static_cast<std::streamsize>(size));
+  if (!file)
+    return std::nullopt;
+
+  return result;
+}
+
+bool write_binary_file_atomically(
+  const std::filesystem::path& path, std::span<std::byte const> data)
+{
+  std::error_code ec;
+  if (path.has_parent_path())
+    std::filesystem::create_directories(path.parent_path(), ec);
+
+  auto tmpPath = path;
+  tmpPath += ".tmp";
+
+  {
+    std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+      return false;
+    file.write(
+      reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    if (!file)
+      return false;
+  }
+
+  std::filesystem::rename(tmpPath, path, ec);
+  if (ec)
+  {
+    std::filesystem::remove(tmpPath, ec);
+    return false;
+  }
+  return true;
+}
+
+} // namespace etna
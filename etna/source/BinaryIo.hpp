@@ -0,0 +1,126 @@
+#pragma once
+#ifndef ETNA_BINARY_IO_HPP_INCLUDED
+#define ETNA_BINARY_IO_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+
+namespace etna
+{
+
+// Not cryptographic in any way, but good enough for detecting changed files.
+// NOTE: 64-bit FNV-1a, so the result is stable across runs and platforms.
+inline uint64_t content_hash(std::span<std::byte const> data, uint64_t seed = 0xcbf29ce484222325)
+{
+  uint64_t hash = seed;
+  for (std::byte b : data)
+  {
+    hash ^= static_cast<uint64_t>(b);
+    hash *= 0x100000001b3;
+  }
+  return hash;
+}
+
+/**
+ * Appends trivially copyable values to a byte buffer in native endianness.
+ * Only intended for caches and other files that are produced and consumed
+ * by etna itself.
+ */
+class BinaryWriter
+{
+public:
+  template <class T>
+    requires std::is_trivially_copyable_v<T>
+  void write(const T& value)
+  {
+    const auto* bytes = reinterpret_cast<const std::byte*>(&value);
+    data.insert(data.end(), bytes, bytes + sizeof(T));
+  }
+
+  void writeBytes(std::span<std::byte const> bytes)
+  {
+    write(static_cast<uint64_t>(bytes.size()));
+    data.insert(data.end(), bytes.begin(), bytes.end());
+  }
+
+  void writeString(std::string_view str) { writeBytes(std::as_bytes(std::span{str})); }
+
+  std::span<std::byte const> getData() const { return data; }
+  std::vector<std::byte> extractData() && { return std::move(data); }
+
+private:
+  std::vector<std::byte> data;
+};
+
+/**
+ * Counterpart of BinaryWriter. Every read returns false instead of going out
+ * of bounds, so that broken or truncated files are simply ignored.
+ */
+class BinaryReader
+{
+public:
+  explicit BinaryReader(std::span<std::byte const> in_data)
+    : data{in_data}
+  {
+  }
+
+  template <class T>
+    requires std::is_trivially_copyable_v<T>
+  [[nodiscard]] bool read(T& value)
+  {
+    if (data.size() - offset < sizeof(T))
+      return false;
+    std::memcpy(&value, data.data() + offset, sizeof(T));
+    offset += sizeof(T);
+    return true;
+  }
+
+  // The result points into the underlying buffer
+  [[nodiscard]] bool readBytes(std::span<std::byte const>& bytes)
+  {
+    uint64_t size = 0;
+    if (!read(size) || data.size() - offset < size)
+      return false;
+    bytes = data.subspan(offset, static_cast<std::size_t>(size));
+    offset += static_cast<std::size_t>(size);
+    return true;
+  }
+
+  [[nodiscard]] bool readString(std::string& str)
+  {
+    std::span<std::byte const> bytes;
+    if (!readBytes(bytes))
+      return false;
+    str.assign(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    return true;
+  }
+
+  std::size_t getOffset() const { return offset; }
+  // Bounds element counts read from broken files before allocating anything
+  std::size_t getRemaining() const { return data.size() - offset; }
+  bool isAtEnd() const { return offset == data.size(); }
+
+private:
+  std::span<std::byte const> data;
+  std::size_t offset = 0;
+};
+
+std::optional<std::vector<std::byte>> read_binary_file(const std::filesystem::path& path);
+
+// Writes to a temporary file first and then renames it, so that a crash
+// never leaves a half-written file behind. Returns false on failure.
+bool write_binary_file_atomically(
+  const std::filesystem::path& path, std::span<std::byte const> data);
+
+} // namespace etna
+
+#endif // ETNA_BINARY_IO_HPP_INCLUDED
@@ -1,6 +1,7 @@
 #include <etna/Buffer.hpp>
 
 #include <etna/BindingItems.hpp>
+#include <etna/GlobalContext.hpp>
 #include "DebugUtils.hpp"
 
 
@@ -28,10 +29,11 @@ Buffer::Buffer(VmaAllocator alloc, CreateInfo info)
   };
 
   VkBuffer buf;
-  auto retcode = vmaCreateBuffer(
+  auto retcode = vmaCreateBufferWithAlignment(
     allocator,
     &static_cast<const VkBufferCreateInfo&>(bufInfo),
     &allocInfo,
+    info.minAlignment,
     &buf,
     &allocation,
     nullptr);
@@ -110,6 +112,11 @@ void Buffer::unmap()
   mapped = nullptr;
 }
 
+vk::DeviceAddress Buffer::getDeviceAddress() const
+{
+  return get_context().getDevice().getBufferAddress(vk::BufferDeviceAddressInfo{.buffer = buffer});
+}
+
 BufferBinding Buffer::genBinding(vk::DeviceSize offset, vk::DeviceSize range) const
 {
   return BufferBinding{this, vk::DescriptorBufferInfo{get(), offset, range}};
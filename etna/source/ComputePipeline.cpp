@@ -0,0 +1,37 @@
+#include <etna/ComputePipeline.hpp>
+
+#include <etna/Etna.hpp>
+#include <etna/PipelineManager.hpp>
+
+
+namespace etna
+{
+
+std::array<uint32_t, 3> ComputePipeline::getWorkgroupSize() const
+{
+  return getOwner()->getWorkgroupSize(getId());
+}
+
+void ComputePipeline::dispatchThreads(
+  vk::CommandBuffer cmd, uint32_t threads_x, uint32_t threads_y, uint32_t threads_z) const
+{
+  const auto size = getWorkgroupSize();
+  cmd.dispatch(
+    (threads_x + size[0] - 1) / size[0],
+    (threads_y + size[1] - 1) / size[1],
+    (threads_z + size[2] - 1) / size[2]);
+}
+
+void ComputePipeline::dispatchIndirect(
+  vk::CommandBuffer cmd, const Buffer& buffer, vk::DeviceSize offset) const
+{
+  set_state(
+    cmd,
+    buffer.get(),
+    vk::PipelineStageFlagBits2::eDrawIndirect,
+    vk::AccessFlagBits2::eIndirectCommandRead);
+  flush_barriers(cmd);
+  cmd.dispatchIndirect(buffer.get(), offset);
+}
+
+} // namespace etna
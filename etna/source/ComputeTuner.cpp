@@ -0,0 +1,238 @@
+#include <etna/ComputeTuner.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+#include <fmt/std.h>
+#include <tracy/Tracy.hpp>
+
+#include <etna/GlobalContext.hpp>
+#include <etna/OneShotCmdMgr.hpp>
+#include <etna/PipelineManager.hpp>
+
+#include "BinaryIo.hpp"
+
+
+namespace etna
+{
+
+static constexpr uint32_t TUNING_RESULTS_MAGIC = 0x52545445; // "ETTR"
+static constexpr uint32_t TUNING_RESULTS_VERSION = 1;
+
+static uint64_t hash_candidates(std::span<const SpecializationConstants> candidates)
+{
+  BinaryWriter writer;
+  for (const auto& candidate : candidates)
+  {
+    writer.write(static_cast<uint32_t>(candidate.getValues().size()));
+    for (const auto& value : candidate.getValues())
+    {
+      writer.writeString(value.name);
+      writer.write(value.constantId);
+      writer.write(value.bits);
+      writer.write(value.size);
+    }
+  }
+  return content_hash(writer.getData());
+}
+
+ComputeTuner::ComputeTuner(CreateInfo info)
+  : path{std::move(info.resultsPath)}
+  , iterations{std::max(info.iterations, 1u)}
+{
+  ZoneScoped;
+
+  auto& ctx = get_context();
+  if (path.empty() && !ctx.getPipelineManager().getPipelineCachePath().empty())
+  {
+    path = ctx.getPipelineManager().getPipelineCachePath();
+    path += ".tuning";
+  }
+
+  const auto properties = ctx.getPhysicalDevice()
+                            .getProperties2<
+                              vk::PhysicalDeviceProperties2,
+                              vk::PhysicalDeviceIDProperties>();
+  const auto& general = properties.get<vk::PhysicalDeviceProperties2>().properties;
+  deviceUuid = properties.get<vk::PhysicalDeviceIDProperties>().deviceUUID;
+  driverVersion = general.driverVersion;
+  timestampPeriod = general.limits.timestampPeriod;
+  const auto queueFamilies = ctx.getPhysicalDevice().getQueueFamilyProperties();
+  timestampValidBits = queueFamilies[ctx.getQueueFamilyIdx()].timestampValidBits;
+
+  if (path.empty())
+    return;
+
+  auto data = read_binary_file(path);
+  if (!data.has_value())
+    return;
+
+  // Every result takes at least this much, which bounds counts of broken files
+  static constexpr std::size_t MIN_RESULT_SIZE =
+    vk::UuidSize + sizeof(uint32_t) + sizeof(uint64_t) + sizeof(uint64_t) + sizeof(uint32_t);
+
+  BinaryReader reader{*data};
+  uint32_t magic = 0;
+  uint32_t version = 0;
+  uint32_t count = 0;
+  if (
+    !reader.read(magic) || magic != TUNING_RESULTS_MAGIC || !reader.read(version) ||
+    version != TUNING_RESULTS_VERSION || !reader.read(count) ||
+    count > reader.getRemaining() / MIN_RESULT_SIZE)
+  {
+    spdlog::warn("Compute tuning results {} are outdated or broken, ignoring them", path);
+    return;
+  }
+
+  results.resize(count);
+  for (auto& result : results)
+    if (
+      !reader.read(result.deviceUuid) || !reader.read(result.driverVersion) ||
+      !reader.readString(result.name) || !reader.read(result.candidatesHash) ||
+      !reader.read(result.chosen))
+    {
+      spdlog::warn("Compute tuning results {} are truncated, ignoring them", path);
+      results.clear();
+      return;
+    }
+}
+
+ComputePipeline ComputeTuner::tune(const TuneInfo& info)
+{
+  ZoneScoped;
+
+  ETNA_VERIFYF(!info.candidates.empty(), "No candidates to tune {} with!", info.name);
+
+  auto& pipelineManager = get_context().getPipelineManager();
+  const uint64_t candidatesHash = hash_candidates(info.candidates);
+
+  auto known = std::find_if(results.begin(), results.end(), [&](const Result& result) {
+    return result.deviceUuid == deviceUuid && result.driverVersion == driverVersion &&
+      result.name == info.name;
+  });
+  const bool upToDate = known != results.end() && known->candidatesHash == candidatesHash &&
+    known->chosen < info.candidates.size();
+  if (upToDate)
+    return pipelineManager.createComputePipeline(
+      info.shaderProgramName,
+      ComputePipeline::CreateInfo{.specializationConstants = info.candidates[known->chosen]});
+
+  const uint32_t chosen = measure(info);
+  if (known == results.end())
+    known = results.insert(results.end(), Result{deviceUuid, driverVersion, info.name, 0, 0});
+  known->candidatesHash = candidatesHash;
+  known->chosen = chosen;
+  dirty = true;
+
+  return pipelineManager.createComputePipeline(
+    info.shaderProgramName,
+    ComputePipeline::CreateInfo{.specializationConstants = info.candidates[chosen]});
+}
+
+uint32_t ComputeTuner::measure(const TuneInfo& info)
+{
+  if (timestampValidBits == 0)
+  {
+    spdlog::warn("Timestamps are not supported, using the first candidate for {}", info.name);
+    return 0;
+  }
+
+  const vk::Device device = get_context().getDevice();
+  auto cmdMgr = get_context().createOneShotCmdMgr();
+  const uint32_t queryCount = 2 * iterations;
+  auto queryPool = unwrap_vk_result(device.createQueryPoolUnique(vk::QueryPoolCreateInfo{
+    .queryType = vk::QueryType::eTimestamp,
+    .queryCount = queryCount,
+  }));
+
+  // Dispatches must neither overlap each other nor the timestamps
+  const vk::MemoryBarrier2 serialize{
+    .srcStageMask = vk::PipelineStageFlagBits2::eAllCommands,
+    .srcAccessMask = vk::AccessFlagBits2::eMemoryWrite,
+    .dstStageMask = vk::PipelineStageFlagBits2::eAllCommands,
+    .dstAccessMask = vk::AccessFlagBits2::eMemoryRead | vk::AccessFlagBits2::eMemoryWrite,
+  };
+
+  uint32_t best = 0;
+  double bestTime = 0;
+  for (uint32_t i = 0; i < info.candidates.size(); ++i)
+  {
+    auto pipeline = get_context().getPipelineManager().createComputePipeline(
+      info.shaderProgramName,
+      ComputePipeline::CreateInfo{.specializationConstants = info.candidates[i]});
+
+    auto cmd = cmdMgr->start();
+    ETNA_CHECK_VK_RESULT(cmd.begin(vk::CommandBufferBeginInfo{
+      .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit,
+    }));
+    cmd.resetQueryPool(queryPool.get(), 0, queryCount);
+    cmd.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.getVkPipeline());
+
+    // The first dispatch warms up caches and clocks and is not timed
+    info.recordDispatch(cmd, pipeline);
+    for (uint32_t j = 0; j < iterations; ++j)
+    {
+      cmd.pipelineBarrier2(vk::DependencyInfo{}.setMemoryBarriers(serialize));
+      cmd.writeTimestamp2(vk::PipelineStageFlagBits2::eAllCommands, queryPool.get(), 2 * j);
+      info.recordDispatch(cmd, pipeline);
+      cmd.writeTimestamp2(vk::PipelineStageFlagBits2::eAllCommands, queryPool.get(), 2 * j + 1);
+    }
+    ETNA_CHECK_VK_RESULT(cmd.end());
+    cmdMgr->submitAndWait(cmd);
+
+    auto timestamps = unwrap_vk_result(device.getQueryPoolResults<uint64_t>(
+      queryPool.get(),
+      0,
+      queryCount,
+      queryCount * sizeof(uint64_t),
+      sizeof(uint64_t),
+      vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait));
+
+    // The counter might wrap around between the two timestamps
+    const uint64_t mask = timestampValidBits >= 64 ? ~uint64_t{0}
+                                                   : (uint64_t{1} << timestampValidBits) - 1;
+    std::vector<uint64_t> durations;
+    for (uint32_t j = 0; j < iterations; ++j)
+      durations.push_back(((timestamps[2 * j + 1] & mask) - (timestamps[2 * j] & mask)) & mask);
+    std::nth_element(durations.begin(), durations.begin() + iterations / 2, durations.end());
+    const double time = static_cast<double>(durations[iterations / 2]) * timestampPeriod;
+
+    spdlog::info("Tuning {}: candidate #{} takes {:.1f} us", info.name, i, time / 1000.0);
+    if (i == 0 || time < bestTime)
+    {
+      best = i;
+      bestTime = time;
+    }
+  }
+
+  spdlog::info("Tuning {}: candidate #{} is the fastest", info.name, best);
+  return best;
+}
+
+void ComputeTuner::save()
+{
+  if (path.empty() || !dirty)
+    return;
+
+  ZoneScoped;
+
+  BinaryWriter writer;
+  writer.write(TUNING_RESULTS_MAGIC);
+  writer.write(TUNING_RESULTS_VERSION);
+  writer.write(static_cast<uint32_t>(results.size()));
+  for (const auto& result : results)
+  {
+    writer.write(result.deviceUuid);
+    writer.write(result.driverVersion);
+    writer.writeString(result.name);
+    writer.write(result.candidatesHash);
+    writer.write(result.chosen);
+  }
+
+  if (write_binary_file_atomically(path, writer.getData()))
+    dirty = false;
+  else
+    spdlog::warn("Failed to write compute tuning results to {}", path);
+}
+
+} // namespace etna
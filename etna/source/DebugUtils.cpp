@@ -62,4 +62,9 @@ void set_debug_name(vk::Semaphore semaphore, const char* name)
   set_debug_name_base(semaphore, vk::ObjectType::eSemaphore, name);
 }
 
+void set_debug_name(vk::AccelerationStructureKHR structure, const char* name)
+{
+  set_debug_name_base(structure, vk::ObjectType::eAccelerationStructureKHR, name);
+}
+
 } // namespace etna
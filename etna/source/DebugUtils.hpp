@@ -12,6 +12,7 @@ void set_debug_name(vk::ImageView image_view, const char* name);
 void set_debug_name(vk::Buffer buffer, const char* name);
 void set_debug_name(vk::Sampler sampler, const char* name);
 void set_debug_name(vk::Semaphore semaphore, const char* name);
+void set_debug_name(vk::AccelerationStructureKHR structure, const char* name);
 
 } // namespace etna
 
@@ -0,0 +1,18 @@
+#include "DeferredDestroyQueue.hpp"
+
+
+namespace etna
+{
+
+void DeferredDestroyQueue::collect()
+{
+  // An object retired during batch N might have been recorded into that batch,
+  // which is only guaranteed to be complete after the slot of batch N gets
+  // reused. Depending on whether we are called before or after the user waits
+  // for that slot, this might be one batch late, so we wait for an extra one.
+  const std::uint64_t gracePeriod = workCount.multiBufferingCount() + 1;
+  while (!retired.empty() && retired.front().batch + gracePeriod <= workCount.batchIndex())
+    retired.pop_front();
+}
+
+} // namespace etna
@@ -0,0 +1,74 @@
+#pragma once
+#ifndef ETNA_DEFERRED_DESTROY_QUEUE_HPP_INCLUDED
+#define ETNA_DEFERRED_DESTROY_QUEUE_HPP_INCLUDED
+
+#include <deque>
+#include <memory>
+#include <type_traits>
+
+#include <etna/GpuWorkCount.hpp>
+
+
+namespace etna
+{
+
+/**
+ * Keeps objects that might still be used by in-flight GPU work alive until the
+ * grace period of the work stream passes, which allows replacing pipelines and
+ * such on the fly without waiting for the GPU to go idle.
+ */
+class DeferredDestroyQueue
+{
+public:
+  explicit DeferredDestroyQueue(const GpuWorkCount& work_count)
+    : workCount{work_count}
+  {
+  }
+
+  DeferredDestroyQueue(const DeferredDestroyQueue&) = delete;
+  DeferredDestroyQueue& operator=(const DeferredDestroyQueue&) = delete;
+
+  // Takes ownership of a RAII object (vk::UniqueX, etna::Buffer, etc)
+  template <class T>
+    requires(!std::is_lvalue_reference_v<T>)
+  void retire(T&& object)
+  {
+    auto holder = std::make_unique<Holder<std::remove_cvref_t<T>>>(std::move(object));
+    retired.push_back(Entry{workCount.batchIndex(), std::move(holder)});
+  }
+
+  // Destroys everything the GPU can no longer be using, call once per frame
+  void collect();
+
+  // Only valid to call when the GPU is idle
+  void clear() { retired.clear(); }
+
+private:
+  struct HolderBase
+  {
+    virtual ~HolderBase() = default;
+  };
+
+  template <class T>
+  struct Holder : HolderBase
+  {
+    explicit Holder(T&& obj)
+      : object{std::move(obj)}
+    {
+    }
+    T object;
+  };
+
+  struct Entry
+  {
+    std::uint64_t batch;
+    std::unique_ptr<HolderBase> holder;
+  };
+
+  const GpuWorkCount& workCount;
+  std::deque<Entry> retired;
+};
+
+} // namespace etna
+
+#endif // ETNA_DEFERRED_DESTROY_QUEUE_HPP_INCLUDED
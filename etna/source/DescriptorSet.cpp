@@ -4,6 +4,7 @@
 #include <vector>
 
 #include <etna/DescriptorSet.hpp>
+#include <etna/AccelerationStructure.hpp>
 #include <etna/Etna.hpp>
 #include <etna/Vulkan.hpp>
 
@@ -23,14 +24,27 @@ static constexpr uint32_t NUM_RW_TEXTURES = 512;
 static constexpr uint32_t NUM_BUFFERS = 2048;
 static constexpr uint32_t NUM_RW_BUFFERS = 512;
 static constexpr uint32_t NUM_SAMPLERS = 128;
+static constexpr uint32_t NUM_ACCELERATION_STRUCTURES = 64;
 
-static constexpr std::array<vk::DescriptorPoolSize, 6> DEFAULT_POOL_SIZES{
+static constexpr std::array<vk::DescriptorPoolSize, 7> DEFAULT_POOL_SIZES{
   vk::DescriptorPoolSize{vk::DescriptorType::eUniformBuffer, NUM_BUFFERS},
   vk::DescriptorPoolSize{vk::DescriptorType::eStorageBuffer, NUM_RW_BUFFERS},
   vk::DescriptorPoolSize{vk::DescriptorType::eSampler, NUM_SAMPLERS},
   vk::DescriptorPoolSize{vk::DescriptorType::eSampledImage, NUM_RW_TEXTURES},
   vk::DescriptorPoolSize{vk::DescriptorType::eStorageImage, NUM_RW_TEXTURES},
-  vk::DescriptorPoolSize{vk::DescriptorType::eCombinedImageSampler, NUM_TEXTURES}};
+  vk::DescriptorPoolSize{vk::DescriptorType::eCombinedImageSampler, NUM_TEXTURES},
+  // Must stay last, it is only used when the extension is enabled
+  vk::DescriptorPoolSize{
+    vk::DescriptorType::eAccelerationStructureKHR, NUM_ACCELERATION_STRUCTURES}};
+
+static vk::DescriptorPoolCreateInfo get_pool_create_info(bool acceleration_structures)
+{
+  return vk::DescriptorPoolCreateInfo{
+    .maxSets = NUM_DESCRIPTORS,
+    .poolSizeCount =
+      static_cast<std::uint32_t>(DEFAULT_POOL_SIZES.size() - (acceleration_structures ? 0 : 1)),
+    .pPoolSizes = DEFAULT_POOL_SIZES.data()};
+}
 
 uint32_t get_num_descriptors_in_pool_for_type(vk::DescriptorType type)
 {
@@ -90,15 +104,13 @@ static vk::DescriptorSet allocate_desciptor_set_from_pool(
   return vkSet;
 }
 
-DynamicDescriptorPool::DynamicDescriptorPool(vk::Device dev, const GpuWorkCount& work_count)
+DynamicDescriptorPool::DynamicDescriptorPool(
+  vk::Device dev, const GpuWorkCount& work_count, bool acceleration_structures)
   : vkDevice{dev}
   , workCount{work_count}
-  , pools{work_count, [dev](std::size_t) {
-            vk::DescriptorPoolCreateInfo info{
-              .maxSets = NUM_DESCRIPTORS,
-              .poolSizeCount = static_cast<std::uint32_t>(DEFAULT_POOL_SIZES.size()),
-              .pPoolSizes = DEFAULT_POOL_SIZES.data()};
-            return unwrap_vk_result(dev.createDescriptorPoolUnique(info));
+  , pools{work_count, [dev, acceleration_structures](std::size_t) {
+            return unwrap_vk_result(
+              dev.createDescriptorPoolUnique(get_pool_create_info(acceleration_structures)));
           }}
 {
 }
@@ -126,12 +138,10 @@ DescriptorSet DynamicDescriptorPool::allocateSet(
     workCount.batchIndex(), layout_id, vkSet, std::move(bindings), command_buffer, behavior};
 }
 
-PersistentDescriptorPool::PersistentDescriptorPool(vk::Device dev)
+PersistentDescriptorPool::PersistentDescriptorPool(vk::Device dev, bool acceleration_structures)
   : vkDevice{dev}
-  , pool{unwrap_vk_result(dev.createDescriptorPoolUnique(vk::DescriptorPoolCreateInfo{
-      .maxSets = NUM_DESCRIPTORS,
-      .poolSizeCount = static_cast<std::uint32_t>(DEFAULT_POOL_SIZES.size()),
-      .pPoolSizes = DEFAULT_POOL_SIZES.data()}))}
+  , pool{unwrap_vk_result(
+      dev.createDescriptorPoolUnique(get_pool_create_info(acceleration_structures)))}
 {
 }
 
@@ -151,6 +161,7 @@ static bool is_image_resource(vk::DescriptorType ds_type)
   case vk::DescriptorType::eStorageBuffer:
   case vk::DescriptorType::eUniformBufferDynamic:
   case vk::DescriptorType::eStorageBufferDynamic:
+  case vk::DescriptorType::eAccelerationStructureKHR:
     return false;
   case vk::DescriptorType::eCombinedImageSampler:
   case vk::DescriptorType::eSampledImage:
@@ -164,6 +175,17 @@ static bool is_image_resource(vk::DescriptorType ds_type)
   ETNA_PANIC("Descriptor write error : unsupported resource {}", vk::to_string(ds_type));
 }
 
+static const char* get_binding_kind(const Binding& binding)
+{
+  if (std::holds_alternative<ImageBinding>(binding.resources))
+    return "image";
+  if (std::holds_alternative<SamplerBinding>(binding.resources))
+    return "sampler";
+  if (std::holds_alternative<AccelerationStructureBinding>(binding.resources))
+    return "acceleration structure";
+  return "buffer";
+}
+
 template <class TDescriptorSet>
 static void validate_descriptor_write(
   const TDescriptorSet& dst, std::bitset<MAX_DESCRIPTOR_BINDINGS> partially_writable_bindings)
@@ -186,15 +208,22 @@ static void validate_descriptor_write(
 
     const auto& bindingInfo = layoutInfo.getBinding(binding.binding);
     bool isImageRequired = is_image_resource(bindingInfo.descriptorType);
+    bool isStructureRequired =
+      bindingInfo.descriptorType == vk::DescriptorType::eAccelerationStructureKHR;
     bool isImageBinding = std::get_if<ImageBinding>(&binding.resources) != nullptr;
     bool isSamplerBinding = std::get_if<SamplerBinding>(&binding.resources) != nullptr;
-    if (isImageRequired != (isImageBinding || isSamplerBinding))
+    bool isStructureBinding =
+      std::get_if<AccelerationStructureBinding>(&binding.resources) != nullptr;
+    if (
+      isImageRequired != (isImageBinding || isSamplerBinding) ||
+      isStructureRequired != isStructureBinding)
     {
       ETNA_PANIC(
         "Descriptor write error: slot {} {} required but {} bound",
         binding.binding,
-        (isImageRequired ? "image/sampler" : "buffer"),
-        (isImageBinding ? "image" : (isSamplerBinding ? "sampler" : "buffer")));
+        (isImageRequired ? "image/sampler"
+                         : (isStructureRequired ? "acceleration structure" : "buffer")),
+        get_binding_kind(binding));
     }
 
     unboundResources[binding.binding] -= 1;
@@ -258,6 +287,13 @@ void write_set(
   numImageInfo = 0;
   numBufferInfo = 0;
 
+  // Acceleration structures are written through a pNext chain instead, reserved
+  // up front so that the pointers stay valid
+  std::vector<vk::AccelerationStructureKHR> structures;
+  std::vector<vk::WriteDescriptorSetAccelerationStructureKHR> structureWrites;
+  structures.reserve(bindings.size());
+  structureWrites.reserve(bindings.size());
+
   for (const auto& binding : bindings)
   {
     const auto& bindingInfo = layoutInfo.getBinding(binding.binding);
@@ -278,6 +314,13 @@ void write_set(
       write.setPImageInfo(imageInfos.data() + numImageInfo);
       numImageInfo++;
     }
+    else if (bindingInfo.descriptorType == vk::DescriptorType::eAccelerationStructureKHR)
+    {
+      structures.push_back(std::get<AccelerationStructureBinding>(binding.resources).handle);
+      auto& structureWrite = structureWrites.emplace_back();
+      structureWrite.setAccelerationStructures({1, &structures.back()});
+      write.setPNext(&structureWrite);
+    }
     else
     {
       const auto buf = std::get<BufferBinding>(binding.resources).descriptor_info;
@@ -299,7 +342,7 @@ template void write_set<PersistentDescriptorSet>(
 constexpr static vk::PipelineStageFlags2 shader_stage_to_pipeline_stage(
   vk::ShaderStageFlags shader_stages)
 {
-  constexpr uint32_t MAPPING_LENGTH = 6;
+  constexpr uint32_t MAPPING_LENGTH = 14;
   constexpr std::array<vk::ShaderStageFlagBits, MAPPING_LENGTH> SHADER_STAGES = {
     vk::ShaderStageFlagBits::eVertex,
     vk::ShaderStageFlagBits::eTessellationControl,
@@ -307,6 +350,14 @@ constexpr static vk::PipelineStageFlags2 shader_stage_to_pipeline_stage(
     vk::ShaderStageFlagBits::eGeometry,
     vk::ShaderStageFlagBits::eFragment,
     vk::ShaderStageFlagBits::eCompute,
+    vk::ShaderStageFlagBits::eTaskEXT,
+    vk::ShaderStageFlagBits::eMeshEXT,
+    vk::ShaderStageFlagBits::eRaygenKHR,
+    vk::ShaderStageFlagBits::eMissKHR,
+    vk::ShaderStageFlagBits::eClosestHitKHR,
+    vk::ShaderStageFlagBits::eAnyHitKHR,
+    vk::ShaderStageFlagBits::eIntersectionKHR,
+    vk::ShaderStageFlagBits::eCallableKHR,
   };
   constexpr std::array<vk::PipelineStageFlagBits2, MAPPING_LENGTH> PIPELINE_STAGES = {
     vk::PipelineStageFlagBits2::eVertexShader,
@@ -315,6 +366,14 @@ constexpr static vk::PipelineStageFlags2 shader_stage_to_pipeline_stage(
     vk::PipelineStageFlagBits2::eGeometryShader,
     vk::PipelineStageFlagBits2::eFragmentShader,
     vk::PipelineStageFlagBits2::eComputeShader,
+    vk::PipelineStageFlagBits2::eTaskShaderEXT,
+    vk::PipelineStageFlagBits2::eMeshShaderEXT,
+    vk::PipelineStageFlagBits2::eRayTracingShaderKHR,
+    vk::PipelineStageFlagBits2::eRayTracingShaderKHR,
+    vk::PipelineStageFlagBits2::eRayTracingShaderKHR,
+    vk::PipelineStageFlagBits2::eRayTracingShaderKHR,
+    vk::PipelineStageFlagBits2::eRayTracingShaderKHR,
+    vk::PipelineStageFlagBits2::eRayTracingShaderKHR,
   };
 
   vk::PipelineStageFlags2 pipelineStages = vk::PipelineStageFlagBits2::eNone;
@@ -356,6 +415,17 @@ static void process_barriers_to_cmd_buf(
   auto& layoutInfo = get_context().getDescriptorSetLayouts().getLayoutInfo(layout_id);
   for (auto& binding : bindings)
   {
+    // Traces must wait for the builds of the structures they use
+    if (const auto* structure = std::get_if<AccelerationStructureBinding>(&binding.resources))
+    {
+      etna::set_state(
+        cmd_buffer,
+        structure->structure->getBuffer().get(),
+        shader_stage_to_pipeline_stage(layoutInfo.getBinding(binding.binding).stageFlags),
+        vk::AccessFlagBits2::eAccelerationStructureReadKHR);
+      continue;
+    }
+
     if (std::get_if<ImageBinding>(&binding.resources) == nullptr)
       continue; // Add processing for buffer here if you need.
 
@@ -42,6 +42,10 @@ void DescriptorSetInfo::addResource(
   bindings[binding.binding] = binding;
   bindingFlags[binding.binding] = flags;
 
+  // Allows restoring a set info from a list of bindings, e.g. when it was cached
+  if (flags & vk::DescriptorBindingFlagBits::eVariableDescriptorCount)
+    hasDynDescriptorArray = true;
+
   if (binding.binding + 1 > usedBindingsCap)
     usedBindingsCap = binding.binding + 1;
 
@@ -53,6 +57,7 @@ void DescriptorSetInfo::clear()
 {
   usedBindingsCap = 0;
   dynOffsets = 0;
+  hasDynDescriptorArray = false;
   usedBindings.reset();
   for (auto& binding : bindings)
     binding = vk::DescriptorSetLayoutBinding{};
@@ -0,0 +1,261 @@
+#include <etna/DynamicState.hpp>
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+#include <etna/Assert.hpp>
+
+
+namespace etna
+{
+
+void add_dynamic_states(
+  GraphicsPipeline::CreateInfo& info, std::span<const vk::DynamicState> states)
+{
+  auto& list = info.dynamicStates;
+  for (auto state : states)
+    if (std::find(list.begin(), list.end(), state) == list.end())
+      list.push_back(state);
+}
+
+std::string_view get_dynamic_state_extension(vk::DynamicState state)
+{
+  switch (state)
+  {
+  case vk::DynamicState::eLogicOpEXT:
+  case vk::DynamicState::ePatchControlPointsEXT:
+    return vk::EXTExtendedDynamicState2ExtensionName;
+  case vk::DynamicState::eVertexInputEXT:
+    return vk::EXTVertexInputDynamicStateExtensionName;
+  default:
+    break;
+  }
+
+  const auto& eds3 = EXTENDED_DYNAMIC_STATES_3;
+  if (std::find(eds3.begin(), eds3.end(), state) != eds3.end())
+    return vk::EXTExtendedDynamicState3ExtensionName;
+  return {};
+}
+
+void set_vertex_input(vk::CommandBuffer cmd, const VertexShaderInputDescription& input)
+{
+  std::vector<vk::VertexInputBindingDescription2EXT> bindings;
+  std::vector<vk::VertexInputAttributeDescription2EXT> attributes;
+
+  for (uint32_t i = 0; i < input.bindings.size(); ++i)
+  {
+    const auto& binding = input.bindings[i];
+    if (!binding.has_value())
+      continue;
+
+    bindings.push_back(vk::VertexInputBindingDescription2EXT{
+      .binding = i,
+      .stride = binding->byteStreamDescription.stride,
+      .inputRate = binding->inputRate,
+      .divisor = 1,
+    });
+
+    for (uint32_t j = 0; j < binding->attributeMapping.size(); ++j)
+    {
+      if (binding->attributeMapping[j] == binding->UNUSED_LOCATION)
+        continue;
+      const auto& attr = binding->byteStreamDescription.attributes[binding->attributeMapping[j]];
+      attributes.push_back(vk::VertexInputAttributeDescription2EXT{
+        .location = j,
+        .binding = i,
+        .format = attr.format,
+        .offset = attr.offset,
+      });
+    }
+  }
+
+  cmd.setVertexInputEXT(bindings, attributes);
+}
+
+static void set_color_blend_state(
+  vk::CommandBuffer cmd,
+  vk::DynamicState state,
+  const std::vector<vk::PipelineColorBlendAttachmentState>& attachments)
+{
+  if (attachments.empty())
+    return;
+
+  switch (state)
+  {
+  case vk::DynamicState::eColorBlendEnableEXT: {
+    std::vector<vk::Bool32> enables;
+    for (const auto& attachment : attachments)
+      enables.push_back(attachment.blendEnable);
+    cmd.setColorBlendEnableEXT(0, enables);
+    break;
+  }
+  case vk::DynamicState::eColorBlendEquationEXT: {
+    std::vector<vk::ColorBlendEquationEXT> equations;
+    for (const auto& attachment : attachments)
+      equations.push_back(vk::ColorBlendEquationEXT{
+        .srcColorBlendFactor = attachment.srcColorBlendFactor,
+        .dstColorBlendFactor = attachment.dstColorBlendFactor,
+        .colorBlendOp = attachment.colorBlendOp,
+        .srcAlphaBlendFactor = attachment.srcAlphaBlendFactor,
+        .dstAlphaBlendFactor = attachment.dstAlphaBlendFactor,
+        .alphaBlendOp = attachment.alphaBlendOp,
+      });
+    cmd.setColorBlendEquationEXT(0, equations);
+    break;
+  }
+  case vk::DynamicState::eColorWriteMaskEXT: {
+    std::vector<vk::ColorComponentFlags> writeMasks;
+    for (const auto& attachment : attachments)
+      writeMasks.push_back(attachment.colorWriteMask);
+    cmd.setColorWriteMaskEXT(0, writeMasks);
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+void set_dynamic_state(vk::CommandBuffer cmd, const GraphicsPipeline::CreateInfo& state)
+{
+  const auto& raster = state.rasterizationConfig;
+  const auto& multisample = state.multisampleConfig;
+  const auto& depth = state.depthConfig;
+  const auto& blending = state.blendingConfig;
+
+  // A null mask means that all samples are enabled
+  static constexpr std::array<vk::SampleMask, 2> ALL_SAMPLES{~0u, ~0u};
+
+  for (auto dynamicState : state.dynamicStates)
+    switch (dynamicState)
+    {
+    case vk::DynamicState::eViewport:
+    case vk::DynamicState::eScissor:
+    case vk::DynamicState::eViewportWithCount:
+    case vk::DynamicState::eScissorWithCount:
+      break;
+    // Strides are passed to vkCmdBindVertexBuffers2 along with the buffers
+    case vk::DynamicState::eVertexInputBindingStride:
+      break;
+
+    case vk::DynamicState::eVertexInputEXT:
+      set_vertex_input(cmd, state.vertexShaderInput);
+      break;
+    case vk::DynamicState::ePrimitiveTopology:
+      cmd.setPrimitiveTopology(state.inputAssemblyConfig.topology);
+      break;
+    case vk::DynamicState::ePrimitiveRestartEnable:
+      cmd.setPrimitiveRestartEnable(state.inputAssemblyConfig.primitiveRestartEnable);
+      break;
+    case vk::DynamicState::ePatchControlPointsEXT:
+      cmd.setPatchControlPointsEXT(state.tessellationConfig.patchControlPoints);
+      break;
+
+    case vk::DynamicState::eRasterizerDiscardEnable:
+      cmd.setRasterizerDiscardEnable(raster.rasterizerDiscardEnable);
+      break;
+    case vk::DynamicState::eDepthClampEnableEXT:
+      cmd.setDepthClampEnableEXT(raster.depthClampEnable);
+      break;
+    case vk::DynamicState::ePolygonModeEXT:
+      cmd.setPolygonModeEXT(raster.polygonMode);
+      break;
+    case vk::DynamicState::eCullMode:
+      cmd.setCullMode(raster.cullMode);
+      break;
+    case vk::DynamicState::eFrontFace:
+      cmd.setFrontFace(raster.frontFace);
+      break;
+    case vk::DynamicState::eLineWidth:
+      cmd.setLineWidth(raster.lineWidth);
+      break;
+    case vk::DynamicState::eDepthBiasEnable:
+      cmd.setDepthBiasEnable(raster.depthBiasEnable);
+      break;
+    case vk::DynamicState::eDepthBias:
+      cmd.setDepthBias(
+        raster.depthBiasConstantFactor, raster.depthBiasClamp, raster.depthBiasSlopeFactor);
+      break;
+
+    case vk::DynamicState::eRasterizationSamplesEXT:
+      cmd.setRasterizationSamplesEXT(multisample.rasterizationSamples);
+      break;
+    case vk::DynamicState::eSampleMaskEXT:
+      cmd.setSampleMaskEXT(
+        multisample.rasterizationSamples,
+        multisample.pSampleMask != nullptr ? multisample.pSampleMask : ALL_SAMPLES.data());
+      break;
+    case vk::DynamicState::eAlphaToCoverageEnableEXT:
+      cmd.setAlphaToCoverageEnableEXT(multisample.alphaToCoverageEnable);
+      break;
+    case vk::DynamicState::eAlphaToOneEnableEXT:
+      cmd.setAlphaToOneEnableEXT(multisample.alphaToOneEnable);
+      break;
+
+    case vk::DynamicState::eDepthTestEnable:
+      cmd.setDepthTestEnable(depth.depthTestEnable);
+      break;
+    case vk::DynamicState::eDepthWriteEnable:
+      cmd.setDepthWriteEnable(depth.depthWriteEnable);
+      break;
+    case vk::DynamicState::eDepthCompareOp:
+      cmd.setDepthCompareOp(depth.depthCompareOp);
+      break;
+    case vk::DynamicState::eDepthBoundsTestEnable:
+      cmd.setDepthBoundsTestEnable(depth.depthBoundsTestEnable);
+      break;
+    case vk::DynamicState::eDepthBounds:
+      cmd.setDepthBounds(depth.minDepthBounds, depth.maxDepthBounds);
+      break;
+    case vk::DynamicState::eStencilTestEnable:
+      cmd.setStencilTestEnable(depth.stencilTestEnable);
+      break;
+    case vk::DynamicState::eStencilOp:
+      cmd.setStencilOp(
+        vk::StencilFaceFlagBits::eFront,
+        depth.front.failOp,
+        depth.front.passOp,
+        depth.front.depthFailOp,
+        depth.front.compareOp);
+      cmd.setStencilOp(
+        vk::StencilFaceFlagBits::eBack,
+        depth.back.failOp,
+        depth.back.passOp,
+        depth.back.depthFailOp,
+        depth.back.compareOp);
+      break;
+    case vk::DynamicState::eStencilCompareMask:
+      cmd.setStencilCompareMask(vk::StencilFaceFlagBits::eFront, depth.front.compareMask);
+      cmd.setStencilCompareMask(vk::StencilFaceFlagBits::eBack, depth.back.compareMask);
+      break;
+    case vk::DynamicState::eStencilWriteMask:
+      cmd.setStencilWriteMask(vk::StencilFaceFlagBits::eFront, depth.front.writeMask);
+      cmd.setStencilWriteMask(vk::StencilFaceFlagBits::eBack, depth.back.writeMask);
+      break;
+    case vk::DynamicState::eStencilReference:
+      cmd.setStencilReference(vk::StencilFaceFlagBits::eFront, depth.front.reference);
+      cmd.setStencilReference(vk::StencilFaceFlagBits::eBack, depth.back.reference);
+      break;
+
+    case vk::DynamicState::eLogicOpEnableEXT:
+      cmd.setLogicOpEnableEXT(blending.logicOpEnable);
+      break;
+    case vk::DynamicState::eLogicOpEXT:
+      cmd.setLogicOpEXT(blending.logicOp);
+      break;
+    case vk::DynamicState::eBlendConstants:
+      cmd.setBlendConstants(blending.blendConstants.data());
+      break;
+    case vk::DynamicState::eColorBlendEnableEXT:
+    case vk::DynamicState::eColorBlendEquationEXT:
+    case vk::DynamicState::eColorWriteMaskEXT:
+      set_color_blend_state(cmd, dynamicState, blending.attachments);
+      break;
+
+    default:
+      ETNA_PANIC(
+        "Dynamic state {} is not supported by set_dynamic_state", vk::to_string(dynamicState));
+    }
+}
+
+} // namespace etna
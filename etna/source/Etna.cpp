@@ -7,6 +7,7 @@
 #include <etna/GlobalContext.hpp>
 #include <etna/PipelineManager.hpp>
 #include <vulkan/vulkan_structs.hpp>
+#include "DeferredDestroyQueue.hpp"
 #include "StateTracking.hpp"
 #include "etna/Image.hpp"
 #include "etna/Vulkan.hpp"
@@ -35,6 +36,11 @@ void initialize(const InitParams& params)
 
 void shutdown()
 {
+  gContext->getShaderManager().saveReflectionCache();
+  gContext->getShaderManager().trimCompiledShaderCache();
+  gContext->getPipelineManager().waitForAllPipelines();
+  gContext->getPipelineManager().savePipelineCache();
+  gContext->getPipelineManager().savePipelineStateCapture();
   gContext->getDescriptorSetLayouts().clear(gContext->getDevice());
   gContext.reset(nullptr);
 }
@@ -45,19 +51,42 @@ ShaderProgramId create_program(
   return gContext->getShaderManager().loadProgram(name, shaders_path);
 }
 
+std::vector<ShaderProgramId> create_programs(std::span<const ShaderProgramDescription> programs)
+{
+  return gContext->getShaderManager().loadPrograms(programs);
+}
+
 ShaderProgramId get_program_id(const char* name)
 {
   return gContext->getShaderManager().tryGetProgram(name);
 }
 
+bool mount_shader_pack(const std::filesystem::path& pack_path, std::filesystem::path root)
+{
+  return gContext->getShaderManager().mountShaderPack(pack_path, std::move(root));
+}
+
 void reload_shaders()
 {
   gContext->getDescriptorSetLayouts().clear(gContext->getDevice());
-  gContext->getShaderManager().reloadPrograms();
-  gContext->getPipelineManager().recreate();
+  const auto reloaded = gContext->getShaderManager().reloadPrograms();
+  gContext->getPipelineManager().recreate(reloaded.programs);
+  gContext->getPipelineManager().waitForPrograms(reloaded.layoutChanged);
   gContext->getDescriptorPool().destroyAllocatedSets();
 }
 
+bool reload_changed_shaders()
+{
+  const auto reloaded = gContext->getShaderManager().reloadChangedPrograms();
+  if (reloaded.programs.empty())
+    return false;
+
+  // Old pipelines only keep being used while they are compatible with the new layouts
+  gContext->getPipelineManager().recreate(reloaded.programs);
+  gContext->getPipelineManager().waitForPrograms(reloaded.layoutChanged);
+  return true;
+}
+
 ShaderProgramInfo get_shader_program(ShaderProgramId id)
 {
   return gContext->getShaderManager().getProgramInfo(id);
@@ -158,6 +187,8 @@ void begin_frame()
 {
   // TODO: this is brittle. Maybe GpuWorkCount should have frame start calllbacks?
   gContext->getDescriptorPool().beginFrame();
+  gContext->getDeferredDestroyQueue().collect();
+  gContext->getPipelineManager().collectCompiledPipelines();
 }
 
 void end_frame()
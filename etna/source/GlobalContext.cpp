@@ -1,5 +1,6 @@
 #include <etna/GlobalContext.hpp>
 
+#include <thread>
 #include <unordered_set>
 #include <spdlog/fmt/ranges.h>
 #include <tracy/TracyVulkan.hpp>
@@ -16,7 +17,9 @@
 #include <etna/PerFrameCmdMgr.hpp>
 #include <etna/OneShotCmdMgr.hpp>
 
+#include "DeferredDestroyQueue.hpp"
 #include "StateTracking.hpp"
+#include "WorkerPool.hpp"
 
 
 namespace etna
@@ -204,7 +207,8 @@ static vk::UniqueDevice create_logical_device(
   vk::PhysicalDevice pdevice,
   uint32_t universal_queue_family,
   const InitParams& params,
-  const OptionalExtensionsFound& optional_exts)
+  const OptionalExtensionsFound& optional_exts,
+  std::unordered_set<std::string>& out_enabled_extensions)
 {
   const float defaultQueuePriority{0.0f};
 
@@ -261,9 +265,22 @@ static vk::UniqueDevice create_logical_device(
 
   spdlog::info("Creating a logical device with the following extensions: {}", deviceExtensions);
 
+  out_enabled_extensions.insert(deviceExtensions.begin(), deviceExtensions.end());
+
   return unwrap_vk_result(pdevice.createDeviceUnique(createInfo));
 }
 
+// Finds a structure in the feature chain the application passed in InitParams::features
+template <class Features>
+static const Features* find_enabled_features(const vk::PhysicalDeviceFeatures2& features)
+{
+  for (auto* next = static_cast<const vk::BaseInStructure*>(features.pNext); next != nullptr;
+       next = next->pNext)
+    if (next->sType == Features::structureType)
+      return reinterpret_cast<const Features*>(next);
+  return nullptr;
+}
+
 #ifndef NDEBUG
 static vk::Bool32 debugCallback(
   vk::DebugUtilsMessageSeverityFlagBitsEXT message_severity,
@@ -341,7 +358,8 @@ GlobalContext::GlobalContext(const InitParams& params)
   constexpr auto UNIVERSAL_QUEUE_FLAGS =
     vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute | vk::QueueFlagBits::eTransfer;
   universalQueueFamilyIdx = get_queue_family_index(vkPhysDevice, UNIVERSAL_QUEUE_FLAGS);
-  vkDevice = create_logical_device(vkPhysDevice, universalQueueFamilyIdx, params, optionalExts);
+  vkDevice = create_logical_device(
+    vkPhysDevice, universalQueueFamilyIdx, params, optionalExts, enabledDeviceExtensions);
   VULKAN_HPP_DEFAULT_DISPATCHER.init(vkDevice.get());
 
   universalQueue = vkDevice->getQueue(universalQueueFamilyIdx, 0);
@@ -351,8 +369,14 @@ GlobalContext::GlobalContext(const InitParams& params)
     functions.vkGetInstanceProcAddr = VULKAN_HPP_DEFAULT_DISPATCHER.vkGetInstanceProcAddr;
     functions.vkGetDeviceProcAddr = VULKAN_HPP_DEFAULT_DISPATCHER.vkGetDeviceProcAddr;
 
+    // Acceleration structures and shader binding tables are referenced by device
+    // address, so the bufferDeviceAddress feature has to be enabled for them anyway
+    VmaAllocatorCreateFlags allocatorFlags = 0;
+    if (isDeviceExtensionEnabled(vk::KHRAccelerationStructureExtensionName))
+      allocatorFlags |= VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
+
     VmaAllocatorCreateInfo allocInfo{
-      .flags = {},
+      .flags = allocatorFlags,
       .physicalDevice = vkPhysDevice,
       .device = vkDevice.get(),
 
@@ -373,13 +397,57 @@ GlobalContext::GlobalContext(const InitParams& params)
     vmaAllocator = {allocator, &::vmaDestroyAllocator};
   }
 
+  deferredDestroyQueue = std::make_unique<DeferredDestroyQueue>(mainWorkStream);
   descriptorSetLayouts = std::make_unique<DescriptorSetLayoutCache>();
-  shaderPrograms = std::make_unique<ShaderProgramManager>();
-  pipelineManager = std::make_unique<PipelineManager>(vkDevice.get(), *shaderPrograms);
-  perFrameDescriptorPool = std::make_unique<DynamicDescriptorPool>(vkDevice.get(), mainWorkStream);
-  persistentDescriptorPool = std::make_unique<PersistentDescriptorPool>(vkDevice.get());
+  shaderPrograms = std::make_unique<ShaderProgramManager>(ShaderProgramManager::CreateInfo{
+    .reflectionCachePath = params.shaderReflectionCachePath,
+    .compiledShaderCachePath = params.compiledShaderCachePath,
+    .compiledShaderCacheSizeLimit = params.compiledShaderCacheSizeLimit,
+    .shaderSourceRoot = params.shaderSourceRoot,
+    .shaderIncludeDirectories = params.shaderIncludeDirectories,
+    .watchFiles = params.watchShaderFiles,
+    .keepShaderCode = isDeviceExtensionEnabled(vk::EXTShaderObjectExtensionName),
+  });
+  const auto* executableFeatures =
+    find_enabled_features<vk::PhysicalDevicePipelineExecutablePropertiesFeaturesKHR>(
+      params.features);
+  const bool executableInfoEnabled =
+    isDeviceExtensionEnabled(vk::KHRPipelineExecutablePropertiesExtensionName) &&
+    executableFeatures != nullptr && executableFeatures->pipelineExecutableInfo == vk::True;
+
+  pipelineManager = std::make_unique<PipelineManager>(
+    vkDevice.get(),
+    *shaderPrograms,
+    PipelineManager::CreateInfo{
+      .deviceProperties = vkPhysDevice.getProperties(),
+      .pipelineCachePath = params.pipelineCachePath,
+      .useGraphicsPipelineLibrary =
+        isDeviceExtensionEnabled(vk::EXTGraphicsPipelineLibraryExtensionName),
+      .captureExecutableStatistics = executableInfoEnabled,
+      .rayTracingProperties = isDeviceExtensionEnabled(vk::KHRRayTracingPipelineExtensionName)
+        ? vkPhysDevice
+            .getProperties2<
+              vk::PhysicalDeviceProperties2,
+              vk::PhysicalDeviceRayTracingPipelinePropertiesKHR>()
+            .get<vk::PhysicalDeviceRayTracingPipelinePropertiesKHR>()
+        : vk::PhysicalDeviceRayTracingPipelinePropertiesKHR{},
+      .pipelineStateCapturePath = params.pipelineStateCapturePath,
+    });
+  const bool accelerationStructures =
+    isDeviceExtensionEnabled(vk::KHRAccelerationStructureExtensionName);
+  perFrameDescriptorPool = std::make_unique<DynamicDescriptorPool>(
+    vkDevice.get(), mainWorkStream, accelerationStructures);
+  persistentDescriptorPool =
+    std::make_unique<PersistentDescriptorPool>(vkDevice.get(), accelerationStructures);
   resourceTracking = std::make_unique<ResourceStates>();
 
+  {
+    // The thread calling into etna participates in parallel work too
+    const uint32_t hardwareThreads = std::max(std::thread::hardware_concurrency(), 2u);
+    workerPool =
+      std::make_unique<WorkerPool>(params.workerThreadCount.value_or(hardwareThreads - 1));
+  }
+
   auto tempPool =
     etna::unwrap_vk_result(vkDevice->createCommandPoolUnique(vk::CommandPoolCreateInfo{
       .flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
@@ -462,6 +530,11 @@ std::unique_ptr<OneShotCmdMgr> GlobalContext::createOneShotCmdMgr()
   return std::make_unique<OneShotCmdMgr>(deps);
 }
 
+bool GlobalContext::isDeviceExtensionEnabled(std::string_view name) const
+{
+  return enabledDeviceExtensions.contains(std::string{name});
+}
+
 ShaderProgramManager& GlobalContext::getShaderManager()
 {
   return *shaderPrograms;
@@ -492,6 +565,16 @@ ResourceStates& GlobalContext::getResourceTracker()
   return *resourceTracking;
 }
 
+WorkerPool& GlobalContext::getWorkerPool()
+{
+  return *workerPool;
+}
+
+DeferredDestroyQueue& GlobalContext::getDeferredDestroyQueue()
+{
+  return *deferredDestroyQueue;
+}
+
 GlobalContext::~GlobalContext() = default;
 
 
@@ -0,0 +1,234 @@
+#include "GraphicsPipelineKey.hpp"
+
+#include <algorithm>
+
+
+namespace etna
+{
+
+// Order of dynamic states does not matter to Vulkan
+static void write_dynamic_states(BinaryWriter& writer, const GraphicsPipeline::CreateInfo& info)
+{
+  std::vector<vk::DynamicState> states = info.dynamicStates;
+  std::sort(states.begin(), states.end());
+  states.erase(std::unique(states.begin(), states.end()), states.end());
+
+  writer.write(static_cast<uint32_t>(states.size()));
+  for (auto state : states)
+    writer.write(state);
+}
+
+static bool is_dynamic(const GraphicsPipeline::CreateInfo& info, vk::DynamicState state)
+{
+  return std::find(info.dynamicStates.begin(), info.dynamicStates.end(), state) !=
+    info.dynamicStates.end();
+}
+
+// Dynamic values are recorded into command buffers and do not affect the pipeline,
+// so a fixed value is written in their place
+template <class T>
+static void write_static(
+  BinaryWriter& writer,
+  const GraphicsPipeline::CreateInfo& info,
+  vk::DynamicState state,
+  const T& value)
+{
+  writer.write(is_dynamic(info, state) ? T{} : value);
+}
+
+// With a dynamic topology, the pipeline only fixes its class
+static vk::PrimitiveTopology topology_class(vk::PrimitiveTopology topology)
+{
+  switch (topology)
+  {
+  case vk::PrimitiveTopology::ePointList:
+    return vk::PrimitiveTopology::ePointList;
+  case vk::PrimitiveTopology::eLineList:
+  case vk::PrimitiveTopology::eLineStrip:
+  case vk::PrimitiveTopology::eLineListWithAdjacency:
+  case vk::PrimitiveTopology::eLineStripWithAdjacency:
+    return vk::PrimitiveTopology::eLineList;
+  case vk::PrimitiveTopology::ePatchList:
+    return vk::PrimitiveTopology::ePatchList;
+  default:
+    return vk::PrimitiveTopology::eTriangleList;
+  }
+}
+
+static void write_multisample_state(BinaryWriter& writer, const GraphicsPipeline::CreateInfo& info)
+{
+  using enum vk::DynamicState;
+  const auto& multisample = info.multisampleConfig;
+  write_static(writer, info, eRasterizationSamplesEXT, multisample.rasterizationSamples);
+  writer.write(multisample.sampleShadingEnable);
+  writer.write(multisample.minSampleShading);
+  write_static(writer, info, eAlphaToCoverageEnableEXT, multisample.alphaToCoverageEnable);
+  write_static(writer, info, eAlphaToOneEnableEXT, multisample.alphaToOneEnable);
+
+  // The mask has a bit for every sample
+  const bool hasMask = multisample.pSampleMask != nullptr && !is_dynamic(info, eSampleMaskEXT);
+  writer.write(hasMask);
+  if (hasMask)
+  {
+    const auto samples = static_cast<uint32_t>(multisample.rasterizationSamples);
+    for (uint32_t i = 0; i < (samples + 31) / 32; ++i)
+      writer.write(multisample.pSampleMask[i]);
+  }
+}
+
+static void write_stencil_op(
+  BinaryWriter& writer, const GraphicsPipeline::CreateInfo& info, const vk::StencilOpState& op)
+{
+  using enum vk::DynamicState;
+  write_static(writer, info, eStencilOp, op.failOp);
+  write_static(writer, info, eStencilOp, op.passOp);
+  write_static(writer, info, eStencilOp, op.depthFailOp);
+  write_static(writer, info, eStencilOp, op.compareOp);
+  write_static(writer, info, eStencilCompareMask, op.compareMask);
+  write_static(writer, info, eStencilWriteMask, op.writeMask);
+  write_static(writer, info, eStencilReference, op.reference);
+}
+
+static void write_vertex_bindings(BinaryWriter& writer, const GraphicsPipeline::CreateInfo& info)
+{
+  const auto& bindings = info.vertexShaderInput.bindings;
+  writer.write(static_cast<uint32_t>(bindings.size()));
+  for (const auto& binding : bindings)
+  {
+    writer.write(binding.has_value());
+    if (!binding.has_value())
+      continue;
+
+    writer.write(binding->inputRate);
+    write_static(
+      writer,
+      info,
+      vk::DynamicState::eVertexInputBindingStride,
+      binding->byteStreamDescription.stride);
+
+    // Only the attributes that are actually mapped to locations matter
+    const auto& attributes = binding->byteStreamDescription.attributes;
+    writer.write(static_cast<uint32_t>(binding->attributeMapping.size()));
+    for (uint32_t attrIdx : binding->attributeMapping)
+    {
+      const bool used = attrIdx != VertexShaderInputDescription::Binding::UNUSED_LOCATION &&
+        attrIdx < attributes.size();
+      writer.write(used);
+      if (!used)
+        continue;
+      writer.write(attributes[attrIdx].format);
+      writer.write(attributes[attrIdx].offset);
+    }
+  }
+}
+
+void write_vertex_input_state(BinaryWriter& writer, const GraphicsPipeline::CreateInfo& info)
+{
+  using enum vk::DynamicState;
+
+  const bool dynamicVertexInput = is_dynamic(info, eVertexInputEXT);
+  writer.write(dynamicVertexInput);
+  if (!dynamicVertexInput)
+    write_vertex_bindings(writer, info);
+
+  const auto topology = info.inputAssemblyConfig.topology;
+  writer.write(is_dynamic(info, ePrimitiveTopology) ? topology_class(topology) : topology);
+  write_static(
+    writer, info, ePrimitiveRestartEnable, info.inputAssemblyConfig.primitiveRestartEnable);
+  write_dynamic_states(writer, info);
+}
+
+void write_pre_rasterization_state(BinaryWriter& writer, const GraphicsPipeline::CreateInfo& info)
+{
+  using enum vk::DynamicState;
+  const auto& raster = info.rasterizationConfig;
+  write_static(writer, info, eDepthClampEnableEXT, raster.depthClampEnable);
+  write_static(writer, info, eRasterizerDiscardEnable, raster.rasterizerDiscardEnable);
+  write_static(writer, info, ePolygonModeEXT, raster.polygonMode);
+  write_static(writer, info, eCullMode, raster.cullMode);
+  write_static(writer, info, eFrontFace, raster.frontFace);
+  write_static(writer, info, eDepthBiasEnable, raster.depthBiasEnable);
+  write_static(writer, info, eDepthBias, raster.depthBiasConstantFactor);
+  write_static(writer, info, eDepthBias, raster.depthBiasClamp);
+  write_static(writer, info, eDepthBias, raster.depthBiasSlopeFactor);
+  write_static(writer, info, eLineWidth, raster.lineWidth);
+
+  write_static(
+    writer, info, ePatchControlPointsEXT, info.tessellationConfig.patchControlPoints);
+  write_dynamic_states(writer, info);
+}
+
+void write_fragment_shader_state(BinaryWriter& writer, const GraphicsPipeline::CreateInfo& info)
+{
+  using enum vk::DynamicState;
+  const auto& depth = info.depthConfig;
+  write_static(writer, info, eDepthTestEnable, depth.depthTestEnable);
+  write_static(writer, info, eDepthWriteEnable, depth.depthWriteEnable);
+  write_static(writer, info, eDepthCompareOp, depth.depthCompareOp);
+  write_static(writer, info, eDepthBoundsTestEnable, depth.depthBoundsTestEnable);
+  write_static(writer, info, eStencilTestEnable, depth.stencilTestEnable);
+  write_stencil_op(writer, info, depth.front);
+  write_stencil_op(writer, info, depth.back);
+  write_static(writer, info, eDepthBounds, depth.minDepthBounds);
+  write_static(writer, info, eDepthBounds, depth.maxDepthBounds);
+
+  write_multisample_state(writer, info);
+  write_dynamic_states(writer, info);
+}
+
+void write_fragment_output_state(BinaryWriter& writer, const GraphicsPipeline::CreateInfo& info)
+{
+  using enum vk::DynamicState;
+  const auto& blending = info.blendingConfig;
+  writer.write(static_cast<uint32_t>(blending.attachments.size()));
+  for (const auto& attachment : blending.attachments)
+  {
+    write_static(writer, info, eColorBlendEnableEXT, attachment.blendEnable);
+    write_static(writer, info, eColorBlendEquationEXT, attachment.srcColorBlendFactor);
+    write_static(writer, info, eColorBlendEquationEXT, attachment.dstColorBlendFactor);
+    write_static(writer, info, eColorBlendEquationEXT, attachment.colorBlendOp);
+    write_static(writer, info, eColorBlendEquationEXT, attachment.srcAlphaBlendFactor);
+    write_static(writer, info, eColorBlendEquationEXT, attachment.dstAlphaBlendFactor);
+    write_static(writer, info, eColorBlendEquationEXT, attachment.alphaBlendOp);
+    write_static(writer, info, eColorWriteMaskEXT, attachment.colorWriteMask);
+  }
+  write_static(writer, info, eLogicOpEnableEXT, blending.logicOpEnable);
+  const bool logicOpUsed = blending.logicOpEnable || is_dynamic(info, eLogicOpEnableEXT);
+  write_static(writer, info, eLogicOpEXT, logicOpUsed ? blending.logicOp : vk::LogicOp{});
+  write_static(writer, info, eBlendConstants, blending.blendConstants);
+
+  const auto& output = info.fragmentShaderOutput;
+  writer.write(static_cast<uint32_t>(output.colorAttachmentFormats.size()));
+  for (auto format : output.colorAttachmentFormats)
+    writer.write(format);
+  writer.write(output.depthAttachmentFormat);
+  writer.write(output.stencilAttachmentFormat);
+
+  write_multisample_state(writer, info);
+  write_dynamic_states(writer, info);
+}
+
+void write_specialization_constants(BinaryWriter& writer, const SpecializationConstants& constants)
+{
+  // Values are kept sorted, so equal sets are written identically
+  const auto values = constants.getValues();
+  writer.write(static_cast<uint32_t>(values.size()));
+  for (const auto& value : values)
+  {
+    writer.writeString(value.name);
+    writer.write(value.constantId);
+    writer.write(value.bits);
+    writer.write(value.size);
+  }
+}
+
+void write_graphics_pipeline_state(BinaryWriter& writer, const GraphicsPipeline::CreateInfo& info)
+{
+  write_vertex_input_state(writer, info);
+  write_pre_rasterization_state(writer, info);
+  write_fragment_shader_state(writer, info);
+  write_fragment_output_state(writer, info);
+  write_specialization_constants(writer, info.specializationConstants);
+}
+
+} // namespace etna
@@ -0,0 +1,38 @@
+#pragma once
+#ifndef ETNA_GRAPHICS_PIPELINE_KEY_HPP_INCLUDED
+#define ETNA_GRAPHICS_PIPELINE_KEY_HPP_INCLUDED
+
+#include <etna/GraphicsPipeline.hpp>
+#include <etna/SpecializationConstants.hpp>
+
+#include "BinaryIo.hpp"
+
+
+namespace etna
+{
+
+/**
+ * Canonical byte representations of GraphicsPipeline::CreateInfo, split along
+ * the four parts of VK_EXT_graphics_pipeline_library. Only values that affect
+ * the resulting pipeline are written, never pointers, padding or fields that
+ * are listed in dynamicStates, so equal bytes mean equal pipelines and the
+ * output can be used as a cache key.
+ */
+
+// Vertex bindings, attributes and input assembly
+void write_vertex_input_state(BinaryWriter& writer, const GraphicsPipeline::CreateInfo& info);
+// Rasterization and tessellation, shaders are not included
+void write_pre_rasterization_state(BinaryWriter& writer, const GraphicsPipeline::CreateInfo& info);
+// Depth, stencil and multisampling, shaders are not included
+void write_fragment_shader_state(BinaryWriter& writer, const GraphicsPipeline::CreateInfo& info);
+// Blending, multisampling and attachment formats
+void write_fragment_output_state(BinaryWriter& writer, const GraphicsPipeline::CreateInfo& info);
+
+void write_specialization_constants(BinaryWriter& writer, const SpecializationConstants& constants);
+
+// All of the above, i.e. everything except for the shaders themselves
+void write_graphics_pipeline_state(BinaryWriter& writer, const GraphicsPipeline::CreateInfo& info);
+
+} // namespace etna
+
+#endif // ETNA_GRAPHICS_PIPELINE_KEY_HPP_INCLUDED
@@ -0,0 +1,149 @@
+#include "MappedFile.hpp"
+
+#include <fstream>
+#include <utility>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace etna
+{
+
+static bool read_into(
+  const std::filesystem::path& path, std::vector<uint32_t>& dst, std::size_t& size)
+{
+  std::ifstream file(path, std::ios::ate | std::ios::binary);
+  if (!file.is_open())
+    return false;
+
+  size = static_cast<std::size_t>(file.tellg());
+  dst.resize((size + sizeof(uint32_t) - 1) / sizeof(uint32_t));
+
+  file.seekg(0);
+  file.read(reinterpret_cast<char*>(dst.data()), static_cast<std::streamsize>(size));
+  return static_cast<bool>(file);
+}
+
+std::optional<MappedFile> MappedFile::open(const std::filesystem::path& path)
+{
+  MappedFile result;
+
+#if defined(_WIN32)
+  HANDLE file = CreateFileW(
+    path.c_str(),
+    GENERIC_READ,
+    FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+    nullptr,
+    OPEN_EXISTING,
+    FILE_ATTRIBUTE_NORMAL,
+    nullptr);
+  if (file != INVALID_HANDLE_VALUE)
+  {
+    LARGE_INTEGER fileSize{};
+    if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+    {
+      // The view keeps the mapping alive, so both handles can be closed right away
+      HANDLE fileMapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+      if (fileMapping != nullptr)
+      {
+        result.mapping = MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(fileMapping);
+      }
+      result.size = static_cast<std::size_t>(fileSize.QuadPart);
+    }
+    CloseHandle(file);
+  }
+#else
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd >= 0)
+  {
+    struct stat st
+    {
+    };
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+      const auto fileSize = static_cast<std::size_t>(st.st_size);
+      void* ptr = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (ptr != MAP_FAILED)
+        result.mapping = ptr;
+      result.size = fileSize;
+    }
+    // The mapping stays valid after closing the descriptor
+    ::close(fd);
+  }
+#endif
+
+  if (result.mapping != nullptr)
+  {
+    result.data = static_cast<const std::byte*>(result.mapping);
+    return result;
+  }
+
+  // Empty files, pipes, exotic file systems, etc
+  if (!read_into(path, result.fallback, result.size))
+    return std::nullopt;
+  result.data = reinterpret_cast<const std::byte*>(result.fallback.data());
+  return result;
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+  : data{std::exchange(other.data, nullptr)}
+  , size{std::exchange(other.size, 0)}
+  , mapping{std::exchange(other.mapping, nullptr)}
+  , fallback{std::move(other.fallback)}
+{
+  // Vector move does not invalidate the pointer, but let's be explicit
+  if (mapping == nullptr)
+    data = reinterpret_cast<const std::byte*>(fallback.data());
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+  if (this == &other)
+    return *this;
+
+  reset();
+  data = std::exchange(other.data, nullptr);
+  size = std::exchange(other.size, 0);
+  mapping = std::exchange(other.mapping, nullptr);
+  fallback = std::move(other.fallback);
+  if (mapping == nullptr)
+    data = reinterpret_cast<const std::byte*>(fallback.data());
+
+  return *this;
+}
+
+MappedFile::~MappedFile()
+{
+  reset();
+}
+
+void MappedFile::reset()
+{
+  if (mapping != nullptr)
+  {
+#if defined(_WIN32)
+    UnmapViewOfFile(mapping);
+#else
+    munmap(mapping, size);
+#endif
+  }
+
+  data = nullptr;
+  size = 0;
+  mapping = nullptr;
+  fallback.clear();
+}
+
+} // namespace etna
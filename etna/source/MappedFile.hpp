@@ -0,0 +1,53 @@
+#pragma once
+#ifndef ETNA_MAPPED_FILE_HPP_INCLUDED
+#define ETNA_MAPPED_FILE_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <vector>
+
+
+namespace etna
+{
+
+/**
+ * Read-only view of a whole file. Memory-maps the file when possible, which
+ * avoids copying it into a separate allocation, and falls back to reading it
+ * into memory otherwise. The data is always at least 4-byte aligned, so it
+ * can be handed to Vulkan as SPIR-V code directly.
+ */
+class MappedFile
+{
+public:
+  // Returns nullopt if the file can not be opened at all
+  static std::optional<MappedFile> open(const std::filesystem::path& path);
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  MappedFile(MappedFile&& other) noexcept;
+  MappedFile& operator=(MappedFile&& other) noexcept;
+
+  ~MappedFile();
+
+  std::span<std::byte const> getData() const { return {data, size}; }
+
+private:
+  MappedFile() = default;
+  void reset();
+
+private:
+  const std::byte* data = nullptr;
+  std::size_t size = 0;
+
+  // Platform-specific mapping handle, null when the fallback is used
+  void* mapping = nullptr;
+  std::vector<uint32_t> fallback;
+};
+
+} // namespace etna
+
+#endif // ETNA_MAPPED_FILE_HPP_INCLUDED
@@ -0,0 +1,138 @@
+#include <etna/Meshlets.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <etna/Assert.hpp>
+
+
+namespace etna
+{
+
+MeshletData build_meshlets(std::span<const uint32_t> indices, MeshletLimits limits)
+{
+  ETNA_VERIFYF(
+    indices.size() % 3 == 0, "Index count {} is not a multiple of 3", indices.size());
+  ETNA_VERIFYF(
+    limits.maxVertices >= 3 && limits.maxVertices <= 256,
+    "Meshlets must have between 3 and 256 vertices, got {}",
+    limits.maxVertices);
+  ETNA_VERIFYF(
+    limits.maxTriangles >= 1 && limits.maxTriangles <= 256,
+    "Meshlets must have between 1 and 256 triangles, got {}",
+    limits.maxTriangles);
+
+  MeshletData result;
+  if (indices.empty())
+    return result;
+
+  constexpr uint32_t NOT_IN_MESHLET = std::numeric_limits<uint32_t>::max();
+  // Position of a vertex within the current meshlet
+  std::vector<uint32_t> localIndices(
+    *std::max_element(indices.begin(), indices.end()) + 1, NOT_IN_MESHLET);
+
+  Meshlet current{};
+
+  auto finishMeshlet = [&]() {
+    if (current.triangleCount == 0)
+      return;
+    for (uint32_t i = 0; i < current.vertexCount; ++i)
+      localIndices[result.vertexIndices[current.vertexOffset + i]] = NOT_IN_MESHLET;
+    result.triangles.resize((result.triangles.size() + 3) & ~size_t{3}, 0);
+    result.meshlets.push_back(current);
+    current = Meshlet{
+      .vertexOffset = static_cast<uint32_t>(result.vertexIndices.size()),
+      .triangleOffset = static_cast<uint32_t>(result.triangles.size()),
+      .vertexCount = 0,
+      .triangleCount = 0,
+    };
+  };
+
+  for (size_t i = 0; i < indices.size(); i += 3)
+  {
+    const std::span<const uint32_t> triangle = indices.subspan(i, 3);
+
+    uint32_t newVertices = 0;
+    for (uint32_t vertex : triangle)
+      if (localIndices[vertex] == NOT_IN_MESHLET)
+        ++newVertices;
+    // Degenerate triangles count a repeated new vertex twice, which only wastes a slot
+    if (
+      current.vertexCount + newVertices > limits.maxVertices ||
+      current.triangleCount + 1 > limits.maxTriangles)
+      finishMeshlet();
+
+    for (uint32_t vertex : triangle)
+    {
+      if (localIndices[vertex] == NOT_IN_MESHLET)
+      {
+        localIndices[vertex] = current.vertexCount++;
+        result.vertexIndices.push_back(vertex);
+      }
+      result.triangles.push_back(static_cast<uint8_t>(localIndices[vertex]));
+    }
+    ++current.triangleCount;
+  }
+  finishMeshlet();
+
+  return result;
+}
+
+std::vector<MeshletBounds> compute_meshlet_bounds(
+  const MeshletData& data, std::span<const float> positions, uint32_t stride)
+{
+  ETNA_VERIFYF(stride >= 3, "Vertex stride of {} floats can not hold a position", stride);
+
+  std::vector<MeshletBounds> result;
+  result.reserve(data.meshlets.size());
+
+  for (const auto& meshlet : data.meshlets)
+  {
+    const auto vertices = std::span{data.vertexIndices}.subspan(
+      meshlet.vertexOffset, meshlet.vertexCount);
+    auto position = [&](uint32_t vertex) {
+      ETNA_ASSERTF(
+        (vertex + 1) * size_t{stride} <= positions.size(),
+        "Vertex {} is out of bounds of the position buffer",
+        vertex);
+      return positions.subspan(vertex * size_t{stride}, 3);
+    };
+
+    // The center of the bounding box is not the optimal center, but it is close
+    std::array<float, 3> min;
+    std::array<float, 3> max;
+    min.fill(std::numeric_limits<float>::max());
+    max.fill(std::numeric_limits<float>::lowest());
+    for (uint32_t vertex : vertices)
+    {
+      const auto pos = position(vertex);
+      for (size_t axis = 0; axis < 3; ++axis)
+      {
+        min[axis] = std::min(min[axis], pos[axis]);
+        max[axis] = std::max(max[axis], pos[axis]);
+      }
+    }
+
+    MeshletBounds bounds{};
+    for (size_t axis = 0; axis < 3; ++axis)
+      bounds.center[axis] = (min[axis] + max[axis]) * 0.5f;
+
+    float radiusSquared = 0.f;
+    for (uint32_t vertex : vertices)
+    {
+      const auto pos = position(vertex);
+      float distanceSquared = 0.f;
+      for (size_t axis = 0; axis < 3; ++axis)
+        distanceSquared += (pos[axis] - bounds.center[axis]) * (pos[axis] - bounds.center[axis]);
+      radiusSquared = std::max(radiusSquared, distanceSquared);
+    }
+    bounds.radius = std::sqrt(radiusSquared);
+
+    result.push_back(bounds);
+  }
+
+  return result;
+}
+
+} // namespace etna
@@ -49,6 +49,16 @@ vk::Pipeline PipelineBase::getVkPipeline() const
   return owner->getVkPipeline(id);
 }
 
+bool PipelineBase::isReady() const
+{
+  return owner->isPipelineReady(id);
+}
+
+const PipelineStatistics& PipelineBase::getStatistics() const
+{
+  return owner->getStatistics(id);
+}
+
 vk::PipelineLayout PipelineBase::getVkPipelineLayout() const
 {
   return owner->getVkPipelineLayout(shaderProgramId);
@@ -1,129 +1,1198 @@
 #include <etna/PipelineManager.hpp>
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <mutex>
 #include <span>
+#include <string>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+#include <variant>
 #include <vector>
 
+#include <fmt/std.h>
+#include <tracy/Tracy.hpp>
+
 #include <etna/Assert.hpp>
+#include <etna/DynamicState.hpp>
+#include <etna/GlobalContext.hpp>
 #include <etna/ShaderProgram.hpp>
 #include <etna/VulkanFormatter.hpp>
 
+#include <vulkan/vulkan_format_traits.hpp>
+
+#include "BinaryIo.hpp"
+#include "DeferredDestroyQueue.hpp"
+#include "GraphicsPipelineKey.hpp"
+#include "PipelineStateCapture.hpp"
+#include "WorkerPool.hpp"
+
 namespace etna
 {
 
-static vk::UniquePipeline createComputePipelineInternal(
-  vk::Device device, vk::PipelineLayout layout, const vk::PipelineShaderStageCreateInfo stage)
+// Keeps the data referenced by vk::SpecializationInfo alive during pipeline creation
+struct SpecializationStorage
+{
+  std::vector<vk::SpecializationMapEntry> entries;
+  std::vector<std::byte> data;
+  vk::SpecializationInfo info{};
+};
+
+// Everything pipeline creation needs to know about a program. ShaderProgramManager
+// is not thread-safe, so this is gathered on the calling thread and handed to workers.
+struct ProgramSnapshot
+{
+  ShaderProgramId id;
+  std::string name;
+  std::vector<vk::PipelineShaderStageCreateInfo> stages;
+  std::vector<SpecializationConstantInfo> specConstants;
+  vk::PipelineLayout layout;
+};
+
+static ProgramSnapshot snapshot_program(
+  const ShaderProgramManager& shader_manager, ShaderProgramId program)
+{
+  const auto info = shader_manager.getProgramInfo(program);
+  const auto specConstants = info.getSpecializationConstants();
+  return ProgramSnapshot{
+    .id = program,
+    .name = info.getName(),
+    .stages = shader_manager.getShaderStages(program),
+    .specConstants = {specConstants.begin(), specConstants.end()},
+    .layout = info.getPipelineLayout(),
+  };
+}
+
+static std::vector<vk::PipelineShaderStageCreateInfo> get_specialized_stages(
+  const ProgramSnapshot& program,
+  const SpecializationConstants& constants,
+  SpecializationStorage& storage)
+{
+  auto stages = program.stages;
+  if (constants.empty())
+    return stages;
+
+  // Constants are resolved by name on every (re)creation, as reloaded shaders
+  // might have renumbered them
+  constants.resolve(program.specConstants, program.name, storage.entries, storage.data);
+  storage.info.setMapEntries(storage.entries);
+  storage.info.setDataSize(storage.data.size());
+  storage.info.setPData(storage.data.data());
+
+  // Entries for constants that a stage does not declare are ignored by Vulkan
+  for (auto& stage : stages)
+    stage.setPSpecializationInfo(&storage.info);
+  return stages;
+}
+
+// Everything pipeline creation needs apart from the create infos, cheap to copy into tasks
+struct PipelineCompiler
+{
+  vk::Device device;
+  vk::PipelineCache cache;
+  // Requires VK_KHR_pipeline_executable_properties and its pipelineExecutableInfo feature
+  bool captureStatistics;
+};
+
+// Storage for what the driver reports about a pipeline while creating it
+struct CreationFeedback
+{
+  explicit CreationFeedback(uint32_t stage_count)
+    : stages(stage_count)
+  {
+    info.setPPipelineCreationFeedback(&pipeline);
+    info.setPipelineStageCreationFeedbacks(stages);
+  }
+
+  // The info points into this
+  CreationFeedback(const CreationFeedback&) = delete;
+  CreationFeedback& operator=(const CreationFeedback&) = delete;
+
+  vk::PipelineCreationFeedback pipeline{};
+  std::vector<vk::PipelineCreationFeedback> stages;
+  vk::PipelineCreationFeedbackCreateInfo info{};
+};
+
+static std::vector<vk::ShaderStageFlagBits> get_stages(const vk::GraphicsPipelineCreateInfo& info)
+{
+  std::vector<vk::ShaderStageFlagBits> stages;
+  for (uint32_t i = 0; i < info.stageCount; ++i)
+    stages.push_back(info.pStages[i].stage);
+  return stages;
+}
+
+static std::vector<vk::ShaderStageFlagBits> get_stages(const vk::ComputePipelineCreateInfo& info)
+{
+  return {info.stage.stage};
+}
+
+static std::vector<vk::ShaderStageFlagBits> get_stages(
+  const vk::RayTracingPipelineCreateInfoKHR& info)
+{
+  std::vector<vk::ShaderStageFlagBits> stages;
+  for (uint32_t i = 0; i < info.stageCount; ++i)
+    stages.push_back(info.pStages[i].stage);
+  return stages;
+}
+
+static std::chrono::nanoseconds get_duration(const vk::PipelineCreationFeedback& feedback)
+{
+  if (!(feedback.flags & vk::PipelineCreationFeedbackFlagBits::eValid))
+    return std::chrono::nanoseconds{0};
+  return std::chrono::nanoseconds{feedback.duration};
+}
+
+static bool is_cache_hit(const vk::PipelineCreationFeedback& feedback)
+{
+  return static_cast<bool>(
+    feedback.flags & vk::PipelineCreationFeedbackFlagBits::eApplicationPipelineCacheHit);
+}
+
+static decltype(PipelineStatistics::Executable::Value::value) get_statistic_value(
+  const vk::PipelineExecutableStatisticKHR& statistic)
+{
+  switch (statistic.format)
+  {
+  case vk::PipelineExecutableStatisticFormatKHR::eBool32:
+    return statistic.value.b32 != vk::False;
+  case vk::PipelineExecutableStatisticFormatKHR::eInt64:
+    return statistic.value.i64;
+  case vk::PipelineExecutableStatisticFormatKHR::eUint64:
+    return statistic.value.u64;
+  case vk::PipelineExecutableStatisticFormatKHR::eFloat64:
+    return statistic.value.f64;
+  }
+  return uint64_t{0};
+}
+
+static std::vector<PipelineStatistics::Executable> query_executables(
+  vk::Device device, vk::Pipeline pipeline)
+{
+  const auto properties = unwrap_vk_result(
+    device.getPipelineExecutablePropertiesKHR(vk::PipelineInfoKHR{.pipeline = pipeline}));
+
+  std::vector<PipelineStatistics::Executable> executables;
+  for (uint32_t i = 0; i < properties.size(); ++i)
+  {
+    auto& executable = executables.emplace_back(PipelineStatistics::Executable{
+      .name = std::string{properties[i].name.data()},
+      .description = std::string{properties[i].description.data()},
+      .stages = properties[i].stages,
+      .subgroupSize = properties[i].subgroupSize,
+    });
+
+    const auto statistics = unwrap_vk_result(device.getPipelineExecutableStatisticsKHR(
+      vk::PipelineExecutableInfoKHR{.pipeline = pipeline, .executableIndex = i}));
+    for (const auto& statistic : statistics)
+      executable.values.push_back(PipelineStatistics::Executable::Value{
+        .name = std::string{statistic.name.data()},
+        .description = std::string{statistic.description.data()},
+        .value = get_statistic_value(statistic),
+      });
+  }
+  return executables;
+}
+
+// Creates all of the pipelines with a single call, attaching creation feedback
+// to the infos, and gathers what the driver reported about them
+template <class Info>
+static std::vector<CompiledPipeline> create_pipelines(
+  const PipelineCompiler& compiler, std::span<Info> infos)
+{
+  std::deque<CreationFeedback> feedback;
+  std::vector<std::vector<vk::ShaderStageFlagBits>> stages;
+  for (auto& info : infos)
+  {
+    stages.push_back(get_stages(info));
+    auto& pipelineFeedback = feedback.emplace_back(static_cast<uint32_t>(stages.back().size()));
+    pipelineFeedback.info.pNext = info.pNext;
+    info.pNext = &pipelineFeedback.info;
+    if (compiler.captureStatistics)
+      info.flags |= vk::PipelineCreateFlagBits::eCaptureStatisticsKHR;
+  }
+
+  std::vector<vk::UniquePipeline> pipelines;
+  if constexpr (std::is_same_v<Info, vk::GraphicsPipelineCreateInfo>)
+    pipelines =
+      unwrap_vk_result(compiler.device.createGraphicsPipelinesUnique(compiler.cache, infos));
+  else if constexpr (std::is_same_v<Info, vk::ComputePipelineCreateInfo>)
+    pipelines =
+      unwrap_vk_result(compiler.device.createComputePipelinesUnique(compiler.cache, infos));
+  else
+    pipelines = unwrap_vk_result(
+      compiler.device.createRayTracingPipelinesKHRUnique({}, compiler.cache, infos));
+
+  std::vector<CompiledPipeline> compiled;
+  for (std::size_t i = 0; i < pipelines.size(); ++i)
+  {
+    PipelineStatistics statistics{
+      .creationTime = get_duration(feedback[i].pipeline),
+      .cacheHit = is_cache_hit(feedback[i].pipeline),
+    };
+    for (std::size_t j = 0; j < stages[i].size(); ++j)
+      statistics.stages.push_back(PipelineStatistics::Stage{
+        .stage = stages[i][j],
+        .creationTime = get_duration(feedback[i].stages[j]),
+        .cacheHit = is_cache_hit(feedback[i].stages[j]),
+      });
+    if (compiler.captureStatistics)
+      statistics.executables = query_executables(compiler.device, pipelines[i].get());
+
+    compiled.push_back(CompiledPipeline{std::move(pipelines[i]), std::move(statistics)});
+  }
+  return compiled;
+}
+
+template <class Info>
+static CompiledPipeline create_pipeline(const PipelineCompiler& compiler, Info& info)
+{
+  return std::move(create_pipelines(compiler, std::span{&info, 1}).front());
+}
+
+// A complete vk::ComputePipelineCreateInfo
+struct PreparedComputePipeline
+{
+  PreparedComputePipeline(const ProgramSnapshot& program, const ComputePipeline::CreateInfo& info)
+  {
+    const auto stages =
+      get_specialized_stages(program, info.specializationConstants, specialization);
+
+    ETNA_VERIFYF(
+      stages.size() == 1,
+      "Incorrect shader program, expected 1 stage for ComputePipeline, but got {}!",
+      stages.size());
+
+    createInfo.setStage(stages[0]);
+    createInfo.setLayout(program.layout);
+  }
+
+  // The stage points into this
+  PreparedComputePipeline(const PreparedComputePipeline&) = delete;
+  PreparedComputePipeline& operator=(const PreparedComputePipeline&) = delete;
+
+  SpecializationStorage specialization;
+  vk::ComputePipelineCreateInfo createInfo{};
+};
+
+static CompiledPipeline createComputePipelineInternal(
+  const PipelineCompiler& compiler,
+  const ProgramSnapshot& program,
+  const ComputePipeline::CreateInfo& info)
 {
-  vk::ComputePipelineCreateInfo pipelineInfo{.layout = layout};
-  pipelineInfo.setStage(stage);
+  ZoneScoped;
 
-  return unwrap_vk_result(device.createComputePipelineUnique(nullptr, pipelineInfo));
+  PreparedComputePipeline prepared{program, info};
+  return create_pipeline(compiler, prepared.createInfo);
 }
 
+// Shader groups of a ray tracing pipeline in the order of the shader binding table
+struct RaytraceGroups
+{
+  std::vector<vk::RayTracingShaderGroupCreateInfoKHR> groups;
+  // Raygen, miss, hit and callable groups
+  std::array<uint32_t, 4> counts{};
+};
 
-static vk::UniquePipeline create_graphics_pipeline_internal(
-  vk::Device device,
-  vk::PipelineLayout layout,
+static RaytraceGroups get_raytrace_groups(
   std::span<const vk::PipelineShaderStageCreateInfo> stages,
-  const GraphicsPipeline::CreateInfo& info)
+  const RaytracePipeline::CreateInfo& info,
+  const std::string& program_name)
 {
-  std::vector<vk::VertexInputAttributeDescription> vertexAttribures;
-  std::vector<vk::VertexInputBindingDescription> vertexBindings;
+  RaytraceGroups result;
+
+  auto addGeneral = [&](vk::ShaderStageFlagBits kind) {
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < stages.size(); ++i)
+    {
+      if (stages[i].stage != kind)
+        continue;
+      result.groups.push_back(vk::RayTracingShaderGroupCreateInfoKHR{
+        .type = vk::RayTracingShaderGroupTypeKHR::eGeneral,
+        .generalShader = i,
+        .closestHitShader = vk::ShaderUnusedKHR,
+        .anyHitShader = vk::ShaderUnusedKHR,
+        .intersectionShader = vk::ShaderUnusedKHR,
+      });
+      ++count;
+    }
+    return count;
+  };
+
+  auto checkShader = [&](uint32_t shader, vk::ShaderStageFlagBits kind) {
+    ETNA_VERIFYF(
+      shader == vk::ShaderUnusedKHR || (shader < stages.size() && stages[shader].stage == kind),
+      "Ray tracing pipeline for {}: hit group refers to shader {}, which is not a {} shader",
+      program_name,
+      shader,
+      vk::to_string(kind));
+    return shader;
+  };
+
+  result.counts[0] = addGeneral(vk::ShaderStageFlagBits::eRaygenKHR);
+  result.counts[1] = addGeneral(vk::ShaderStageFlagBits::eMissKHR);
+
+  std::vector<RaytracePipeline::HitGroup> hitGroups = info.hitGroups;
+  if (hitGroups.empty())
+    for (uint32_t i = 0; i < stages.size(); ++i)
+      if (stages[i].stage == vk::ShaderStageFlagBits::eClosestHitKHR)
+        hitGroups.push_back(RaytracePipeline::HitGroup{.closestHit = i});
+  for (const auto& hitGroup : hitGroups)
+    result.groups.push_back(vk::RayTracingShaderGroupCreateInfoKHR{
+      .type = hitGroup.intersection == vk::ShaderUnusedKHR
+        ? vk::RayTracingShaderGroupTypeKHR::eTrianglesHitGroup
+        : vk::RayTracingShaderGroupTypeKHR::eProceduralHitGroup,
+      .generalShader = vk::ShaderUnusedKHR,
+      .closestHitShader = checkShader(hitGroup.closestHit, vk::ShaderStageFlagBits::eClosestHitKHR),
+      .anyHitShader = checkShader(hitGroup.anyHit, vk::ShaderStageFlagBits::eAnyHitKHR),
+      .intersectionShader =
+        checkShader(hitGroup.intersection, vk::ShaderStageFlagBits::eIntersectionKHR),
+    });
+  result.counts[2] = static_cast<uint32_t>(hitGroups.size());
+
+  result.counts[3] = addGeneral(vk::ShaderStageFlagBits::eCallableKHR);
+  return result;
+}
+
+// A complete vk::RayTracingPipelineCreateInfoKHR
+struct PreparedRaytracePipeline
+{
+  PreparedRaytracePipeline(const ProgramSnapshot& program, const RaytracePipeline::CreateInfo& info)
+    : stages{get_specialized_stages(program, info.specializationConstants, specialization)}
+    , groups{get_raytrace_groups(stages, info, program.name).groups}
+  {
+    createInfo.setStages(stages);
+    createInfo.setGroups(groups);
+    createInfo.setMaxPipelineRayRecursionDepth(info.maxRayRecursionDepth);
+    createInfo.setLayout(program.layout);
+  }
+
+  // The create info points into this
+  PreparedRaytracePipeline(const PreparedRaytracePipeline&) = delete;
+  PreparedRaytracePipeline& operator=(const PreparedRaytracePipeline&) = delete;
+
+  SpecializationStorage specialization;
+  std::vector<vk::PipelineShaderStageCreateInfo> stages;
+  std::vector<vk::RayTracingShaderGroupCreateInfoKHR> groups;
+  vk::RayTracingPipelineCreateInfoKHR createInfo{};
+};
+
+
+// Float, signed and unsigned integer inputs have to be fed with compatible formats
+static char vertex_format_class(vk::Format format)
+{
+  const std::string_view numeric = vk::componentNumericFormat(format, 0);
+  if (numeric == "UINT")
+    return 'u';
+  if (numeric == "SINT")
+    return 'i';
+  return 'f';
+}
 
-  for (uint32_t i = 0; i < info.vertexShaderInput.bindings.size(); i++)
+// Mismatches between the supplied vertex input and the shader are not errors as
+// far as Vulkan is concerned, but they either read garbage or waste bandwidth.
+// Checked once when a pipeline is created, recreating it does not repeat the warnings.
+static void validate_vertex_input(
+  const ShaderProgramInfo& program, const VertexShaderInputDescription& description)
+{
+  const auto inputs = program.getVertexInputs();
+
+  for (uint32_t binding = 0; binding < description.bindings.size(); ++binding)
   {
-    const auto& bindingDesc = info.vertexShaderInput.bindings[i];
+    const auto& bindingDesc = description.bindings[binding];
     if (!bindingDesc.has_value())
       continue;
 
-    vertexBindings.emplace_back() = vk::VertexInputBindingDescription{
-      .binding = i,
-      .stride = bindingDesc->byteStreamDescription.stride,
-      .inputRate = bindingDesc->inputRate,
+    for (uint32_t location = 0; location < bindingDesc->attributeMapping.size(); ++location)
+    {
+      const uint32_t attrIdx = bindingDesc->attributeMapping[location];
+      if (attrIdx == VertexShaderInputDescription::Binding::UNUSED_LOCATION)
+        continue;
+
+      const auto& attributes = bindingDesc->byteStreamDescription.attributes;
+      ETNA_VERIFYF(
+        attrIdx < attributes.size(),
+        "Pipeline for {}: binding {} maps location {} to attribute {}, but there are only {}",
+        program.getName(),
+        binding,
+        location,
+        attrIdx,
+        attributes.size());
+      const vk::Format supplied = attributes[attrIdx].format;
+
+      // 64-bit three and four component inputs take two locations
+      auto input = std::find_if(inputs.begin(), inputs.end(), [location](const auto& in) {
+        return in.location <= location &&
+          location < in.location + get_vertex_input_location_count(in.format);
+      });
+      if (input == inputs.end())
+      {
+        spdlog::warn(
+          "Pipeline for {}: vertex attribute at location {} (binding {}) is never read by the "
+          "shader, but still gets fetched",
+          program.getName(),
+          location,
+          binding);
+        continue;
+      }
+      if (input->location != location)
+      {
+        spdlog::error(
+          "Pipeline for {}: vertex attribute at location {} (binding {}) overlaps vertex "
+          "input '{}', which also takes this location",
+          program.getName(),
+          location,
+          binding,
+          input->name);
+        continue;
+      }
+
+      if (input->format == vk::Format::eUndefined)
+        continue;
+
+      if (vertex_format_class(supplied) != vertex_format_class(input->format))
+        spdlog::error(
+          "Pipeline for {}: vertex input '{}' expects {}-like data, but is fed with {}",
+          program.getName(),
+          input->name,
+          vk::to_string(input->format),
+          vk::to_string(supplied));
+      else if (vk::componentCount(supplied) > vk::componentCount(input->format))
+        spdlog::warn(
+          "Pipeline for {}: vertex input '{}' only reads {} components, but is fed with {}, "
+          "which wastes bandwidth",
+          program.getName(),
+          input->name,
+          vk::componentCount(input->format),
+          vk::to_string(supplied));
+    }
+  }
+
+  for (const auto& input : inputs)
+  {
+    const bool supplied = std::any_of(
+      description.bindings.begin(), description.bindings.end(), [&input](const auto& binding) {
+        return binding.has_value() && input.location < binding->attributeMapping.size() &&
+          binding->attributeMapping[input.location] !=
+          VertexShaderInputDescription::Binding::UNUSED_LOCATION;
+      });
+    if (!supplied)
+      spdlog::error(
+        "Pipeline for {}: vertex input '{}' at location {} is not fed by any binding, "
+        "see ShaderProgramInfo::getDefaultVertexShaderInput",
+        program.getName(),
+        input.name,
+        input.location);
+  }
+}
+
+static void validate_dynamic_states(const GraphicsPipeline::CreateInfo& info)
+{
+  for (auto state : info.dynamicStates)
+  {
+    const auto extension = get_dynamic_state_extension(state);
+    ETNA_VERIFYF(
+      extension.empty() || get_context().isDeviceExtensionEnabled(extension),
+      "Dynamic state {} requires {}, add it to InitParams::deviceExtensions",
+      vk::to_string(state),
+      extension);
+  }
+}
+
+static std::string to_key(const BinaryWriter& writer)
+{
+  const auto bytes = writer.getData();
+  return {reinterpret_cast<const char*>(bytes.data()), bytes.size()};
+}
+
+// Pipelines are shared when everything they are created from is identical
+static std::string graphics_pipeline_key(
+  ShaderProgramId program, const GraphicsPipeline::CreateInfo& info)
+{
+  BinaryWriter writer;
+  writer.write(vk::PipelineBindPoint::eGraphics);
+  writer.write(program);
+  write_graphics_pipeline_state(writer, info);
+  return to_key(writer);
+}
+
+static std::string compute_pipeline_key(
+  ShaderProgramId program, const ComputePipeline::CreateInfo& info)
+{
+  BinaryWriter writer;
+  writer.write(vk::PipelineBindPoint::eCompute);
+  writer.write(program);
+  write_specialization_constants(writer, info.specializationConstants);
+  return to_key(writer);
+}
+
+static std::string raytrace_pipeline_key(
+  ShaderProgramId program, const RaytracePipeline::CreateInfo& info)
+{
+  BinaryWriter writer;
+  writer.write(vk::PipelineBindPoint::eRayTracingKHR);
+  writer.write(program);
+  writer.write(static_cast<uint32_t>(info.hitGroups.size()));
+  for (const auto& hitGroup : info.hitGroups)
+  {
+    writer.write(hitGroup.closestHit);
+    writer.write(hitGroup.anyHit);
+    writer.write(hitGroup.intersection);
+  }
+  writer.write(info.maxRayRecursionDepth);
+  write_specialization_constants(writer, info.specializationConstants);
+  return to_key(writer);
+}
+
+// Formats are not known up front, so they don't take part in the key
+static std::string format_agnostic_pipeline_key(
+  ShaderProgramId program, GraphicsPipeline::CreateInfo info)
+{
+  info.fragmentShaderOutput = {};
+  info.multisampleConfig.rasterizationSamples = vk::SampleCountFlagBits::e1;
+  BinaryWriter writer;
+  writer.writeString("format_agnostic");
+  writer.write(program);
+  write_graphics_pipeline_state(writer, info);
+  return to_key(writer);
+}
+
+// Vulkan structs describing a CreateInfo, along with the arrays they point to
+struct GraphicsPipelineState
+{
+  explicit GraphicsPipelineState(const GraphicsPipeline::CreateInfo& info)
+  {
+    for (uint32_t i = 0; i < info.vertexShaderInput.bindings.size(); i++)
+    {
+      const auto& bindingDesc = info.vertexShaderInput.bindings[i];
+      if (!bindingDesc.has_value())
+        continue;
+
+      vertexBindings.emplace_back() = vk::VertexInputBindingDescription{
+        .binding = i,
+        .stride = bindingDesc->byteStreamDescription.stride,
+        .inputRate = bindingDesc->inputRate,
+      };
+
+      for (uint32_t j = 0; j < bindingDesc->attributeMapping.size(); ++j)
+      {
+        if (bindingDesc->attributeMapping[j] == bindingDesc->UNUSED_LOCATION)
+          continue;
+        const auto& attr =
+          bindingDesc->byteStreamDescription.attributes[bindingDesc->attributeMapping[j]];
+        vertexAttribures.emplace_back() = vk::VertexInputAttributeDescription{
+          .location = j,
+          .binding = i,
+          .format = attr.format,
+          .offset = attr.offset,
+        };
+      }
+    }
+
+    vertexInput.setVertexAttributeDescriptions(vertexAttribures);
+    vertexInput.setVertexBindingDescriptions(vertexBindings);
+
+    blendState.setAttachments(info.blendingConfig.attachments);
+    blendState.blendConstants = info.blendingConfig.blendConstants;
+
+    dynamicState.setDynamicStates(info.dynamicStates);
+
+    rendering.setColorAttachmentFormats(info.fragmentShaderOutput.colorAttachmentFormats);
+  }
+
+  // The structs point into the vectors
+  GraphicsPipelineState(const GraphicsPipelineState&) = delete;
+  GraphicsPipelineState& operator=(const GraphicsPipelineState&) = delete;
+
+  std::vector<vk::VertexInputAttributeDescription> vertexAttribures;
+  std::vector<vk::VertexInputBindingDescription> vertexBindings;
+  vk::PipelineVertexInputStateCreateInfo vertexInput{};
+
+  vk::PipelineViewportStateCreateInfo viewportState{
+    .viewportCount = 1,
+    .scissorCount = 1,
+  };
+
+  vk::PipelineColorBlendStateCreateInfo blendState{};
+  vk::PipelineDynamicStateCreateInfo dynamicState{};
+  vk::PipelineRenderingCreateInfo rendering{};
+};
+
+// A complete vk::GraphicsPipelineCreateInfo, `info` has to outlive it
+struct PreparedGraphicsPipeline
+{
+  PreparedGraphicsPipeline(const ProgramSnapshot& program, const GraphicsPipeline::CreateInfo& info)
+    : stages{get_specialized_stages(program, info.specializationConstants, specialization)}
+    , state{info}
+  {
+    createInfo = vk::GraphicsPipelineCreateInfo{
+      .pNext = &state.rendering,
+      .pVertexInputState = &state.vertexInput,
+      .pInputAssemblyState = &info.inputAssemblyConfig,
+      .pTessellationState = &info.tessellationConfig,
+      .pViewportState = &state.viewportState,
+      .pRasterizationState = &info.rasterizationConfig,
+      .pMultisampleState = &info.multisampleConfig,
+      .pDepthStencilState = &info.depthConfig,
+      .pColorBlendState = &state.blendState,
+      .pDynamicState = &state.dynamicState,
+      .layout = program.layout,
+    };
+    createInfo.setStages(stages);
+  }
+
+  SpecializationStorage specialization;
+  std::vector<vk::PipelineShaderStageCreateInfo> stages;
+  GraphicsPipelineState state;
+  vk::GraphicsPipelineCreateInfo createInfo{};
+};
+
+static CompiledPipeline create_graphics_pipeline_internal(
+  const PipelineCompiler& compiler,
+  const ProgramSnapshot& program,
+  const GraphicsPipeline::CreateInfo& info)
+{
+  ZoneScoped;
+
+  PreparedGraphicsPipeline prepared{program, info};
+  return create_pipeline(compiler, prepared.createInfo);
+}
+
+/**
+ * Parts of graphics pipelines created with VK_EXT_graphics_pipeline_library,
+ * keyed by the canonical bytes of the state they contain. Most new pipelines
+ * share the majority of their parts with existing ones, and linking parts
+ * without link time optimization is nearly free, so new combinations of
+ * materials and render targets can be used on the very frame they appear.
+ */
+class GraphicsLibraryCache
+{
+public:
+  explicit GraphicsLibraryCache(const PipelineCompiler& pipeline_compiler)
+    : compiler{pipeline_compiler}
+  {
+  }
+
+  // Thread-safe, parts missing from the cache are created on the calling thread
+  CompiledPipeline link(
+    const ProgramSnapshot& program, const GraphicsPipeline::CreateInfo& info, bool optimized)
+  {
+    ZoneScoped;
+
+    SpecializationStorage specialization;
+    const auto stages =
+      get_specialized_stages(program, info.specializationConstants, specialization);
+    GraphicsPipelineState state{info};
+
+    using Part = vk::GraphicsPipelineLibraryFlagBitsEXT;
+    std::vector<vk::Pipeline> libraries;
+    // Mesh pipelines have no vertex input, so there is no such part for them
+    const bool hasMeshStage = std::any_of(stages.begin(), stages.end(), [](const auto& stage) {
+      return stage.stage == vk::ShaderStageFlagBits::eMeshEXT;
+    });
+    if (!hasMeshStage)
+      libraries.push_back(getPart(Part::eVertexInputInterface, program, info, stages, state));
+    libraries.push_back(getPart(Part::ePreRasterizationShaders, program, info, stages, state));
+    libraries.push_back(getPart(Part::eFragmentShader, program, info, stages, state));
+    libraries.push_back(getPart(Part::eFragmentOutputInterface, program, info, stages, state));
+
+    vk::PipelineLibraryCreateInfoKHR libraryInfo{};
+    libraryInfo.setLibraries(libraries);
+
+    vk::GraphicsPipelineCreateInfo pipelineInfo{
+      .pNext = &libraryInfo,
+      .flags = optimized ? vk::PipelineCreateFlagBits::eLinkTimeOptimizationEXT
+                         : vk::PipelineCreateFlags{},
+      .layout = program.layout,
+    };
+    return create_pipeline(compiler, pipelineInfo);
+  }
+
+  // Parts containing shaders of reloaded programs are useless from now on
+  void evict(std::span<ShaderProgramId const> programs)
+  {
+    std::unique_lock lock{mutex};
+    std::erase_if(parts, [programs](const auto& entry) {
+      return std::find(programs.begin(), programs.end(), entry.second.program) != programs.end();
+    });
+  }
+
+  void clear()
+  {
+    std::unique_lock lock{mutex};
+    parts.clear();
+  }
+
+private:
+  vk::Pipeline getPart(
+    vk::GraphicsPipelineLibraryFlagBitsEXT part,
+    const ProgramSnapshot& program,
+    const GraphicsPipeline::CreateInfo& info,
+    std::span<const vk::PipelineShaderStageCreateInfo> stages,
+    const GraphicsPipelineState& state)
+  {
+    using Part = vk::GraphicsPipelineLibraryFlagBitsEXT;
+    const bool hasShaders = part == Part::ePreRasterizationShaders || part == Part::eFragmentShader;
+
+    BinaryWriter keyWriter;
+    keyWriter.write(part);
+    if (hasShaders)
+    {
+      keyWriter.write(program.id);
+      write_specialization_constants(keyWriter, info.specializationConstants);
+    }
+    switch (part)
+    {
+    case Part::eVertexInputInterface:
+      write_vertex_input_state(keyWriter, info);
+      break;
+    case Part::ePreRasterizationShaders:
+      write_pre_rasterization_state(keyWriter, info);
+      break;
+    case Part::eFragmentShader:
+      write_fragment_shader_state(keyWriter, info);
+      break;
+    case Part::eFragmentOutputInterface:
+      write_fragment_output_state(keyWriter, info);
+      break;
+    }
+    std::string key = to_key(keyWriter);
+
+    {
+      std::unique_lock lock{mutex};
+      if (auto it = parts.find(key); it != parts.end())
+        return it->second.library.get();
+    }
+
+    // Pre-rasterization gets every stage up to the fragment one
+    std::vector<vk::PipelineShaderStageCreateInfo> partStages;
+    for (const auto& stage : stages)
+      if (
+        (part == Part::eFragmentShader) ==
+        (stage.stage == vk::ShaderStageFlagBits::eFragment))
+        partStages.push_back(stage);
+
+    vk::GraphicsPipelineLibraryCreateInfoEXT libraryInfo{
+      .pNext = &state.rendering,
+      .flags = part,
+    };
+    vk::GraphicsPipelineCreateInfo pipelineInfo{
+      .pNext = &libraryInfo,
+      .flags = vk::PipelineCreateFlagBits::eLibraryKHR |
+        vk::PipelineCreateFlagBits::eRetainLinkTimeOptimizationInfoEXT,
+      .pDynamicState = &state.dynamicState,
     };
+    // Statistics of the linked pipeline are only available if its parts captured them
+    if (compiler.captureStatistics)
+      pipelineInfo.flags |= vk::PipelineCreateFlagBits::eCaptureStatisticsKHR;
+    switch (part)
+    {
+    case Part::eVertexInputInterface:
+      pipelineInfo.pVertexInputState = &state.vertexInput;
+      pipelineInfo.pInputAssemblyState = &info.inputAssemblyConfig;
+      break;
+    case Part::ePreRasterizationShaders:
+      pipelineInfo.setStages(partStages);
+      pipelineInfo.pTessellationState = &info.tessellationConfig;
+      pipelineInfo.pViewportState = &state.viewportState;
+      pipelineInfo.pRasterizationState = &info.rasterizationConfig;
+      pipelineInfo.layout = program.layout;
+      break;
+    case Part::eFragmentShader:
+      pipelineInfo.setStages(partStages);
+      pipelineInfo.pMultisampleState = &info.multisampleConfig;
+      pipelineInfo.pDepthStencilState = &info.depthConfig;
+      pipelineInfo.layout = program.layout;
+      break;
+    case Part::eFragmentOutputInterface:
+      pipelineInfo.pMultisampleState = &info.multisampleConfig;
+      pipelineInfo.pColorBlendState = &state.blendState;
+      break;
+    }
+    auto library =
+      unwrap_vk_result(compiler.device.createGraphicsPipelineUnique(compiler.cache, pipelineInfo));
+
+    // Another thread might have created the same part in the meantime, theirs wins
+    std::unique_lock lock{mutex};
+    auto it = parts.try_emplace(
+      std::move(key),
+      CachedPart{hasShaders ? program.id : ShaderProgramId::Invalid, std::move(library)});
+    return it.first->second.library.get();
+  }
+
+private:
+  struct CachedPart
+  {
+    ShaderProgramId program;
+    vk::UniquePipeline library;
+  };
+
+  PipelineCompiler compiler;
+
+  std::mutex mutex;
+  std::unordered_map<std::string, CachedPart> parts;
+};
+
+// Pipelines that are recreated on worker threads, the results are delivered through promises
+template <class CreateInfo>
+struct PipelineRecreation
+{
+  PipelineId id;
+  ProgramSnapshot program;
+  CreateInfo info;
+  std::promise<CompiledPipeline> result;
+};
+
+using GraphicsRecreation = PipelineRecreation<GraphicsPipeline::CreateInfo>;
+using ComputeRecreation = PipelineRecreation<ComputePipeline::CreateInfo>;
+using RaytraceRecreation = PipelineRecreation<RaytracePipeline::CreateInfo>;
+
+// A single call for many pipelines lets the driver share work between them
+static void create_graphics_pipeline_batch(
+  const PipelineCompiler& compiler,
+  GraphicsLibraryCache* libraries,
+  std::span<GraphicsRecreation> batch)
+{
+  ZoneScoped;
+
+  // Libraries are linked one by one, but most parts are shared between pipelines
+  if (libraries != nullptr)
+  {
+    for (auto& job : batch)
+      job.result.set_value(libraries->link(job.program, job.info, true));
+    return;
+  }
+
+  std::deque<PreparedGraphicsPipeline> prepared;
+  std::vector<vk::GraphicsPipelineCreateInfo> infos;
+  for (const auto& job : batch)
+    infos.push_back(prepared.emplace_back(job.program, job.info).createInfo);
+
+  auto created = create_pipelines(compiler, std::span{infos});
+  for (std::size_t i = 0; i < batch.size(); ++i)
+    batch[i].result.set_value(std::move(created[i]));
+}
+
+// Compute and ray tracing pipelines, which are always created from scratch
+template <class Prepared, class Job>
+static void create_prepared_pipeline_batch(const PipelineCompiler& compiler, std::span<Job> batch)
+{
+  ZoneScoped;
+
+  std::deque<Prepared> prepared;
+  std::vector<decltype(Prepared::createInfo)> infos;
+  for (const auto& job : batch)
+    infos.push_back(prepared.emplace_back(job.program, job.info).createInfo);
+
+  auto created = create_pipelines(compiler, std::span{infos});
+  for (std::size_t i = 0; i < batch.size(); ++i)
+    batch[i].result.set_value(std::move(created[i]));
+}
+
+// Splits the jobs into a batch per worker thread, so that all of them are busy
+template <class Job, class F>
+static void submit_batches(WorkerPool& pool, std::vector<Job> jobs, F create_batch)
+{
+  if (jobs.empty())
+    return;
+
+  const std::size_t threads = std::max<std::size_t>(pool.getThreadCount(), 1);
+  const std::size_t batchCount = std::min(jobs.size(), threads);
+  const std::size_t batchSize = (jobs.size() + batchCount - 1) / batchCount;
+  for (std::size_t begin = 0; begin < jobs.size(); begin += batchSize)
+  {
+    const std::size_t end = std::min(begin + batchSize, jobs.size());
+    std::vector<Job> batch(
+      std::make_move_iterator(jobs.begin() + begin), std::make_move_iterator(jobs.begin() + end));
+    pool.submit(
+      [batch = std::move(batch), create_batch]() mutable { create_batch(std::span{batch}); });
+  }
+}
+
+static constexpr uint32_t PIPELINE_CACHE_MAGIC = 0x43505445; // "ETPC"
+static constexpr uint32_t PIPELINE_CACHE_VERSION = 1;
+
+// Driver data is prefixed with everything that invalidates it. Drivers are supposed
+// to reject foreign data themselves, but not all of them do so gracefully.
+static void write_pipeline_cache_header(
+  BinaryWriter& writer, const vk::PhysicalDeviceProperties& props)
+{
+  writer.write(PIPELINE_CACHE_MAGIC);
+  writer.write(PIPELINE_CACHE_VERSION);
+  writer.write(props.vendorID);
+  writer.write(props.deviceID);
+  writer.write(props.driverVersion);
+  writer.write(props.pipelineCacheUUID);
+}
+
+static std::vector<std::byte> read_pipeline_cache(
+  const std::filesystem::path& path, const vk::PhysicalDeviceProperties& props)
+{
+  auto file = read_binary_file(path);
+  if (!file.has_value())
+    return {};
+
+  BinaryWriter expected;
+  write_pipeline_cache_header(expected, props);
+  const auto header = expected.getData();
+
+  std::span<std::byte const> data;
+  if (
+    file->size() < header.size() ||
+    std::memcmp(file->data(), header.data(), header.size()) != 0 ||
+    !BinaryReader{std::span{*file}.subspan(header.size())}.readBytes(data))
+  {
+    spdlog::info("Pipeline cache {} was written by another device or driver, ignoring it", path);
+    return {};
+  }
+
+  return {data.begin(), data.end()};
+}
+
+PipelineManager::PipelineManager(
+  vk::Device dev, ShaderProgramManager& shader_manager, CreateInfo create_info)
+  : device{dev}
+  , shaderManager{shader_manager}
+  , pipelineCachePath{std::move(create_info.pipelineCachePath)}
+  , deviceProperties{create_info.deviceProperties}
+  , rayTracingProperties{create_info.rayTracingProperties}
+  , captureStatistics{create_info.captureExecutableStatistics}
+{
+  ZoneScoped;
+
+  std::vector<std::byte> initialData;
+  if (!pipelineCachePath.empty())
+    initialData = read_pipeline_cache(pipelineCachePath, deviceProperties);
+
+  vk::PipelineCacheCreateInfo info{};
+  info.setInitialDataSize(initialData.size());
+  info.setPInitialData(initialData.data());
+  pipelineCache = unwrap_vk_result(device.createPipelineCacheUnique(info));
+
+  if (!initialData.empty())
+    spdlog::info(
+      "Loaded {} bytes of pipeline cache from {}", initialData.size(), pipelineCachePath);
+
+  if (create_info.useGraphicsPipelineLibrary)
+    graphicsLibraries = std::make_unique<GraphicsLibraryCache>(getCompiler());
+
+  if (!create_info.pipelineStateCapturePath.empty())
+    stateCapture =
+      std::make_unique<PipelineStateCapture>(std::move(create_info.pipelineStateCapturePath));
+}
+
+PipelineManager::~PipelineManager() = default;
+
+void PipelineManager::savePipelineStateCapture()
+{
+  if (stateCapture != nullptr)
+    stateCapture->save();
+}
+
+// Captures outlive the shaders and the device they were recorded with, so
+// everything creation would assert on is checked before prewarming a record
+static bool has_stage(
+  std::span<const vk::PipelineShaderStageCreateInfo> stages, vk::ShaderStageFlagBits stage)
+{
+  return std::any_of(
+    stages.begin(), stages.end(), [stage](const auto& info) { return info.stage == stage; });
+}
+
+static bool is_creatable(
+  std::span<const vk::PipelineShaderStageCreateInfo> stages,
+  const GraphicsPipeline::CreateInfo& info)
+{
+  const bool hasMesh = has_stage(stages, vk::ShaderStageFlagBits::eMeshEXT);
+  if (!hasMesh && !has_stage(stages, vk::ShaderStageFlagBits::eVertex))
+    return false;
+  if (hasMesh && !get_context().isDeviceExtensionEnabled(vk::EXTMeshShaderExtensionName))
+    return false;
+
+  for (auto state : info.dynamicStates)
+  {
+    const auto extension = get_dynamic_state_extension(state);
+    if (!extension.empty() && !get_context().isDeviceExtensionEnabled(extension))
+      return false;
+  }
+
+  for (const auto& binding : info.vertexShaderInput.bindings)
+    if (binding.has_value())
+      for (const uint32_t attrIdx : binding->attributeMapping)
+        if (
+          attrIdx != VertexShaderInputDescription::Binding::UNUSED_LOCATION &&
+          attrIdx >= binding->byteStreamDescription.attributes.size())
+          return false;
+
+  return true;
+}
 
-    for (uint32_t j = 0; j < bindingDesc->attributeMapping.size(); ++j)
+static bool is_creatable(
+  std::span<const vk::PipelineShaderStageCreateInfo> stages, const ComputePipeline::CreateInfo&)
+{
+  return stages.size() == 1 && stages[0].stage == vk::ShaderStageFlagBits::eCompute;
+}
+
+static bool is_creatable(
+  std::span<const vk::PipelineShaderStageCreateInfo> stages,
+  const RaytracePipeline::CreateInfo& info,
+  uint32_t max_recursion_depth)
+{
+  if (
+    !get_context().isDeviceExtensionEnabled(vk::KHRRayTracingPipelineExtensionName) ||
+    !has_stage(stages, vk::ShaderStageFlagBits::eRaygenKHR) ||
+    info.maxRayRecursionDepth > max_recursion_depth)
+    return false;
+
+  auto isShader = [stages](uint32_t shader, vk::ShaderStageFlagBits kind) {
+    return shader == vk::ShaderUnusedKHR ||
+      (shader < stages.size() && stages[shader].stage == kind);
+  };
+  return std::all_of(info.hitGroups.begin(), info.hitGroups.end(), [&](const auto& group) {
+    return isShader(group.closestHit, vk::ShaderStageFlagBits::eClosestHitKHR) &&
+      isShader(group.anyHit, vk::ShaderStageFlagBits::eAnyHitKHR) &&
+      isShader(group.intersection, vk::ShaderStageFlagBits::eIntersectionKHR);
+  });
+}
+
+void PipelineManager::prewarmCapturedPipelines()
+{
+  if (stateCapture == nullptr)
+    return;
+
+  ZoneScoped;
+
+  // Programs might have been renamed, removed or changed since the capture, and
+  // extensions might have been disabled. Such records are dropped for good.
+  uint32_t skipped = 0;
+  const auto pipelines = stateCapture->getPipelines();
+  for (const auto& captured : pipelines)
+  {
+    const ShaderProgramId program = shaderManager.tryGetProgram(captured.programName.c_str());
+    bool creatable = program != ShaderProgramId::Invalid;
+    if (creatable)
     {
-      const auto& attr =
-        bindingDesc->byteStreamDescription.attributes[bindingDesc->attributeMapping[j]];
-      vertexAttribures.emplace_back() = vk::VertexInputAttributeDescription{
-        .location = j,
-        .binding = i,
-        .format = attr.format,
-        .offset = attr.offset,
-      };
+      const auto stages = shaderManager.getShaderStages(program);
+      const auto constants = shaderManager.getProgramInfo(program).getSpecializationConstants();
+      creatable = std::visit(
+        [&](const auto& info) {
+          if (!info.specializationConstants.matches(constants))
+            return false;
+          if constexpr (std::is_same_v<std::decay_t<decltype(info)>, RaytracePipeline::CreateInfo>)
+            return is_creatable(stages, info, rayTracingProperties.maxRayRecursionDepth);
+          else
+            return is_creatable(stages, info);
+        },
+        captured.info);
+    }
+    if (!creatable)
+    {
+      stateCapture->forget(captured);
+      ++skipped;
+      continue;
     }
+
+    if (const auto* graphics = std::get_if<GraphicsPipeline::CreateInfo>(&captured.info))
+      prewarmedPipelines.push_back(createGraphics(program, *graphics, true));
+    else if (const auto* compute = std::get_if<ComputePipeline::CreateInfo>(&captured.info))
+      prewarmedPipelines.push_back(createCompute(program, *compute, true));
+    else
+      prewarmedPipelines.push_back(
+        createRaytrace(program, std::get<RaytracePipeline::CreateInfo>(captured.info), true));
   }
 
-  vk::PipelineVertexInputStateCreateInfo vertexInput{};
-  vertexInput.setVertexAttributeDescriptions(vertexAttribures);
-  vertexInput.setVertexBindingDescriptions(vertexBindings);
+  spdlog::info(
+    "Prewarming {} captured pipelines, dropped {} that can't be created anymore",
+    pipelines.size() - skipped,
+    skipped);
+}
 
+void PipelineManager::releasePrewarmedPipelines()
+{
+  for (auto id : prewarmedPipelines)
+    destroyPipeline(id);
+  prewarmedPipelines.clear();
+}
 
-  vk::PipelineViewportStateCreateInfo viewportState{
-    .viewportCount = 1,
-    .scissorCount = 1,
-  };
+void PipelineManager::savePipelineCache()
+{
+  if (pipelineCachePath.empty())
+    return;
 
-  vk::PipelineColorBlendStateCreateInfo blendState{
-    .logicOpEnable = static_cast<vk::Bool32>(info.blendingConfig.logicOpEnable),
-    .logicOp = info.blendingConfig.logicOp,
-  };
-  blendState.setAttachments(info.blendingConfig.attachments);
-  blendState.blendConstants = info.blendingConfig.blendConstants;
+  ZoneScoped;
 
-  vk::PipelineDynamicStateCreateInfo dynamicState{};
-  dynamicState.setDynamicStates(info.dynamicStates);
+  const auto data = unwrap_vk_result(device.getPipelineCacheData(pipelineCache.get()));
 
-  vk::PipelineRenderingCreateInfo rendering{
-    .depthAttachmentFormat = info.fragmentShaderOutput.depthAttachmentFormat,
-    .stencilAttachmentFormat = info.fragmentShaderOutput.stencilAttachmentFormat,
-  };
-  rendering.setColorAttachmentFormats(info.fragmentShaderOutput.colorAttachmentFormats);
-
-  vk::GraphicsPipelineCreateInfo pipelineInfo{
-    .pNext = &rendering,
-    .pVertexInputState = &vertexInput,
-    .pInputAssemblyState = &info.inputAssemblyConfig,
-    .pTessellationState = &info.tessellationConfig,
-    .pViewportState = &viewportState,
-    .pRasterizationState = &info.rasterizationConfig,
-    .pMultisampleState = &info.multisampleConfig,
-    .pDepthStencilState = &info.depthConfig,
-    .pColorBlendState = &blendState,
-    .pDynamicState = &dynamicState,
-    .layout = layout,
-  };
-  pipelineInfo.setStages(stages);
+  BinaryWriter writer;
+  write_pipeline_cache_header(writer, deviceProperties);
+  writer.writeBytes(std::as_bytes(std::span{data}));
 
-  return unwrap_vk_result(device.createGraphicsPipelineUnique(nullptr, pipelineInfo));
+  // A crash mid-write must not leave a truncated cache behind for the next launch
+  if (!write_binary_file_atomically(pipelineCachePath, writer.getData()))
+    spdlog::warn("Failed to write pipeline cache {}", pipelineCachePath);
 }
 
-PipelineManager::PipelineManager(vk::Device dev, ShaderProgramManager& shader_manager)
-  : device{dev}
-  , shaderManager{shader_manager}
+static constexpr uint32_t PIPELINE_INDEX_BITS = 20;
+static constexpr uint32_t PIPELINE_INDEX_MASK = (1u << PIPELINE_INDEX_BITS) - 1;
+static constexpr uint32_t PIPELINE_GENERATION_MASK = ~0u >> PIPELINE_INDEX_BITS;
+
+// The all-ones index is never handed out, so no id collides with PipelineId::Invalid
+static PipelineId make_pipeline_id(uint32_t index, uint32_t generation)
+{
+  return static_cast<PipelineId>((generation << PIPELINE_INDEX_BITS) | index);
+}
+
+static uint32_t pipeline_index(PipelineId id)
+{
+  return static_cast<uint32_t>(id) & PIPELINE_INDEX_MASK;
+}
+
+static uint32_t pipeline_generation(PipelineId id)
+{
+  return static_cast<uint32_t>(id) >> PIPELINE_INDEX_BITS;
+}
+
+PipelineId PipelineManager::createCompute(
+  ShaderProgramId program, ComputePipeline::CreateInfo info, bool async)
 {
+  auto key = compute_pipeline_key(program, info);
+  if (auto existing = acquireShared(key, !async); existing.has_value())
+    return *existing;
+  const PipelineId pipelineId = registerShared(std::move(key), program, info);
+
+  if (!async)
+    installPipeline(
+      pipelineId,
+      createComputePipelineInternal(getCompiler(), snapshot_program(shaderManager, program), info));
+  else
+    pendingPipelines.emplace(
+      pipelineId,
+      get_context().getWorkerPool().submit(
+        [compiler = getCompiler(),
+         snapshot = snapshot_program(shaderManager, program),
+         info = std::move(info)]() {
+          return createComputePipelineInternal(compiler, snapshot, info);
+        }));
+
+  return pipelineId;
 }
 
 ComputePipeline PipelineManager::createComputePipeline(
   const char* shader_program_name, ComputePipeline::CreateInfo info)
 {
-  const PipelineId pipelineId = static_cast<PipelineId>(pipelineIdCounter++);
   const ShaderProgramId progId = shaderManager.getProgram(shader_program_name);
-  const std::vector<vk::PipelineShaderStageCreateInfo> shaderStages =
-    shaderManager.getShaderStages(progId);
-
-  ETNA_VERIFYF(
-    shaderStages.size() == 1,
-    "Incorrect shader program, expected 1 stage for ComputePipeline, but got {}!",
-    shaderStages.size());
-
-  pipelines.emplace(
-    pipelineId,
-    createComputePipelineInternal(device, shaderManager.getProgramLayout(progId), shaderStages[0]));
-  computePipelineParameters.emplace(pipelineId, ComputeParameters{progId, std::move(info)});
+  return ComputePipeline(this, createCompute(progId, std::move(info), false), progId);
+}
 
-  return ComputePipeline(this, pipelineId, progId);
-};
+ComputePipeline PipelineManager::createComputePipelineAsync(
+  const char* shader_program_name, ComputePipeline::CreateInfo info)
+{
+  const ShaderProgramId progId = shaderManager.getProgram(shader_program_name);
+  return ComputePipeline(this, createCompute(progId, std::move(info), true), progId);
+}
 
 static void print_prog_info(const etna::ShaderProgramInfo& info, const std::string& name)
 {
@@ -153,48 +1222,667 @@ static void print_prog_info(const etna::ShaderProgramInfo& info, const std::stri
     }
   }
 
-  auto pc = info.getPushConst();
-  if (pc.size > 0)
-    fmt::format_to(it, "  PushConst size = {}, stages = {}\n", pc.size, pc.stageFlags);
+  for (const auto& pc : info.getPushConstRanges())
+    fmt::format_to(
+      it, "  PushConst offset = {}, size = {}, stages = {}\n", pc.offset, pc.size, pc.stageFlags);
+
+  for (const auto& constant : info.getSpecializationConstants())
+    fmt::format_to(
+      it,
+      "  SpecConst {} '{}': {} bytes, default = {}\n",
+      constant.constantId,
+      constant.name,
+      constant.size,
+      constant.defaultValue);
 
   spdlog::info("Program Info for '{}':\n{}", name, result);
 }
 
+PipelineId PipelineManager::createGraphics(
+  ShaderProgramId program, GraphicsPipeline::CreateInfo info, bool async)
+{
+  validate_dynamic_states(info);
+  auto key = graphics_pipeline_key(program, info);
+  if (auto existing = acquireShared(key, !async); existing.has_value())
+    return *existing;
+  const PipelineId pipelineId = registerShared(std::move(key), program, info);
+
+  if (!async)
+    installPipeline(pipelineId, buildGraphicsPipeline(pipelineId, program, info));
+  else
+    pendingPipelines.emplace(
+      pipelineId,
+      get_context().getWorkerPool().submit(
+        [compiler = getCompiler(),
+         libraries = graphicsLibraries.get(),
+         snapshot = snapshot_program(shaderManager, program),
+         info = std::move(info)]() {
+          if (libraries == nullptr)
+            return create_graphics_pipeline_internal(compiler, snapshot, info);
+          // Nobody is waiting for this pipeline yet, so the fast link is skipped
+          return libraries->link(snapshot, info, true);
+        }));
+
+  return pipelineId;
+}
+
 GraphicsPipeline PipelineManager::createGraphicsPipeline(
   const char* shader_program_name, GraphicsPipeline::CreateInfo info)
 {
-  const PipelineId pipelineId = static_cast<PipelineId>(pipelineIdCounter++);
   const ShaderProgramId progId = shaderManager.getProgram(shader_program_name);
+  print_prog_info(shaderManager.getProgramInfo(progId), shader_program_name);
+  validate_vertex_input(shaderManager.getProgramInfo(progId), info.vertexShaderInput);
+  return GraphicsPipeline(this, createGraphics(progId, std::move(info), false), progId);
+}
+
+GraphicsPipeline PipelineManager::createGraphicsPipelineAsync(
+  const char* shader_program_name, GraphicsPipeline::CreateInfo info)
+{
+  const ShaderProgramId progId = shaderManager.getProgram(shader_program_name);
+  print_prog_info(shaderManager.getProgramInfo(progId), shader_program_name);
+  validate_vertex_input(shaderManager.getProgramInfo(progId), info.vertexShaderInput);
+  return GraphicsPipeline(this, createGraphics(progId, std::move(info), true), progId);
+}
+
+GraphicsPipeline PipelineManager::createFormatAgnosticGraphicsPipeline(
+  const char* shader_program_name, GraphicsPipeline::CreateInfo info)
+{
+  const ShaderProgramId progId = shaderManager.getProgram(shader_program_name);
+  // Variants are compiled later on without printing anything
+  print_prog_info(shaderManager.getProgramInfo(progId), shader_program_name);
+  validate_vertex_input(shaderManager.getProgramInfo(progId), info.vertexShaderInput);
+  validate_dynamic_states(info);
+  auto key = format_agnostic_pipeline_key(progId, info);
+  if (auto existing = acquireShared(key, false); existing.has_value())
+    return GraphicsPipeline(this, *existing, progId);
+  const PipelineId id =
+    registerShared(std::move(key), progId, FormatAgnosticInfo{std::move(info), {}});
+  return GraphicsPipeline(this, id, progId);
+}
+
+void PipelineManager::prewarmFormatVariants(
+  const GraphicsPipeline& pipeline, std::span<const RenderTargetFormats> formats)
+{
+  ZoneScoped;
+
+  for (const auto& variantFormats : formats)
+    getFormatVariant(pipeline.id, variantFormats, true);
+}
+
+PipelineId PipelineManager::getFormatVariant(
+  PipelineId id, const RenderTargetFormats& formats, bool async)
+{
+  auto* agnostic = std::get_if<FormatAgnosticInfo>(&getSlot(id).info);
+  ETNA_VERIFYF(agnostic != nullptr, "Pipeline was not created as format agnostic!");
+
+  auto it = std::find_if(
+    agnostic->variants.begin(), agnostic->variants.end(), [&formats](const auto& variant) {
+      return variant.first == formats;
+    });
+  if (it != agnostic->variants.end())
+  {
+    const PipelineId variant = it->second;
+    // Might have been prewarmed and still be compiling
+    if (!async && !isPipelineReady(variant))
+      if (auto pending = pendingPipelines.find(variant); pending != pendingPipelines.end())
+      {
+        installPipeline(variant, pending->second.get());
+        pendingPipelines.erase(pending);
+      }
+    return variant;
+  }
+
+  auto info = agnostic->info;
+  info.fragmentShaderOutput = {
+    .colorAttachmentFormats = formats.colorAttachmentFormats,
+    .depthAttachmentFormat = formats.depthAttachmentFormat,
+    .stencilAttachmentFormat = formats.stencilAttachmentFormat,
+  };
+  info.multisampleConfig.rasterizationSamples = formats.samples;
+
+  // Creating the variant might reallocate the slots
+  const PipelineId variant = createGraphics(getSlot(id).shaderProgram, std::move(info), async);
+  std::get<FormatAgnosticInfo>(getSlot(id).info).variants.emplace_back(formats, variant);
+  return variant;
+}
+
+// Mesh pipelines are graphics pipelines without vertex input, Vulkan ignores
+// the vertex input, input assembly and tessellation states when there is a mesh stage
+static GraphicsPipeline::CreateInfo to_graphics_info(MeshPipeline::CreateInfo info)
+{
+  return GraphicsPipeline::CreateInfo{
+    .rasterizationConfig = info.rasterizationConfig,
+    .multisampleConfig = info.multisampleConfig,
+    .blendingConfig = std::move(info.blendingConfig),
+    .depthConfig = info.depthConfig,
+    .fragmentShaderOutput = std::move(info.fragmentShaderOutput),
+    .dynamicStates = std::move(info.dynamicStates),
+    .specializationConstants = std::move(info.specializationConstants),
+  };
+}
+
+static void validate_mesh_program(const ShaderProgramManager& shader_manager, ShaderProgramId id)
+{
+  const auto stages = shader_manager.getShaderStages(id);
+  const bool hasMesh = std::any_of(stages.begin(), stages.end(), [](const auto& stage) {
+    return stage.stage == vk::ShaderStageFlagBits::eMeshEXT;
+  });
+  ETNA_VERIFYF(
+    hasMesh,
+    "Program {} has no mesh shader and can not be used for a MeshPipeline",
+    shader_manager.getProgramInfo(id).getName());
+  ETNA_VERIFYF(
+    get_context().isDeviceExtensionEnabled(vk::EXTMeshShaderExtensionName),
+    "Mesh pipelines require {}, add it to InitParams::deviceExtensions",
+    vk::EXTMeshShaderExtensionName);
+}
+
+MeshPipeline PipelineManager::createMeshPipeline(
+  const char* shader_program_name, MeshPipeline::CreateInfo info)
+{
+  const ShaderProgramId progId = shaderManager.getProgram(shader_program_name);
+  validate_mesh_program(shaderManager, progId);
+  print_prog_info(shaderManager.getProgramInfo(progId), shader_program_name);
+  return MeshPipeline(
+    this, createGraphics(progId, to_graphics_info(std::move(info)), false), progId);
+}
+
+MeshPipeline PipelineManager::createMeshPipelineAsync(
+  const char* shader_program_name, MeshPipeline::CreateInfo info)
+{
+  const ShaderProgramId progId = shaderManager.getProgram(shader_program_name);
+  validate_mesh_program(shaderManager, progId);
+  print_prog_info(shaderManager.getProgramInfo(progId), shader_program_name);
+  return MeshPipeline(
+    this, createGraphics(progId, to_graphics_info(std::move(info)), true), progId);
+}
+
+PipelineId PipelineManager::createRaytrace(
+  ShaderProgramId program, RaytracePipeline::CreateInfo info, bool async)
+{
+  const auto programInfo = shaderManager.getProgramInfo(program);
+  ETNA_VERIFYF(
+    get_context().isDeviceExtensionEnabled(vk::KHRRayTracingPipelineExtensionName),
+    "Ray tracing pipelines require {}, add it to InitParams::deviceExtensions",
+    vk::KHRRayTracingPipelineExtensionName);
+  const auto stages = shaderManager.getShaderStages(program);
+  const bool hasRaygen = std::any_of(stages.begin(), stages.end(), [](const auto& stage) {
+    return stage.stage == vk::ShaderStageFlagBits::eRaygenKHR;
+  });
+  ETNA_VERIFYF(
+    hasRaygen,
+    "Program {} has no ray generation shader and can not be used for a RaytracePipeline",
+    programInfo.getName());
+  ETNA_VERIFYF(
+    info.maxRayRecursionDepth <= rayTracingProperties.maxRayRecursionDepth,
+    "Ray tracing pipeline for {}: recursion depth {} exceeds the device limit of {}",
+    programInfo.getName(),
+    info.maxRayRecursionDepth,
+    rayTracingProperties.maxRayRecursionDepth);
+
+  auto key = raytrace_pipeline_key(program, info);
+  if (auto existing = acquireShared(key, !async); existing.has_value())
+    return *existing;
+  const PipelineId pipelineId = registerShared(std::move(key), program, info);
+
+  auto create = [compiler = getCompiler(),
+                 snapshot = snapshot_program(shaderManager, program),
+                 info = std::move(info)]() {
+    ZoneScoped;
+    PreparedRaytracePipeline prepared{snapshot, info};
+    return create_pipeline(compiler, prepared.createInfo);
+  };
+  if (!async)
+    installPipeline(pipelineId, create());
+  else
+    pendingPipelines.emplace(pipelineId, get_context().getWorkerPool().submit(std::move(create)));
+
+  print_prog_info(programInfo, programInfo.getName());
+  return pipelineId;
+}
+
+RaytracePipeline PipelineManager::createRaytracePipeline(
+  const char* shader_program_name, RaytracePipeline::CreateInfo info)
+{
+  const ShaderProgramId progId = shaderManager.getProgram(shader_program_name);
+  return RaytracePipeline(this, createRaytrace(progId, std::move(info), false), progId);
+}
+
+RaytracePipeline PipelineManager::createRaytracePipelineAsync(
+  const char* shader_program_name, RaytracePipeline::CreateInfo info)
+{
+  const ShaderProgramId progId = shaderManager.getProgram(shader_program_name);
+  return RaytracePipeline(this, createRaytrace(progId, std::move(info), true), progId);
+}
+
+std::optional<PipelineId> PipelineManager::acquireShared(const std::string& key, bool wait)
+{
+  auto it = pipelineIdsByKey.find(key);
+  if (it == pipelineIdsByKey.end())
+    return std::nullopt;
+
+  const PipelineId id = it->second;
+  ++getSlot(id).refCount;
+
+  // Somebody might have requested the same pipeline asynchronously before
+  if (wait && !isPipelineReady(id))
+    if (auto pending = pendingPipelines.find(id); pending != pendingPipelines.end())
+    {
+      installPipeline(id, pending->second.get());
+      pendingPipelines.erase(pending);
+    }
+
+  return id;
+}
+
+PipelineId PipelineManager::registerShared(
+  std::string key, ShaderProgramId program, PipelineInfo info)
+{
+  uint32_t index;
+  if (!freeSlots.empty())
+  {
+    index = freeSlots.back();
+    freeSlots.pop_back();
+  }
+  else
+  {
+    ETNA_VERIFYF(slots.size() < PIPELINE_INDEX_MASK, "Too many pipelines!");
+    index = static_cast<uint32_t>(slots.size());
+    slots.emplace_back();
+  }
+
+  // Format agnostic pipelines are captured through their variants
+  if (stateCapture != nullptr)
+  {
+    const auto programInfo = shaderManager.getProgramInfo(program);
+    if (const auto* graphics = std::get_if<GraphicsPipeline::CreateInfo>(&info))
+      stateCapture->record(programInfo.getName(), *graphics);
+    else if (const auto* compute = std::get_if<ComputePipeline::CreateInfo>(&info))
+      stateCapture->record(programInfo.getName(), *compute);
+    else if (const auto* raytrace = std::get_if<RaytracePipeline::CreateInfo>(&info))
+      stateCapture->record(programInfo.getName(), *raytrace);
+  }
+
+  auto& slot = slots[index];
+  slot.refCount = 1;
+  slot.key = key;
+  slot.shaderProgram = program;
+  slot.info = std::move(info);
+
+  const PipelineId id = make_pipeline_id(index, slot.generation);
+  pipelineIdsByKey.emplace(std::move(key), id);
+  return id;
+}
 
-  pipelines.emplace(
-    pipelineId,
-    create_graphics_pipeline_internal(
-      device, shaderManager.getProgramLayout(progId), shaderManager.getShaderStages(progId), info));
-  graphicsPipelineParameters.emplace(pipelineId, PipelineParameters{progId, std::move(info)});
+const PipelineManager::PipelineSlot& PipelineManager::getSlot(PipelineId id) const
+{
+  const uint32_t index = pipeline_index(id);
+  ETNA_ASSERTF(
+    index < slots.size() && slots[index].refCount > 0 &&
+      slots[index].generation == pipeline_generation(id),
+    "Pipeline {} was already destroyed!",
+    static_cast<uint32_t>(id));
+  return slots[index];
+}
+
+PipelineManager::PipelineSlot& PipelineManager::getSlot(PipelineId id)
+{
+  return const_cast<PipelineSlot&>(std::as_const(*this).getSlot(id));
+}
+
+PipelineCompiler PipelineManager::getCompiler() const
+{
+  return PipelineCompiler{
+    .device = device,
+    .cache = pipelineCache.get(),
+    .captureStatistics = captureStatistics,
+  };
+}
+
+CompiledPipeline PipelineManager::buildGraphicsPipeline(
+  PipelineId id, ShaderProgramId program, const GraphicsPipeline::CreateInfo& info)
+{
+  auto snapshot = snapshot_program(shaderManager, program);
+  if (graphicsLibraries == nullptr)
+    return create_graphics_pipeline_internal(getCompiler(), snapshot, info);
+
+  auto fastLinked = graphicsLibraries->link(snapshot, info, false);
+
+  // The optimized pipeline replaces the fast one as soon as it is ready
+  pendingPipelines[id] = get_context().getWorkerPool().submit(
+    [libraries = graphicsLibraries.get(), program = std::move(snapshot), info]() {
+      return libraries->link(program, info, true);
+    });
+
+  return fastLinked;
+}
+
+// Tracy identifies plots by the address of their name, so names have to live forever
+[[maybe_unused]] static const char* get_plot_name(std::string name)
+{
+  static std::unordered_set<std::string> names;
+  return names.insert(std::move(name)).first->c_str();
+}
+
+static void plot_statistics([[maybe_unused]] const PipelineStatistics& statistics)
+{
+  TracyPlot(
+    "Pipeline creation, ms",
+    std::chrono::duration<double, std::milli>(statistics.creationTime).count());
+  TracyPlot("Pipeline cache hit", static_cast<int64_t>(statistics.cacheHit));
+
+#ifdef TRACY_ENABLE
+  for (const auto& executable : statistics.executables)
+    for (const auto& value : executable.values)
+    {
+      const char* name = get_plot_name(fmt::format("{}: {}", executable.name, value.name));
+      std::visit([name](auto v) { TracyPlot(name, static_cast<double>(v)); }, value.value);
+    }
+#endif
+}
+
+static std::array<uint32_t, 3> get_workgroup_size(
+  const ShaderProgramInfo& program, const SpecializationConstants& constants)
+{
+  const auto reflected = program.getWorkgroupSize();
+  auto result = reflected.size;
+  if (constants.empty())
+    return result;
+
+  std::vector<vk::SpecializationMapEntry> entries;
+  std::vector<std::byte> data;
+  constants.resolve(program.getSpecializationConstants(), program.getName(), entries, data);
+  for (std::size_t dim = 0; dim < result.size(); ++dim)
+  {
+    const uint32_t constantId = reflected.constantIds[dim];
+    auto it = std::find_if(entries.begin(), entries.end(), [constantId](const auto& entry) {
+      return entry.constantID == constantId;
+    });
+    if (constantId != WorkgroupSizeInfo::NO_CONSTANT_ID && it != entries.end())
+      std::memcpy(&result[dim], data.data() + it->offset, sizeof(uint32_t));
+  }
+  return result;
+}
+
+void PipelineManager::installPipeline(PipelineId id, CompiledPipeline compiled)
+{
+  plot_statistics(compiled.statistics);
+
+  auto& slot = getSlot(id);
+  if (slot.pipeline)
+    get_context().getDeferredDestroyQueue().retire(std::move(slot.pipeline));
+  slot.pipeline = std::move(compiled.pipeline);
+  slot.statistics = std::move(compiled.statistics);
+
+  // Group handles belong to the pipeline, so every new version needs a new table
+  if (std::holds_alternative<RaytracePipeline::CreateInfo>(slot.info))
+    buildShaderBindingTable(slot);
+
+  // The program might have been reloaded with a different local_size
+  if (auto compute = std::get_if<ComputePipeline::CreateInfo>(&slot.info))
+    slot.workgroupSize = get_workgroup_size(
+      shaderManager.getProgramInfo(slot.shaderProgram), compute->specializationConstants);
+}
+
+static vk::DeviceSize align_up(vk::DeviceSize value, vk::DeviceSize alignment)
+{
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+void PipelineManager::buildShaderBindingTable(PipelineSlot& slot)
+{
+  ZoneScoped;
+
+  const auto& info = std::get<RaytracePipeline::CreateInfo>(slot.info);
+  const auto stages = shaderManager.getShaderStages(slot.shaderProgram);
+  const auto layout =
+    get_raytrace_groups(stages, info, shaderManager.getProgramInfo(slot.shaderProgram).getName());
+
+  const uint32_t groupCount = static_cast<uint32_t>(layout.groups.size());
+  const uint32_t handleSize = rayTracingProperties.shaderGroupHandleSize;
+  const auto handles = unwrap_vk_result(device.getRayTracingShaderGroupHandlesKHR<std::byte>(
+    slot.pipeline.get(), 0, groupCount, groupCount * handleSize));
+
+  // Records only contain the handles. Every ray generation record is used as a
+  // region of its own, so all of them have to be aligned like regions are.
+  const vk::DeviceSize baseAlignment = rayTracingProperties.shaderGroupBaseAlignment;
+  const vk::DeviceSize raygenStride = align_up(handleSize, baseAlignment);
+  const vk::DeviceSize recordStride =
+    align_up(handleSize, rayTracingProperties.shaderGroupHandleAlignment);
+
+  std::array<vk::DeviceSize, 4> offsets{};
+  std::array<vk::DeviceSize, 4> strides{};
+  vk::DeviceSize size = 0;
+  for (std::size_t region = 0; region < offsets.size(); ++region)
+  {
+    offsets[region] = size;
+    strides[region] = region == 0 ? raygenStride : recordStride;
+    size = align_up(size + layout.counts[region] * strides[region], baseAlignment);
+  }
+
+  Buffer table = get_context().createBuffer(Buffer::CreateInfo{
+    .size = size,
+    .bufferUsage = vk::BufferUsageFlagBits::eShaderBindingTableKHR |
+      vk::BufferUsageFlagBits::eShaderDeviceAddress,
+    .memoryUsage = VMA_MEMORY_USAGE_AUTO,
+    .allocationCreate = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+    .minAlignment = baseAlignment,
+    .name = "shader_binding_table",
+  });
+
+  std::byte* data = table.map();
+  uint32_t group = 0;
+  for (std::size_t region = 0; region < offsets.size(); ++region)
+    for (uint32_t i = 0; i < layout.counts[region]; ++i, ++group)
+      std::memcpy(
+        data + offsets[region] + i * strides[region],
+        handles.data() + group * handleSize,
+        handleSize);
+  table.unmap();
+
+  const vk::DeviceAddress address = table.getDeviceAddress();
+  std::array<vk::StridedDeviceAddressRegionKHR, 4> regions{};
+  for (std::size_t region = 0; region < regions.size(); ++region)
+    if (layout.counts[region] > 0)
+      regions[region] = vk::StridedDeviceAddressRegionKHR{
+        .deviceAddress = address + offsets[region],
+        .stride = strides[region],
+        .size = layout.counts[region] * strides[region],
+      };
+  // The ray generation region always consists of a single record
+  regions[0].size = raygenStride;
+
+  // The old table stays valid for the frames that still trace with the old pipeline
+  if (slot.shaderBindingTable.get())
+    get_context().getDeferredDestroyQueue().retire(std::move(slot.shaderBindingTable));
+  slot.shaderBindingTable = std::move(table);
+  slot.sbtRegions = RaytracePipeline::ShaderBindingTable{
+    .raygen = regions[0],
+    .miss = regions[1],
+    .hit = regions[2],
+    .callable = regions[3],
+  };
+  slot.raygenCount = layout.counts[0];
+}
+
+RaytracePipeline::ShaderBindingTable PipelineManager::getShaderBindingTable(
+  PipelineId id, uint32_t raygen_index) const
+{
+  const auto& slot = getSlot(id);
+  ETNA_VERIFYF(slot.pipeline, "Ray tracing pipeline is still being compiled!");
+  ETNA_VERIFYF(
+    raygen_index < slot.raygenCount,
+    "Ray generation shader #{} requested, but the pipeline only has {}",
+    raygen_index,
+    slot.raygenCount);
+
+  auto result = slot.sbtRegions;
+  result.raygen.deviceAddress += raygen_index * result.raygen.stride;
+  return result;
+}
+
+void PipelineManager::collectCompiledPipelines()
+{
+  for (auto it = pendingPipelines.begin(); it != pendingPipelines.end();)
+  {
+    if (it->second.wait_for(std::chrono::seconds{0}) != std::future_status::ready)
+    {
+      ++it;
+      continue;
+    }
+    installPipeline(it->first, it->second.get());
+    it = pendingPipelines.erase(it);
+  }
+
+  // Nothing was ever bound with these, so they are destroyed right away
+  std::erase_if(abandonedPipelines, [](const auto& future) {
+    return future.wait_for(std::chrono::seconds{0}) == std::future_status::ready;
+  });
+}
+
+void PipelineManager::waitForPipelines(std::span<const PipelineBase* const> batch)
+{
+  ZoneScoped;
+
+  for (const auto* pipeline : batch)
+  {
+    auto it = pendingPipelines.find(pipeline->id);
+    if (it == pendingPipelines.end())
+      continue;
+    installPipeline(it->first, it->second.get());
+    pendingPipelines.erase(it);
+  }
+}
+
+void PipelineManager::waitForAllPipelines()
+{
+  ZoneScoped;
+
+  for (auto& [id, future] : pendingPipelines)
+    installPipeline(id, future.get());
+  pendingPipelines.clear();
+  waitForAbandonedPipelines();
+}
 
-  GraphicsPipeline pipeline(this, pipelineId, progId);
-  print_prog_info(shaderManager.getProgramInfo(shader_program_name), shader_program_name);
-  return pipeline;
+void PipelineManager::waitForAbandonedPipelines()
+{
+  for (auto& future : abandonedPipelines)
+    future.wait();
+  abandonedPipelines.clear();
 }
 
 void PipelineManager::recreate()
 {
-  pipelines.clear();
-  for (const auto& [id, params] : graphicsPipelineParameters)
-    pipelines.emplace(
-      id,
-      create_graphics_pipeline_internal(
-        device,
-        shaderManager.getProgramLayout(params.shaderProgram),
-        shaderManager.getShaderStages(params.shaderProgram),
-        params.info));
-  for (const auto& [id, params] : computePipelineParameters)
-    pipelines.emplace(
-      id,
-      createComputePipelineInternal(
-        device,
-        shaderManager.getProgramLayout(params.shaderProgram),
-        shaderManager.getShaderStages(params.shaderProgram)[0]));
+  std::vector<ShaderProgramId> programs;
+  for (const auto& slot : slots)
+    if (slot.refCount > 0)
+      programs.push_back(slot.shaderProgram);
+  std::sort(programs.begin(), programs.end());
+  programs.erase(std::unique(programs.begin(), programs.end()), programs.end());
+
+  // Compilations in flight might be linking parts that are about to be destroyed
+  waitForAllPipelines();
+  if (graphicsLibraries != nullptr)
+    graphicsLibraries->clear();
+  recreate(programs);
+}
+
+void PipelineManager::recreate(std::span<ShaderProgramId const> programs)
+{
+  ZoneScoped;
+
+  // Compilations in flight might be linking parts of these programs
+  waitForPrograms(programs);
+  waitForAbandonedPipelines();
+  if (graphicsLibraries != nullptr)
+    graphicsLibraries->evict(programs);
+
+  // Programs that are not in here are left alone, along with their pipelines
+  std::unordered_map<ShaderProgramId, ProgramSnapshot> snapshots;
+  for (auto program : programs)
+    snapshots.emplace(program, snapshot_program(shaderManager, program));
+
+  // Compilations that are still running reference the old shaders, so they
+  // have to finish before those are gone. Their results are used until the new
+  // pipelines are collected, the same as old pipelines are.
+  auto replacePending = [this](PipelineId id, std::future<CompiledPipeline> future) {
+    if (auto it = pendingPipelines.find(id); it != pendingPipelines.end())
+      installPipeline(id, it->second.get());
+    pendingPipelines[id] = std::move(future);
+  };
+
+  std::vector<GraphicsRecreation> graphicsJobs;
+  std::vector<ComputeRecreation> computeJobs;
+  std::vector<RaytraceRecreation> raytraceJobs;
+  for (uint32_t index = 0; index < slots.size(); ++index)
+  {
+    const auto& slot = slots[index];
+    if (slot.refCount == 0)
+      continue;
+    auto it = snapshots.find(slot.shaderProgram);
+    if (it == snapshots.end())
+      continue;
+
+    // Variants are recreated on their own
+    if (std::holds_alternative<FormatAgnosticInfo>(slot.info))
+      continue;
+
+    const PipelineId id = make_pipeline_id(index, slot.generation);
+    if (const auto* graphics = std::get_if<GraphicsPipeline::CreateInfo>(&slot.info))
+    {
+      graphicsJobs.push_back(GraphicsRecreation{id, it->second, *graphics, {}});
+      replacePending(id, graphicsJobs.back().result.get_future());
+    }
+    else if (const auto* compute = std::get_if<ComputePipeline::CreateInfo>(&slot.info))
+    {
+      computeJobs.push_back(ComputeRecreation{id, it->second, *compute, {}});
+      replacePending(id, computeJobs.back().result.get_future());
+    }
+    else
+    {
+      const auto& raytrace = std::get<RaytracePipeline::CreateInfo>(slot.info);
+      raytraceJobs.push_back(RaytraceRecreation{id, it->second, raytrace, {}});
+      replacePending(id, raytraceJobs.back().result.get_future());
+    }
+  }
+
+  auto& pool = get_context().getWorkerPool();
+  submit_batches(
+    pool,
+    std::move(graphicsJobs),
+    [compiler = getCompiler(), libraries = graphicsLibraries.get()](
+      std::span<GraphicsRecreation> batch) {
+      create_graphics_pipeline_batch(compiler, libraries, batch);
+    });
+  submit_batches(
+    pool,
+    std::move(computeJobs),
+    [compiler = getCompiler()](std::span<ComputeRecreation> batch) {
+      create_prepared_pipeline_batch<PreparedComputePipeline>(compiler, batch);
+    });
+  submit_batches(
+    pool,
+    std::move(raytraceJobs),
+    [compiler = getCompiler()](std::span<RaytraceRecreation> batch) {
+      create_prepared_pipeline_batch<PreparedRaytracePipeline>(compiler, batch);
+    });
+}
+
+void PipelineManager::waitForPrograms(std::span<ShaderProgramId const> programs)
+{
+  ZoneScoped;
+
+  for (auto it = pendingPipelines.begin(); it != pendingPipelines.end();)
+  {
+    const ShaderProgramId program = getSlot(it->first).shaderProgram;
+    if (std::find(programs.begin(), programs.end(), program) == programs.end())
+    {
+      ++it;
+      continue;
+    }
+    installPipeline(it->first, it->second.get());
+    it = pendingPipelines.erase(it);
+  }
 }
 
 void PipelineManager::destroyPipeline(PipelineId id)
@@ -202,14 +1890,63 @@ void PipelineManager::destroyPipeline(PipelineId id)
   if (id == PipelineId::Invalid)
     return;
 
-  pipelines.erase(id);
-  graphicsPipelineParameters.erase(id);
+  // Other handles might still be using the same pipeline
+  auto& slot = getSlot(id);
+  if (--slot.refCount > 0)
+    return;
+  pipelineIdsByKey.erase(slot.key);
+
+  // An abandoned compilation still finishes, the result is simply dropped
+  if (auto pending = pendingPipelines.find(id); pending != pendingPipelines.end())
+  {
+    abandonedPipelines.push_back(std::move(pending->second));
+    pendingPipelines.erase(pending);
+  }
+
+  std::vector<std::pair<RenderTargetFormats, PipelineId>> variants;
+  if (auto* agnostic = std::get_if<FormatAgnosticInfo>(&slot.info))
+    variants = std::move(agnostic->variants);
+
+  slot.key.clear();
+  slot.shaderProgram = ShaderProgramId::Invalid;
+  slot.info = std::monostate{};
+  slot.pipeline.reset();
+  slot.statistics = {};
+  slot.shaderBindingTable.reset();
+  slot.sbtRegions = {};
+  slot.raygenCount = 0;
+  slot.generation = (slot.generation + 1) & PIPELINE_GENERATION_MASK;
+  freeSlots.push_back(pipeline_index(id));
+
+  for (const auto& variant : variants)
+    destroyPipeline(variant.second);
+}
+
+const PipelineStatistics& PipelineManager::getStatistics(PipelineId id) const
+{
+  return getSlot(id).statistics;
+}
+
+std::array<uint32_t, 3> PipelineManager::getWorkgroupSize(PipelineId id) const
+{
+  const auto& slot = getSlot(id);
+  ETNA_VERIFYF(slot.pipeline, "Compute pipeline is still being compiled!");
+  return slot.workgroupSize;
+}
+
+bool PipelineManager::isPipelineReady(PipelineId id) const
+{
+  // Variants are compiled when they are bound
+  const auto& slot = getSlot(id);
+  return slot.pipeline || std::holds_alternative<FormatAgnosticInfo>(slot.info);
 }
 
-vk::Pipeline PipelineManager::getVkPipeline(PipelineId id) const
+vk::Pipeline PipelineManager::getVkPipeline(PipelineId id)
 {
   ETNA_VERIFY(id != PipelineId::Invalid);
-  return pipelines.find(id)->second.get();
+  if (std::holds_alternative<FormatAgnosticInfo>(getSlot(id).info))
+    id = getFormatVariant(id, RenderTargetState::getCurrentFormats(), false);
+  return getSlot(id).pipeline.get();
 }
 
 vk::PipelineLayout PipelineManager::getVkPipelineLayout(ShaderProgramId id) const
@@ -0,0 +1,391 @@
+#include "PipelineStateCapture.hpp"
+
+#include <optional>
+#include <span>
+
+#include <fmt/std.h>
+#include <tracy/Tracy.hpp>
+
+#include <etna/Assert.hpp>
+
+#include "BinaryIo.hpp"
+
+
+namespace etna
+{
+
+static constexpr uint32_t PIPELINE_CAPTURE_MAGIC = 0x43535445; // "ETSC"
+static constexpr uint32_t PIPELINE_CAPTURE_VERSION = 1;
+
+// Index of the alternative in CapturedPipeline::info
+enum class CapturedKind : uint32_t
+{
+  Graphics,
+  Compute,
+  Raytrace,
+};
+
+// Arbitrary limit just to not allocate garbage amounts of memory on broken files
+static constexpr uint32_t MAX_ARRAY_SIZE = 4096;
+
+// The same field lists are used for writing and reading, so that the two can't
+// get out of sync. Every call returns false on broken input.
+class FieldWriter
+{
+public:
+  explicit FieldWriter(BinaryWriter& in_writer)
+    : writer{in_writer}
+  {
+  }
+
+  template <class T>
+  bool value(const T& value)
+  {
+    writer.write(value);
+    return true;
+  }
+
+  bool string(const std::string& str)
+  {
+    writer.writeString(str);
+    return true;
+  }
+
+  template <class T>
+  bool size(const std::vector<T>& vec)
+  {
+    writer.write(static_cast<uint32_t>(vec.size()));
+    return true;
+  }
+
+private:
+  BinaryWriter& writer;
+};
+
+class FieldReader
+{
+public:
+  explicit FieldReader(BinaryReader& in_reader)
+    : reader{in_reader}
+  {
+  }
+
+  template <class T>
+  bool value(T& value)
+  {
+    return reader.read(value);
+  }
+
+  bool string(std::string& str) { return reader.readString(str); }
+
+  template <class T>
+  bool size(std::vector<T>& vec)
+  {
+    uint32_t count = 0;
+    if (!reader.read(count) || count > MAX_ARRAY_SIZE)
+      return false;
+    vec.resize(count);
+    return true;
+  }
+
+private:
+  BinaryReader& reader;
+};
+
+template <class Io>
+static bool transfer_specialization_constants(Io& io, SpecializationConstants& constants)
+{
+  std::vector<SpecializationConstants::Value> values{
+    constants.getValues().begin(), constants.getValues().end()};
+  if (!io.size(values))
+    return false;
+  for (auto& value : values)
+    if (
+      !io.string(value.name) || !io.value(value.constantId) || !io.value(value.bits) ||
+      !io.value(value.size))
+      return false;
+
+  constants = {};
+  for (auto& value : values)
+    constants.setValue(std::move(value));
+  return true;
+}
+
+template <class Io>
+static bool transfer_vertex_input(Io& io, VertexShaderInputDescription& input)
+{
+  if (!io.size(input.bindings))
+    return false;
+  for (auto& binding : input.bindings)
+  {
+    bool present = binding.has_value();
+    if (!io.value(present))
+      return false;
+    if (!present)
+      continue;
+    if (!binding.has_value())
+      binding.emplace();
+
+    auto& stream = binding->byteStreamDescription;
+    if (!io.value(stream.stride) || !io.size(stream.attributes))
+      return false;
+    for (auto& attribute : stream.attributes)
+      if (!io.value(attribute.format) || !io.value(attribute.offset))
+        return false;
+    if (!io.value(binding->inputRate) || !io.size(binding->attributeMapping))
+      return false;
+    for (auto& location : binding->attributeMapping)
+      if (!io.value(location))
+        return false;
+  }
+  return true;
+}
+
+template <class Io>
+static bool transfer_stencil_op(Io& io, vk::StencilOpState& op)
+{
+  return io.value(op.failOp) && io.value(op.passOp) && io.value(op.depthFailOp) &&
+    io.value(op.compareOp) && io.value(op.compareMask) && io.value(op.writeMask) &&
+    io.value(op.reference);
+}
+
+// Structs with pNext are transferred field by field, the rest as a whole
+template <class Io>
+static bool transfer(Io& io, GraphicsPipeline::CreateInfo& info)
+{
+  if (!transfer_vertex_input(io, info.vertexShaderInput))
+    return false;
+
+  auto& assembly = info.inputAssemblyConfig;
+  auto& raster = info.rasterizationConfig;
+  const bool fixedFunctionOk = io.value(assembly.topology) &&
+    io.value(assembly.primitiveRestartEnable) &&
+    io.value(info.tessellationConfig.patchControlPoints) && io.value(raster.depthClampEnable) &&
+    io.value(raster.rasterizerDiscardEnable) && io.value(raster.polygonMode) &&
+    io.value(raster.cullMode) && io.value(raster.frontFace) && io.value(raster.depthBiasEnable) &&
+    io.value(raster.depthBiasConstantFactor) && io.value(raster.depthBiasClamp) &&
+    io.value(raster.depthBiasSlopeFactor) && io.value(raster.lineWidth);
+  if (!fixedFunctionOk)
+    return false;
+
+  auto& multisample = info.multisampleConfig;
+  const bool multisampleOk = io.value(multisample.rasterizationSamples) &&
+    io.value(multisample.sampleShadingEnable) && io.value(multisample.minSampleShading) &&
+    io.value(multisample.alphaToCoverageEnable) && io.value(multisample.alphaToOneEnable);
+  if (!multisampleOk)
+    return false;
+
+  auto& blending = info.blendingConfig;
+  if (!io.size(blending.attachments))
+    return false;
+  for (auto& attachment : blending.attachments)
+    if (!io.value(attachment))
+      return false;
+  if (
+    !io.value(blending.logicOpEnable) || !io.value(blending.logicOp) ||
+    !io.value(blending.blendConstants))
+    return false;
+
+  auto& depth = info.depthConfig;
+  const bool depthOk = io.value(depth.depthTestEnable) && io.value(depth.depthWriteEnable) &&
+    io.value(depth.depthCompareOp) && io.value(depth.depthBoundsTestEnable) &&
+    io.value(depth.stencilTestEnable) && transfer_stencil_op(io, depth.front) &&
+    transfer_stencil_op(io, depth.back) && io.value(depth.minDepthBounds) &&
+    io.value(depth.maxDepthBounds);
+  if (!depthOk)
+    return false;
+
+  auto& output = info.fragmentShaderOutput;
+  if (!io.size(output.colorAttachmentFormats))
+    return false;
+  for (auto& format : output.colorAttachmentFormats)
+    if (!io.value(format))
+      return false;
+  if (!io.value(output.depthAttachmentFormat) || !io.value(output.stencilAttachmentFormat))
+    return false;
+
+  if (!io.size(info.dynamicStates))
+    return false;
+  for (auto& state : info.dynamicStates)
+    if (!io.value(state))
+      return false;
+
+  return transfer_specialization_constants(io, info.specializationConstants);
+}
+
+template <class Io>
+static bool transfer(Io& io, ComputePipeline::CreateInfo& info)
+{
+  return transfer_specialization_constants(io, info.specializationConstants);
+}
+
+template <class Io>
+static bool transfer(Io& io, RaytracePipeline::CreateInfo& info)
+{
+  if (!io.size(info.hitGroups))
+    return false;
+  for (auto& group : info.hitGroups)
+    if (
+      !io.value(group.closestHit) || !io.value(group.anyHit) || !io.value(group.intersection))
+      return false;
+  return io.value(info.maxRayRecursionDepth) &&
+    transfer_specialization_constants(io, info.specializationConstants);
+}
+
+// Takes a copy, as the fields are transferred through non-const references
+template <class Info>
+static std::string serialize(CapturedKind kind, std::string_view program_name, Info info)
+{
+  BinaryWriter writer;
+  FieldWriter io{writer};
+  writer.write(kind);
+  writer.writeString(program_name);
+  transfer(io, info);
+
+  const auto bytes = writer.getData();
+  return {reinterpret_cast<const char*>(bytes.data()), bytes.size()};
+}
+
+static std::optional<CapturedPipeline> deserialize(std::span<std::byte const> entry)
+{
+  BinaryReader reader{entry};
+  FieldReader io{reader};
+
+  CapturedKind kind{};
+  CapturedPipeline result;
+  if (!reader.read(kind) || !reader.readString(result.programName))
+    return std::nullopt;
+
+  bool ok = false;
+  switch (kind)
+  {
+  case CapturedKind::Graphics:
+    ok = transfer(io, result.info.emplace<GraphicsPipeline::CreateInfo>());
+    break;
+  case CapturedKind::Compute:
+    ok = transfer(io, result.info.emplace<ComputePipeline::CreateInfo>());
+    break;
+  case CapturedKind::Raytrace:
+    ok = transfer(io, result.info.emplace<RaytracePipeline::CreateInfo>());
+    break;
+  default:
+    break;
+  }
+
+  if (!ok || !reader.isAtEnd())
+    return std::nullopt;
+  return result;
+}
+
+PipelineStateCapture::PipelineStateCapture(std::filesystem::path capture_path)
+  : path{std::move(capture_path)}
+{
+  ZoneScoped;
+
+  auto data = read_binary_file(path);
+  if (!data.has_value())
+    return;
+
+  BinaryReader reader{*data};
+
+  uint32_t magic = 0;
+  uint32_t version = 0;
+  uint32_t count = 0;
+  if (
+    !reader.read(magic) || magic != PIPELINE_CAPTURE_MAGIC || !reader.read(version) ||
+    version != PIPELINE_CAPTURE_VERSION || !reader.read(count))
+  {
+    spdlog::warn("Pipeline state capture {} is outdated or broken, ignoring it", path);
+    return;
+  }
+
+  for (uint32_t i = 0; i < count; ++i)
+  {
+    std::span<std::byte const> entry;
+    if (!reader.readBytes(entry))
+    {
+      spdlog::warn("Pipeline state capture {} is truncated, ignoring it", path);
+      entries.clear();
+      return;
+    }
+    entries.emplace(reinterpret_cast<const char*>(entry.data()), entry.size());
+  }
+}
+
+void PipelineStateCapture::record(
+  std::string_view program_name, const GraphicsPipeline::CreateInfo& info)
+{
+  // The mask lives behind a pointer that can't be restored
+  if (info.multisampleConfig.pSampleMask != nullptr)
+    return;
+  insert(serialize(CapturedKind::Graphics, program_name, info));
+}
+
+void PipelineStateCapture::record(
+  std::string_view program_name, const ComputePipeline::CreateInfo& info)
+{
+  insert(serialize(CapturedKind::Compute, program_name, info));
+}
+
+void PipelineStateCapture::record(
+  std::string_view program_name, const RaytracePipeline::CreateInfo& info)
+{
+  insert(serialize(CapturedKind::Raytrace, program_name, info));
+}
+
+void PipelineStateCapture::insert(std::string entry)
+{
+  if (entries.insert(std::move(entry)).second)
+    dirty = true;
+}
+
+std::vector<CapturedPipeline> PipelineStateCapture::getPipelines()
+{
+  std::vector<CapturedPipeline> result;
+  result.reserve(entries.size());
+  for (auto it = entries.begin(); it != entries.end();)
+  {
+    auto pipeline = deserialize(std::as_bytes(std::span{*it}));
+    if (!pipeline.has_value())
+    {
+      spdlog::warn("Dropping a broken pipeline from the state capture {}", path);
+      it = entries.erase(it);
+      dirty = true;
+      continue;
+    }
+    result.push_back(std::move(*pipeline));
+    ++it;
+  }
+  return result;
+}
+
+void PipelineStateCapture::forget(const CapturedPipeline& pipeline)
+{
+  const auto kind = static_cast<CapturedKind>(pipeline.info.index());
+  const auto entry = std::visit(
+    [&](const auto& info) { return serialize(kind, pipeline.programName, info); }, pipeline.info);
+  if (entries.erase(entry) > 0)
+    dirty = true;
+}
+
+void PipelineStateCapture::save()
+{
+  ZoneScoped;
+
+  if (!dirty)
+    return;
+
+  BinaryWriter writer;
+  writer.write(PIPELINE_CAPTURE_MAGIC);
+  writer.write(PIPELINE_CAPTURE_VERSION);
+  writer.write(static_cast<uint32_t>(entries.size()));
+  for (const auto& entry : entries)
+    writer.writeBytes(std::as_bytes(std::span{entry}));
+
+  if (write_binary_file_atomically(path, writer.getData()))
+    dirty = false;
+  else
+    spdlog::warn("Failed to write pipeline state capture to {}", path);
+}
+
+} // namespace etna
@@ -0,0 +1,70 @@
+#pragma once
+#ifndef ETNA_PIPELINE_STATE_CAPTURE_HPP_INCLUDED
+#define ETNA_PIPELINE_STATE_CAPTURE_HPP_INCLUDED
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <variant>
+#include <vector>
+
+#include <etna/GraphicsPipeline.hpp>
+#include <etna/ComputePipeline.hpp>
+#include <etna/RaytracePipeline.hpp>
+
+
+namespace etna
+{
+
+// A pipeline as it was requested from PipelineManager, enough to create it again
+struct CapturedPipeline
+{
+  std::string programName;
+  std::variant<
+    GraphicsPipeline::CreateInfo,
+    ComputePipeline::CreateInfo,
+    RaytracePipeline::CreateInfo>
+    info;
+};
+
+/**
+ * Set of every distinct pipeline that was created, persisted across launches.
+ * Pipelines are recorded by program name rather than id, as ids depend on the
+ * order in which programs are loaded. New records are merged into what was
+ * loaded, so the file accumulates pipelines from all the runs.
+ */
+class PipelineStateCapture
+{
+public:
+  // Loads the previous captures, silently starting from scratch if the file is
+  // missing, broken or was written by an incompatible version of etna
+  explicit PipelineStateCapture(std::filesystem::path capture_path);
+
+  void record(std::string_view program_name, const GraphicsPipeline::CreateInfo& info);
+  void record(std::string_view program_name, const ComputePipeline::CreateInfo& info);
+  void record(std::string_view program_name, const RaytracePipeline::CreateInfo& info);
+
+  // Decodes everything captured so far, in no particular order. Broken records
+  // are dropped.
+  std::vector<CapturedPipeline> getPipelines();
+  // Drops a record that can't be created anymore, e.g. because its shaders changed
+  void forget(const CapturedPipeline& pipeline);
+
+  // Writes the captures back to disk if anything new was recorded
+  void save();
+
+private:
+  void insert(std::string entry);
+
+private:
+  std::filesystem::path path;
+  // Serialized CapturedPipelines, which are canonical, so equal pipelines are
+  // only stored once
+  std::unordered_set<std::string> entries;
+  bool dirty = false;
+};
+
+} // namespace etna
+
+#endif // ETNA_PIPELINE_STATE_CAPTURE_HPP_INCLUDED
@@ -0,0 +1,23 @@
+#include <etna/RaytracePipeline.hpp>
+
+#include <etna/PipelineManager.hpp>
+
+
+namespace etna
+{
+
+RaytracePipeline::ShaderBindingTable RaytracePipeline::getShaderBindingTable(
+  uint32_t raygen_index) const
+{
+  return getOwner()->getShaderBindingTable(getId(), raygen_index);
+}
+
+void RaytracePipeline::traceRays(
+  vk::CommandBuffer cmd, uint32_t width, uint32_t height, uint32_t depth, uint32_t raygen_index)
+  const
+{
+  const auto table = getShaderBindingTable(raygen_index);
+  cmd.traceRaysKHR(table.raygen, table.miss, table.hit, table.callable, width, height, depth);
+}
+
+} // namespace etna
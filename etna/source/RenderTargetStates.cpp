@@ -8,6 +8,8 @@ namespace etna
 {
 
 bool RenderTargetState::inScope = false;
+RenderTargetFormats RenderTargetState::currentFormats = {};
+bool RenderTargetState::currentFormatsDefined = false;
 
 RenderTargetState::RenderTargetState(
   vk::CommandBuffer cmd_buff,
@@ -32,6 +34,41 @@ RenderTargetState::RenderTargetState(
 
   commandBuffer.setViewport(0, {viewport});
   commandBuffer.setScissor(0, {rect});
+  // Shader objects also need the counts, which pipelines bake in
+  if (get_context().isDeviceExtensionEnabled(vk::EXTShaderObjectExtensionName))
+  {
+    commandBuffer.setViewportWithCount({viewport});
+    commandBuffer.setScissorWithCount({rect});
+  }
+
+  // Attachments without a view are not rendered to, so their formats and
+  // sample counts don't matter. Rendering without any attachments is single-sampled.
+  currentFormats = RenderTargetFormats{
+    .depthAttachmentFormat =
+      depth_attachment.view ? depth_attachment.format : vk::Format::eUndefined,
+    .stencilAttachmentFormat =
+      stencil_attachment.view ? stencil_attachment.format : vk::Format::eUndefined,
+  };
+  currentFormatsDefined = true;
+  const AttachmentParams* firstAttachment = nullptr;
+  auto addAttachment = [&](const AttachmentParams& attachment) {
+    if (!attachment.view)
+      return;
+    if (firstAttachment == nullptr)
+      firstAttachment = &attachment;
+    if (attachment.format == vk::Format::eUndefined)
+      currentFormatsDefined = false;
+  };
+  for (const auto& attachment : color_attachments)
+  {
+    addAttachment(attachment);
+    currentFormats.colorAttachmentFormats.push_back(
+      attachment.view ? attachment.format : vk::Format::eUndefined);
+  }
+  addAttachment(depth_attachment);
+  addAttachment(stencil_attachment);
+  if (firstAttachment != nullptr)
+    currentFormats.samples = firstAttachment->samples;
 
   std::vector<vk::RenderingAttachmentInfo> attachmentInfos(color_attachments.size());
   for (uint32_t i = 0; i < color_attachments.size(); ++i)
@@ -159,4 +196,13 @@ RenderTargetState::~RenderTargetState()
   inScope = false;
 }
 
+const RenderTargetFormats& RenderTargetState::getCurrentFormats()
+{
+  ETNA_VERIFYF(inScope, "Formats are only known inside of a RenderTargetState scope!");
+  ETNA_VERIFYF(
+    currentFormatsDefined,
+    "Format agnostic pipelines require AttachmentParams::format of every attachment!");
+  return currentFormats;
+}
+
 } // namespace etna
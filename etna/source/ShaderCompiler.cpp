@@ -0,0 +1,463 @@
+#include "ShaderCompiler.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <string_view>
+
+#include <fmt/std.h>
+#include <tracy/Tracy.hpp>
+
+#if ETNA_SHADER_COMPILER
+#include <shaderc/shaderc.hpp>
+#endif
+
+#include <etna/Assert.hpp>
+#include "BinaryIo.hpp"
+
+
+namespace etna
+{
+
+static constexpr uint32_t COMPILED_SHADER_CACHE_MAGIC = 0x43535445; // "ETSC"
+// Bump this whenever compilation options or the cache format change
+static constexpr uint32_t COMPILED_SHADER_CACHE_VERSION = 2;
+
+struct StageExtension
+{
+  std::string_view extension;
+#if ETNA_SHADER_COMPILER
+  shaderc_shader_kind kind;
+#endif
+};
+
+#if ETNA_SHADER_COMPILER
+#define ETNA_STAGE_EXTENSION(ext, kind)                                                            \
+  StageExtension                                                                                   \
+  {                                                                                                \
+    ext, kind                                                                                      \
+  }
+#else
+#define ETNA_STAGE_EXTENSION(ext, kind)                                                            \
+  StageExtension                                                                                   \
+  {                                                                                                \
+    ext                                                                                            \
+  }
+#endif
+
+static constexpr std::array STAGE_EXTENSIONS{
+  ETNA_STAGE_EXTENSION(".vert", shaderc_vertex_shader),
+  ETNA_STAGE_EXTENSION(".tesc", shaderc_tess_control_shader),
+  ETNA_STAGE_EXTENSION(".tese", shaderc_tess_evaluation_shader),
+  ETNA_STAGE_EXTENSION(".geom", shaderc_geometry_shader),
+  ETNA_STAGE_EXTENSION(".frag", shaderc_fragment_shader),
+  ETNA_STAGE_EXTENSION(".comp", shaderc_compute_shader),
+  ETNA_STAGE_EXTENSION(".task", shaderc_task_shader),
+  ETNA_STAGE_EXTENSION(".mesh", shaderc_mesh_shader),
+  ETNA_STAGE_EXTENSION(".rgen", shaderc_raygen_shader),
+  ETNA_STAGE_EXTENSION(".rint", shaderc_intersection_shader),
+  ETNA_STAGE_EXTENSION(".rahit", shaderc_anyhit_shader),
+  ETNA_STAGE_EXTENSION(".rchit", shaderc_closesthit_shader),
+  ETNA_STAGE_EXTENSION(".rmiss", shaderc_miss_shader),
+  ETNA_STAGE_EXTENSION(".rcall", shaderc_callable_shader),
+};
+
+#undef ETNA_STAGE_EXTENSION
+
+struct SourceKind
+{
+  const StageExtension* stage;
+  bool hlsl;
+};
+
+// `foo.frag` and `foo.frag.glsl` are GLSL, `foo.frag.hlsl` is HLSL
+static std::optional<SourceKind> get_source_kind(const std::filesystem::path& path)
+{
+  auto extension = path.extension().string();
+  const bool hlsl = extension == ".hlsl";
+  if (hlsl || extension == ".glsl")
+    extension = path.stem().extension().string();
+
+  auto it = std::find_if(STAGE_EXTENSIONS.begin(), STAGE_EXTENSIONS.end(), [&](const auto& st) {
+    return st.extension == extension;
+  });
+  if (it == STAGE_EXTENSIONS.end())
+    return std::nullopt;
+  return SourceKind{&*it, hlsl};
+}
+
+#if ETNA_SHADER_COMPILER
+
+struct ShaderCompiler::Impl
+{
+  shaderc::Compiler compiler;
+};
+
+namespace
+{
+
+// Resolves includes relative to the including file first and to the include
+// directories second, and remembers every file it has read.
+class Includer final : public shaderc::CompileOptions::IncluderInterface
+{
+public:
+  Includer(
+    std::span<std::filesystem::path const> include_directories,
+    std::vector<std::filesystem::path>& out_dependencies)
+    : includeDirectories{include_directories}
+    , dependencies{out_dependencies}
+  {
+  }
+
+  shaderc_include_result* GetInclude(
+    const char* requested_source,
+    shaderc_include_type type,
+    const char* requesting_source,
+    size_t /*include_depth*/) override
+  {
+    auto* data = new IncludeData{};
+    data->result.user_data = data;
+
+    std::vector<std::filesystem::path> candidates;
+    if (type == shaderc_include_type_relative)
+      candidates.push_back(std::filesystem::path{requesting_source}.parent_path());
+    candidates.insert(candidates.end(), includeDirectories.begin(), includeDirectories.end());
+
+    for (const auto& dir : candidates)
+    {
+      const auto path = (dir / requested_source).lexically_normal();
+      auto contents = read_binary_file(path);
+      if (!contents.has_value())
+        continue;
+
+      data->name = path.string();
+      data->content.assign(reinterpret_cast<const char*>(contents->data()), contents->size());
+      dependencies.push_back(path);
+      break;
+    }
+
+    // An empty name tells shaderc that the include failed, with the content being the error
+    if (data->name.empty())
+      data->content = fmt::format("Can not find include file {}", requested_source);
+
+    data->result.source_name = data->name.c_str();
+    data->result.source_name_length = data->name.size();
+    data->result.content = data->content.c_str();
+    data->result.content_length = data->content.size();
+    return &data->result;
+  }
+
+  void ReleaseInclude(shaderc_include_result* data) override
+  {
+    delete static_cast<IncludeData*>(data->user_data);
+  }
+
+private:
+  struct IncludeData
+  {
+    std::string name;
+    std::string content;
+    shaderc_include_result result{};
+  };
+
+  std::span<std::filesystem::path const> includeDirectories;
+  std::vector<std::filesystem::path>& dependencies;
+};
+
+} // namespace
+
+#else
+
+struct ShaderCompiler::Impl
+{
+};
+
+#endif
+
+static std::filesystem::path normalized_absolute(const std::filesystem::path& path)
+{
+  std::error_code ec;
+  auto result = std::filesystem::absolute(path, ec);
+  return (ec ? path : result).lexically_normal();
+}
+
+ShaderCompiler::ShaderCompiler(
+  std::filesystem::path cache_directory,
+  std::uintmax_t cache_size_limit,
+  std::filesystem::path source_root,
+  std::vector<std::filesystem::path> include_directories)
+  : cacheDirectory{std::move(cache_directory)}
+  , cacheSizeLimit{cache_size_limit}
+  , includeDirectories{std::move(include_directories)}
+  , impl{std::make_unique<Impl>()}
+{
+  if (source_root.empty())
+    source_root = normalized_absolute(cacheDirectory).parent_path();
+  sourceRoot = normalized_absolute(source_root);
+
+  for (const auto& dir : includeDirectories)
+    includeDirectoriesKey.append(makeCachedPath(dir)).append(1, '\0');
+}
+
+ShaderCompiler::~ShaderCompiler() = default;
+
+bool ShaderCompiler::isSourceFile(const std::filesystem::path& path)
+{
+  return get_source_kind(path).has_value();
+}
+
+// Paths are stored relative to the source root, so that a cache built in one
+// place keeps working after being moved together with the shaders.
+std::string ShaderCompiler::makeCachedPath(const std::filesystem::path& path) const
+{
+  const auto absolute = normalized_absolute(path);
+  const auto relative = absolute.lexically_relative(sourceRoot);
+  return (relative.empty() ? absolute : relative).generic_string();
+}
+
+std::filesystem::path ShaderCompiler::resolveCachedPath(const std::string& path) const
+{
+  const std::filesystem::path result{path};
+  return result.is_absolute() ? result : (sourceRoot / result).lexically_normal();
+}
+
+std::optional<CompiledShader> ShaderCompiler::findCached(const std::filesystem::path& entry) const
+{
+  const auto data = read_binary_file(entry);
+  if (!data.has_value())
+    return std::nullopt;
+
+  BinaryReader reader{*data};
+
+  uint32_t magic = 0;
+  uint32_t version = 0;
+  uint32_t dependencyCount = 0;
+  if (
+    !reader.read(magic) || magic != COMPILED_SHADER_CACHE_MAGIC || !reader.read(version) ||
+    version != COMPILED_SHADER_CACHE_VERSION || !reader.read(dependencyCount))
+    return std::nullopt;
+
+  // The entry is only valid if none of the includes changed since it was written
+  CompiledShader result;
+  for (uint32_t i = 0; i < dependencyCount; ++i)
+  {
+    std::string path;
+    uint64_t hash = 0;
+    if (!reader.readString(path) || !reader.read(hash))
+      return std::nullopt;
+
+    auto dependency = resolveCachedPath(path);
+    const auto contents = read_binary_file(dependency);
+    if (!contents.has_value() || content_hash(*contents) != hash)
+      return std::nullopt;
+    result.dependencies.push_back(std::move(dependency));
+  }
+
+  std::span<std::byte const> spirv;
+  if (!reader.readBytes(spirv) || spirv.size() % sizeof(uint32_t) != 0)
+    return std::nullopt;
+
+  result.spirv.resize(spirv.size() / sizeof(uint32_t));
+  std::memcpy(result.spirv.data(), spirv.data(), spirv.size());
+  return result;
+}
+
+bool ShaderCompiler::storeCached(
+  const std::filesystem::path& entry, const CompiledShader& shader) const
+{
+  BinaryWriter writer;
+  writer.write(COMPILED_SHADER_CACHE_MAGIC);
+  writer.write(COMPILED_SHADER_CACHE_VERSION);
+  writer.write(static_cast<uint32_t>(shader.dependencies.size()));
+  for (const auto& path : shader.dependencies)
+  {
+    // The compiler has just read the file, so this should not fail
+    const auto contents = read_binary_file(path);
+    writer.writeString(makeCachedPath(path));
+    writer.write(contents.has_value() ? content_hash(*contents) : 0);
+  }
+  writer.writeBytes(std::as_bytes(std::span{shader.spirv}));
+
+  if (!write_binary_file_atomically(entry, writer.getData()))
+  {
+    spdlog::warn("Failed to write compiled shader cache entry {}", entry);
+    return false;
+  }
+  return true;
+}
+
+void ShaderCompiler::replaceCurrentEntry(
+  const std::filesystem::path& source,
+  std::span<std::string const> defines,
+  const std::filesystem::path& entry) const
+{
+  std::string permutation = source.generic_string();
+  for (const auto& define : defines)
+    permutation.append(1, '\0').append(define);
+
+  // The previous version of a reloaded permutation is of no use anymore. It is
+  // only dropped once the new one is in the cache, so that a failed compile
+  // followed by reverting the change still hits the cache.
+  std::unique_lock lock{entriesMutex};
+  auto& current = currentEntries[std::move(permutation)];
+  if (!current.empty() && current != entry)
+  {
+    std::error_code ec;
+    std::filesystem::remove(current, ec);
+  }
+  current = entry;
+}
+
+void ShaderCompiler::trimCache() const
+{
+  if (cacheDirectory.empty())
+    return;
+
+  ZoneScoped;
+
+  struct Entry
+  {
+    std::filesystem::path path;
+    std::filesystem::file_time_type lastUse;
+    std::uintmax_t size;
+  };
+  std::vector<Entry> entries;
+  std::uintmax_t totalSize = 0;
+
+  std::error_code ec;
+  for (const auto& file : std::filesystem::directory_iterator{cacheDirectory, ec})
+  {
+    if (file.path().extension() != ".spvc")
+      continue;
+    const auto size = file.file_size(ec);
+    const auto lastUse = file.last_write_time(ec);
+    if (ec)
+      continue;
+    entries.push_back(Entry{file.path(), lastUse, size});
+    totalSize += size;
+  }
+  if (totalSize <= cacheSizeLimit)
+    return;
+
+  std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+    return a.lastUse < b.lastUse;
+  });
+  std::size_t removed = 0;
+  for (; removed < entries.size() && totalSize > cacheSizeLimit; ++removed)
+  {
+    std::filesystem::remove(entries[removed].path, ec);
+    totalSize -= entries[removed].size;
+  }
+  spdlog::info("Removed {} least recently used entries from {}", removed, cacheDirectory);
+}
+
+std::optional<CompiledShader> ShaderCompiler::compile(
+  const std::filesystem::path& source, std::span<std::string const> defines) const
+{
+  ZoneScoped;
+
+  const auto kind = get_source_kind(source);
+  ETNA_VERIFYF(kind.has_value(), "Can not deduce shader stage from file name {}", source);
+
+  const auto contents = read_binary_file(source);
+  if (!contents.has_value())
+  {
+    spdlog::error("Failed to read shader source {}", source);
+    return std::nullopt;
+  }
+
+  std::error_code ec;
+  const auto sourcePath = normalized_absolute(source);
+
+  // Everything that affects the result, except for includes which are checked separately
+  uint64_t key = content_hash(std::as_bytes(std::span{&COMPILED_SHADER_CACHE_VERSION, 1}));
+  auto mix = [&key](std::string_view str) {
+    const uint64_t size = str.size();
+    key = content_hash(std::as_bytes(std::span{&size, 1}), key);
+    key = content_hash(std::as_bytes(std::span{str}), key);
+  };
+  mix(makeCachedPath(sourcePath));
+  mix({reinterpret_cast<const char*>(contents->data()), contents->size()});
+  mix(includeDirectoriesKey);
+  for (const auto& define : defines)
+    mix(define);
+#if ETNA_DEBUG
+  mix("debug");
+#endif
+
+  std::filesystem::path cacheEntry;
+  if (!cacheDirectory.empty())
+  {
+    cacheEntry = cacheDirectory / fmt::format("{:016x}.spvc", key);
+    if (auto cached = findCached(cacheEntry); cached.has_value())
+    {
+      // Modification times order entries by last use for trimCache
+      std::filesystem::last_write_time(
+        cacheEntry, std::filesystem::file_time_type::clock::now(), ec);
+      replaceCurrentEntry(sourcePath, defines, cacheEntry);
+      return cached;
+    }
+  }
+
+#if ETNA_SHADER_COMPILER
+  CompiledShader result;
+
+  shaderc::CompileOptions options;
+  options.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_3);
+  options.SetSourceLanguage(
+    kind->hlsl ? shaderc_source_language_hlsl : shaderc_source_language_glsl);
+#if ETNA_DEBUG
+  options.SetGenerateDebugInfo();
+  options.SetOptimizationLevel(shaderc_optimization_level_zero);
+#else
+  options.SetOptimizationLevel(shaderc_optimization_level_performance);
+#endif
+  for (const auto& define : defines)
+  {
+    const auto eq = define.find('=');
+    if (eq == std::string::npos)
+      options.AddMacroDefinition(define);
+    else
+      options.AddMacroDefinition(define.substr(0, eq), define.substr(eq + 1));
+  }
+  options.SetIncluder(std::make_unique<Includer>(includeDirectories, result.dependencies));
+
+  const auto sourceName = sourcePath.string();
+  const auto compiled = impl->compiler.CompileGlslToSpv(
+    reinterpret_cast<const char*>(contents->data()),
+    contents->size(),
+    kind->stage->kind,
+    sourceName.c_str(),
+    "main",
+    options);
+
+  if (compiled.GetCompilationStatus() != shaderc_compilation_status_success)
+  {
+    spdlog::error("Failed to compile shader {}:\n{}", source, compiled.GetErrorMessage());
+    return std::nullopt;
+  }
+  if (compiled.GetNumWarnings() > 0)
+    spdlog::warn("Shader {} compiled with warnings:\n{}", source, compiled.GetErrorMessage());
+
+  result.spirv.assign(compiled.cbegin(), compiled.cend());
+
+  std::sort(result.dependencies.begin(), result.dependencies.end());
+  result.dependencies.erase(
+    std::unique(result.dependencies.begin(), result.dependencies.end()),
+    result.dependencies.end());
+
+  if (!cacheEntry.empty() && storeCached(cacheEntry, result))
+    replaceCurrentEntry(sourcePath, defines, cacheEntry);
+
+  return result;
+#else
+  // Edited sources always miss the cache, the caller decides whether that is fatal
+  spdlog::error(
+    "Can not compile {}: etna was built without ETNA_ENABLE_SHADER_COMPILER and the "
+    "compiled shader cache does not contain it",
+    source);
+  return std::nullopt;
+#endif
+}
+
+} // namespace etna
@@ -0,0 +1,96 @@
+#pragma once
+#ifndef ETNA_SHADER_COMPILER_HPP_INCLUDED
+#define ETNA_SHADER_COMPILER_HPP_INCLUDED
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace etna
+{
+
+struct CompiledShader
+{
+  std::vector<uint32_t> spirv;
+  // Every file that was included while compiling, for hot reloading
+  std::vector<std::filesystem::path> dependencies;
+};
+
+/**
+ * Compiles GLSL and HLSL sources into SPIR-V at runtime. The stage is deduced
+ * from the extension: `.vert`, `.frag`, `.comp` etc. for GLSL and `.vert.hlsl`,
+ * `.frag.hlsl` etc. for HLSL, whose entry point is always `main`.
+ *
+ * Results are cached on disk keyed by the contents of the source, all of its
+ * includes, the include directories and the defines, so only permutations
+ * that actually changed get recompiled on the next launch. Thread-safe,
+ * permutations are compiled on worker threads in parallel. Entries replaced by
+ * a hot reload are deleted right away, and the least recently used ones are
+ * deleted by trimCache.
+ *
+ * Only available when etna is built with ETNA_ENABLE_SHADER_COMPILER,
+ * otherwise only cached results can be loaded and compiling anything else fails.
+ */
+class ShaderCompiler
+{
+public:
+  // An empty cache directory disables the cache. Paths are stored relative to
+  // the source root, which defaults to the parent of the cache directory.
+  ShaderCompiler(
+    std::filesystem::path cache_directory,
+    std::uintmax_t cache_size_limit,
+    std::filesystem::path source_root,
+    std::vector<std::filesystem::path> include_directories);
+  ~ShaderCompiler();
+
+  ShaderCompiler(const ShaderCompiler&) = delete;
+  ShaderCompiler& operator=(const ShaderCompiler&) = delete;
+
+  // Whether the file is a shader source rather than precompiled SPIR-V
+  static bool isSourceFile(const std::filesystem::path& path);
+
+  // Defines are either "NAME" or "NAME=VALUE". Returns nullopt and logs the
+  // errors if the source does not compile.
+  std::optional<CompiledShader> compile(
+    const std::filesystem::path& source, std::span<std::string const> defines) const;
+
+  // Deletes least recently used entries until the cache fits into the size limit
+  void trimCache() const;
+
+private:
+  std::optional<CompiledShader> findCached(const std::filesystem::path& entry) const;
+  bool storeCached(const std::filesystem::path& entry, const CompiledShader& shader) const;
+  std::string makeCachedPath(const std::filesystem::path& path) const;
+  std::filesystem::path resolveCachedPath(const std::string& path) const;
+  void replaceCurrentEntry(
+    const std::filesystem::path& source,
+    std::span<std::string const> defines,
+    const std::filesystem::path& entry) const;
+
+private:
+  std::filesystem::path cacheDirectory;
+  std::uintmax_t cacheSizeLimit;
+  std::filesystem::path sourceRoot;
+  std::vector<std::filesystem::path> includeDirectories;
+  // Include directories relative to the source root, as part of every key
+  std::string includeDirectoriesKey;
+
+  // Entry used by every permutation during this launch, keyed by source and defines
+  mutable std::mutex entriesMutex;
+  mutable std::unordered_map<std::string, std::filesystem::path> currentEntries;
+
+  // Opaque shaderc compiler, which is safe to use from multiple threads
+  struct Impl;
+  std::unique_ptr<Impl> impl;
+};
+
+} // namespace etna
+
+#endif // ETNA_SHADER_COMPILER_HPP_INCLUDED
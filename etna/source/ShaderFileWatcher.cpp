@@ -0,0 +1,142 @@
+#include "ShaderFileWatcher.hpp"
+
+#include <algorithm>
+#include <fmt/std.h>
+
+#include <etna/Assert.hpp>
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+
+namespace etna
+{
+
+std::string ShaderFileWatcher::normalize(const std::filesystem::path& path)
+{
+  std::error_code ec;
+  auto result = std::filesystem::weakly_canonical(path, ec);
+  if (ec)
+    result = std::filesystem::absolute(path, ec).lexically_normal();
+  return result.generic_string();
+}
+
+#if defined(__linux__)
+
+ShaderFileWatcher::ShaderFileWatcher()
+  : inotifyFd{inotify_init1(IN_NONBLOCK | IN_CLOEXEC)}
+{
+  if (inotifyFd < 0)
+    spdlog::warn("Failed to initialize inotify, shader hot reload will not work!");
+}
+
+ShaderFileWatcher::~ShaderFileWatcher()
+{
+  if (inotifyFd >= 0)
+    close(inotifyFd);
+}
+
+void ShaderFileWatcher::watch(const std::filesystem::path& file)
+{
+  const auto normalized = normalize(file);
+  auto& originals = files[normalized];
+  if (std::find(originals.begin(), originals.end(), file) == originals.end())
+    originals.push_back(file);
+
+  if (inotifyFd < 0)
+    return;
+
+  // Editors and compilers often write a new file and rename it over the
+  // old one, so we watch directories instead of the files themselves. Only
+  // finished writes are reported, a file that was just created is still empty.
+  const auto dir = std::filesystem::path{normalized}.parent_path();
+  const int wd = inotify_add_watch(inotifyFd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+  if (wd < 0)
+  {
+    spdlog::warn("Failed to watch directory {} for shader changes", dir);
+    return;
+  }
+  // inotify returns the same descriptor for the same directory
+  watchedDirs[wd] = dir;
+}
+
+std::vector<std::filesystem::path> ShaderFileWatcher::poll()
+{
+  std::vector<std::filesystem::path> result;
+  if (inotifyFd < 0)
+    return result;
+
+  alignas(inotify_event) char buffer[4096];
+  for (;;)
+  {
+    const ssize_t len = read(inotifyFd, buffer, sizeof(buffer));
+    if (len <= 0)
+      break;
+
+    for (ssize_t offset = 0; offset < len;)
+    {
+      const auto* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+      offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+
+      auto dirIt = watchedDirs.find(event->wd);
+      if (event->len == 0 || dirIt == watchedDirs.end())
+        continue;
+
+      const auto changed = (dirIt->second / event->name).generic_string();
+      if (auto it = files.find(changed); it != files.end())
+        for (const auto& original : it->second)
+          if (std::find(result.begin(), result.end(), original) == result.end())
+            result.push_back(original);
+    }
+  }
+
+  return result;
+}
+
+#else
+
+ShaderFileWatcher::ShaderFileWatcher() = default;
+ShaderFileWatcher::~ShaderFileWatcher() = default;
+
+void ShaderFileWatcher::watch(const std::filesystem::path& file)
+{
+  const auto normalized = normalize(file);
+  auto& originals = files[normalized];
+  if (std::find(originals.begin(), originals.end(), file) == originals.end())
+    originals.push_back(file);
+
+  std::error_code ec;
+  writeTimes[normalized] = std::filesystem::last_write_time(normalized, ec);
+}
+
+std::vector<std::filesystem::path> ShaderFileWatcher::poll()
+{
+  std::vector<std::filesystem::path> result;
+
+  // Hitting the file system every frame is wasteful, and nobody edits shaders that fast
+  constexpr auto POLL_INTERVAL = std::chrono::milliseconds{250};
+  const auto now = std::chrono::steady_clock::now();
+  if (now - lastPoll < POLL_INTERVAL)
+    return result;
+  lastPoll = now;
+
+  for (auto& [normalized, time] : writeTimes)
+  {
+    std::error_code ec;
+    const auto newTime = std::filesystem::last_write_time(normalized, ec);
+    if (ec || newTime == time)
+      continue;
+    time = newTime;
+    const auto& originals = files[normalized];
+    result.insert(result.end(), originals.begin(), originals.end());
+  }
+
+  return result;
+}
+
+#endif
+
+} // namespace etna
@@ -0,0 +1,51 @@
+#pragma once
+#ifndef ETNA_SHADER_FILE_WATCHER_HPP_INCLUDED
+#define ETNA_SHADER_FILE_WATCHER_HPP_INCLUDED
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace etna
+{
+
+/**
+ * Tells which of the watched files were modified since the last poll.
+ * On Linux this is based on inotify and is basically free when nothing
+ * changes, elsewhere we fall back to periodically checking modification times.
+ */
+class ShaderFileWatcher
+{
+public:
+  ShaderFileWatcher();
+  ~ShaderFileWatcher();
+
+  ShaderFileWatcher(const ShaderFileWatcher&) = delete;
+  ShaderFileWatcher& operator=(const ShaderFileWatcher&) = delete;
+
+  void watch(const std::filesystem::path& file);
+
+  // Returns the paths exactly as they were passed to watch()
+  std::vector<std::filesystem::path> poll();
+
+private:
+  static std::string normalize(const std::filesystem::path& path);
+
+  // normalized path -> paths passed to watch()
+  std::unordered_map<std::string, std::vector<std::filesystem::path>> files;
+
+#if defined(__linux__)
+  int inotifyFd = -1;
+  std::unordered_map<int, std::filesystem::path> watchedDirs;
+#else
+  std::unordered_map<std::string, std::filesystem::file_time_type> writeTimes;
+  std::chrono::steady_clock::time_point lastPoll{};
+#endif
+};
+
+} // namespace etna
+
+#endif // ETNA_SHADER_FILE_WATCHER_HPP_INCLUDED
@@ -0,0 +1,158 @@
+#include <etna/ShaderObjects.hpp>
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+#include <etna/DynamicState.hpp>
+#include <etna/GlobalContext.hpp>
+#include <etna/ShaderProgram.hpp>
+
+
+namespace etna
+{
+
+static void set_rasterization_state(
+  vk::CommandBuffer cmd, const GraphicsPipeline::CreateInfo& state)
+{
+  const auto& raster = state.rasterizationConfig;
+  cmd.setRasterizerDiscardEnable(raster.rasterizerDiscardEnable);
+  cmd.setDepthClampEnableEXT(raster.depthClampEnable);
+  cmd.setPolygonModeEXT(raster.polygonMode);
+  cmd.setCullMode(raster.cullMode);
+  cmd.setFrontFace(raster.frontFace);
+  cmd.setLineWidth(raster.lineWidth);
+  cmd.setDepthBiasEnable(raster.depthBiasEnable);
+  if (raster.depthBiasEnable)
+    cmd.setDepthBias(
+      raster.depthBiasConstantFactor, raster.depthBiasClamp, raster.depthBiasSlopeFactor);
+
+  const auto& multisample = state.multisampleConfig;
+  // A null mask means that all samples are enabled
+  static constexpr std::array<vk::SampleMask, 2> ALL_SAMPLES{~0u, ~0u};
+  cmd.setRasterizationSamplesEXT(multisample.rasterizationSamples);
+  cmd.setSampleMaskEXT(
+    multisample.rasterizationSamples,
+    multisample.pSampleMask != nullptr ? multisample.pSampleMask : ALL_SAMPLES.data());
+  cmd.setAlphaToCoverageEnableEXT(multisample.alphaToCoverageEnable);
+  cmd.setAlphaToOneEnableEXT(multisample.alphaToOneEnable);
+}
+
+static void set_depth_stencil_state(
+  vk::CommandBuffer cmd, const vk::PipelineDepthStencilStateCreateInfo& depth)
+{
+  cmd.setDepthTestEnable(depth.depthTestEnable);
+  cmd.setDepthWriteEnable(depth.depthWriteEnable);
+  cmd.setDepthCompareOp(depth.depthCompareOp);
+  cmd.setDepthBoundsTestEnable(depth.depthBoundsTestEnable);
+  if (depth.depthBoundsTestEnable)
+    cmd.setDepthBounds(depth.minDepthBounds, depth.maxDepthBounds);
+
+  cmd.setStencilTestEnable(depth.stencilTestEnable);
+  if (!depth.stencilTestEnable)
+    return;
+
+  auto setFace = [cmd](vk::StencilFaceFlags face, const vk::StencilOpState& op) {
+    cmd.setStencilOp(face, op.failOp, op.passOp, op.depthFailOp, op.compareOp);
+    cmd.setStencilCompareMask(face, op.compareMask);
+    cmd.setStencilWriteMask(face, op.writeMask);
+    cmd.setStencilReference(face, op.reference);
+  };
+  setFace(vk::StencilFaceFlagBits::eFront, depth.front);
+  setFace(vk::StencilFaceFlagBits::eBack, depth.back);
+}
+
+static void set_blend_state(
+  vk::CommandBuffer cmd, const GraphicsPipeline::CreateInfo::Blending& blending)
+{
+  cmd.setLogicOpEnableEXT(blending.logicOpEnable);
+  if (blending.logicOpEnable)
+    cmd.setLogicOpEXT(blending.logicOp);
+  cmd.setBlendConstants(blending.blendConstants.data());
+
+  if (blending.attachments.empty())
+    return;
+
+  std::vector<vk::Bool32> enables;
+  std::vector<vk::ColorBlendEquationEXT> equations;
+  std::vector<vk::ColorComponentFlags> writeMasks;
+  for (const auto& attachment : blending.attachments)
+  {
+    enables.push_back(attachment.blendEnable);
+    equations.push_back(vk::ColorBlendEquationEXT{
+      .srcColorBlendFactor = attachment.srcColorBlendFactor,
+      .dstColorBlendFactor = attachment.dstColorBlendFactor,
+      .colorBlendOp = attachment.colorBlendOp,
+      .srcAlphaBlendFactor = attachment.srcAlphaBlendFactor,
+      .dstAlphaBlendFactor = attachment.dstAlphaBlendFactor,
+      .alphaBlendOp = attachment.alphaBlendOp,
+    });
+    writeMasks.push_back(attachment.colorWriteMask);
+  }
+  cmd.setColorBlendEnableEXT(0, enables);
+  cmd.setColorBlendEquationEXT(0, equations);
+  cmd.setColorWriteMaskEXT(0, writeMasks);
+}
+
+void bind_shader_objects(
+  vk::CommandBuffer cmd, ShaderProgramId program, const GraphicsPipeline::CreateInfo& state)
+{
+  auto& context = get_context();
+  const auto& objects =
+    context.getShaderManager().getShaderObjects(program, state.specializationConstants);
+
+  // Every graphics stage the device supports must have something bound, even if it is null
+  std::vector<vk::ShaderStageFlagBits> stages{
+    vk::ShaderStageFlagBits::eVertex,
+    vk::ShaderStageFlagBits::eTessellationControl,
+    vk::ShaderStageFlagBits::eTessellationEvaluation,
+    vk::ShaderStageFlagBits::eGeometry,
+    vk::ShaderStageFlagBits::eFragment,
+  };
+  if (context.isDeviceExtensionEnabled(vk::EXTMeshShaderExtensionName))
+  {
+    stages.push_back(vk::ShaderStageFlagBits::eTaskEXT);
+    stages.push_back(vk::ShaderStageFlagBits::eMeshEXT);
+  }
+
+  std::vector<vk::ShaderEXT> shaders(stages.size());
+  bool tessellated = false;
+  for (std::size_t i = 0; i < objects.stages.size(); ++i)
+  {
+    const auto stage = objects.stages[i];
+    ETNA_VERIFYF(
+      stage != vk::ShaderStageFlagBits::eCompute,
+      "Program {} is a compute program and can not be used for drawing",
+      context.getShaderManager().getProgramInfo(program).getName());
+    tessellated |= stage == vk::ShaderStageFlagBits::eTessellationControl;
+
+    const auto slot = std::find(stages.begin(), stages.end(), stage) - stages.begin();
+    shaders[slot] = objects.shaders[i];
+  }
+  cmd.bindShadersEXT(stages, shaders);
+
+  set_vertex_input(cmd, state.vertexShaderInput);
+  cmd.setPrimitiveTopology(state.inputAssemblyConfig.topology);
+  cmd.setPrimitiveRestartEnable(state.inputAssemblyConfig.primitiveRestartEnable);
+  if (tessellated)
+    cmd.setPatchControlPointsEXT(state.tessellationConfig.patchControlPoints);
+
+  set_rasterization_state(cmd, state);
+  set_depth_stencil_state(cmd, state.depthConfig);
+  set_blend_state(cmd, state.blendingConfig);
+}
+
+void bind_shader_objects(
+  vk::CommandBuffer cmd, ShaderProgramId program, const ComputePipeline::CreateInfo& info)
+{
+  auto& manager = get_context().getShaderManager();
+  const auto& objects = manager.getShaderObjects(program, info.specializationConstants);
+  ETNA_VERIFYF(
+    objects.stages.size() == 1 && objects.stages.front() == vk::ShaderStageFlagBits::eCompute,
+    "Program {} is not a compute program",
+    manager.getProgramInfo(program).getName());
+
+  cmd.bindShadersEXT(objects.stages, objects.shaders);
+}
+
+} // namespace etna
@@ -0,0 +1,230 @@
+#include "ShaderPack.hpp"
+
+#include <algorithm>
+#include <unordered_set>
+
+#include <fmt/std.h>
+#include <tracy/Tracy.hpp>
+
+#include "BinaryIo.hpp"
+#include "SpirvReflection.hpp"
+
+
+namespace etna
+{
+
+static constexpr uint32_t SHADER_PACK_MAGIC = 0x50535445; // "ETSP"
+static constexpr uint32_t SHADER_PACK_VERSION = 1;
+static constexpr std::size_t SHADER_PACK_BLOB_ALIGNMENT = 8;
+
+static std::size_t align_pack_offset(std::size_t offset)
+{
+  return (offset + SHADER_PACK_BLOB_ALIGNMENT - 1) & ~(SHADER_PACK_BLOB_ALIGNMENT - 1);
+}
+
+static std::filesystem::path normalized_absolute(const std::filesystem::path& path)
+{
+  std::error_code ec;
+  auto result = std::filesystem::absolute(path, ec);
+  return (ec ? path : result).lexically_normal();
+}
+
+// Paths are stored relative to the root, so that packs can be moved around
+// together with the application.
+static std::string make_pack_key(
+  const std::filesystem::path& path, const std::filesystem::path& normalized_root)
+{
+  const auto absolute = normalized_absolute(path);
+  const auto relative = absolute.lexically_relative(normalized_root);
+  return (relative.empty() ? absolute : relative).generic_string();
+}
+
+std::optional<ShaderPack> ShaderPack::open(
+  const std::filesystem::path& pack_path, std::filesystem::path root)
+{
+  ZoneScoped;
+
+  auto file = MappedFile::open(pack_path);
+  if (!file.has_value())
+    return std::nullopt;
+
+  ShaderPack pack{std::move(*file)};
+  pack.root = normalized_absolute(root);
+
+  const auto data = pack.file.getData();
+  BinaryReader reader{data};
+
+  uint32_t magic = 0;
+  uint32_t version = 0;
+  uint32_t reflectionVersion = 0;
+  std::span<std::byte const> index;
+  if (
+    !reader.read(magic) || magic != SHADER_PACK_MAGIC || !reader.read(version) ||
+    version != SHADER_PACK_VERSION || !reader.read(reflectionVersion) ||
+    reflectionVersion != SHADER_REFLECTION_FORMAT_VERSION || !reader.readBytes(index))
+  {
+    spdlog::warn("Shader pack {} is outdated or broken, ignoring it", pack_path);
+    return std::nullopt;
+  }
+
+  const std::size_t blobsStart = align_pack_offset(reader.getOffset());
+  const auto blobData = data.subspan(std::min(blobsStart, data.size()));
+
+  BinaryReader indexReader{index};
+  auto broken = [&pack_path]() {
+    spdlog::warn("Shader pack {} is truncated, ignoring it", pack_path);
+    return std::nullopt;
+  };
+
+  // Every blob takes at least its offset, size and hash in the index
+  static constexpr std::size_t MIN_BLOB_SIZE = 3 * sizeof(uint64_t);
+  uint32_t blobCount = 0;
+  if (!indexReader.read(blobCount) || blobCount > indexReader.getRemaining() / MIN_BLOB_SIZE)
+    return broken();
+
+  pack.blobs.resize(blobCount);
+  for (auto& blob : pack.blobs)
+  {
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    if (
+      !indexReader.read(offset) || !indexReader.read(size) ||
+      !indexReader.read(blob.contentHash) || !read_reflection(indexReader, blob.reflection))
+      return broken();
+    if (offset > blobData.size() || size > blobData.size() - offset || size % 4 != 0)
+      return broken();
+    blob.code =
+      blobData.subspan(static_cast<std::size_t>(offset), static_cast<std::size_t>(size));
+  }
+
+  uint32_t entryCount = 0;
+  if (!indexReader.read(entryCount))
+    return broken();
+
+  for (uint32_t i = 0; i < entryCount; ++i)
+  {
+    std::string key;
+    uint32_t blobIdx = 0;
+    if (!indexReader.readString(key) || !indexReader.read(blobIdx) || blobIdx >= blobCount)
+      return broken();
+    pack.entries.emplace(std::move(key), blobIdx);
+  }
+
+  return pack;
+}
+
+std::optional<ShaderPack::Module> ShaderPack::find(
+  const std::filesystem::path& shader_path) const
+{
+  auto it = entries.find(make_pack_key(shader_path, root));
+  if (it == entries.end())
+    return std::nullopt;
+
+  const auto& blob = blobs[it->second];
+  return Module{
+    .code = blob.code,
+    .contentHash = blob.contentHash,
+    .reflection = &blob.reflection,
+  };
+}
+
+bool write_shader_pack(
+  const std::filesystem::path& pack_path,
+  const std::filesystem::path& root,
+  std::span<std::filesystem::path const> shaders)
+{
+  ZoneScoped;
+
+  struct PendingBlob
+  {
+    std::vector<std::byte> code;
+    uint64_t contentHash;
+    uint64_t offset;
+    ShaderReflection reflection;
+  };
+
+  const auto normalizedRoot = normalized_absolute(root);
+
+  std::vector<PendingBlob> blobs;
+  std::vector<std::pair<std::string, uint32_t>> entries;
+  std::unordered_set<std::string> usedKeys;
+  uint64_t blobsSize = 0;
+
+  for (const auto& path : shaders)
+  {
+    auto code = read_binary_file(path);
+    if (!code.has_value() || code->size() % 4 != 0)
+    {
+      spdlog::error("Failed to read SPIR-V file {}", path);
+      return false;
+    }
+
+    auto key = make_pack_key(path, normalizedRoot);
+    if (usedKeys.contains(key))
+      continue;
+
+    const uint64_t hash = content_hash(*code);
+    auto sameBlob = std::find_if(blobs.begin(), blobs.end(), [&](const PendingBlob& blob) {
+      return blob.contentHash == hash && blob.code == *code;
+    });
+
+    auto blobIdx = static_cast<uint32_t>(sameBlob - blobs.begin());
+    if (sameBlob == blobs.end())
+    {
+      auto reflection = reflect_spirv(*code, path);
+      const uint64_t size = code->size();
+      blobs.push_back(PendingBlob{std::move(*code), hash, blobsSize, std::move(reflection)});
+      blobsSize = align_pack_offset(blobsSize + size);
+    }
+
+    usedKeys.insert(key);
+    entries.emplace_back(std::move(key), blobIdx);
+  }
+
+  BinaryWriter index;
+  index.write(static_cast<uint32_t>(blobs.size()));
+  for (const auto& blob : blobs)
+  {
+    index.write(blob.offset);
+    index.write(static_cast<uint64_t>(blob.code.size()));
+    index.write(blob.contentHash);
+    write_reflection(index, blob.reflection);
+  }
+  index.write(static_cast<uint32_t>(entries.size()));
+  for (const auto& [key, blobIdx] : entries)
+  {
+    index.writeString(key);
+    index.write(blobIdx);
+  }
+
+  BinaryWriter writer;
+  writer.write(SHADER_PACK_MAGIC);
+  writer.write(SHADER_PACK_VERSION);
+  writer.write(SHADER_REFLECTION_FORMAT_VERSION);
+  writer.writeBytes(index.getData());
+
+  auto result = std::move(writer).extractData();
+  const std::size_t blobsStart = align_pack_offset(result.size());
+  result.resize(blobsStart + static_cast<std::size_t>(blobsSize));
+  for (const auto& blob : blobs)
+    std::copy(
+      blob.code.begin(),
+      blob.code.end(),
+      result.begin() + static_cast<std::ptrdiff_t>(blobsStart + blob.offset));
+
+  if (!write_binary_file_atomically(pack_path, result))
+  {
+    spdlog::error("Failed to write shader pack {}", pack_path);
+    return false;
+  }
+
+  spdlog::info(
+    "Packed {} shaders ({} unique) into {}, {} bytes",
+    entries.size(),
+    blobs.size(),
+    pack_path,
+    result.size());
+  return true;
+}
+
+} // namespace etna
@@ -0,0 +1,78 @@
+#pragma once
+#ifndef ETNA_SHADER_PACK_HPP_INCLUDED
+#define ETNA_SHADER_PACK_HPP_INCLUDED
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_map>
+
+#include <etna/ShaderProgram.hpp>
+
+#include "MappedFile.hpp"
+
+
+namespace etna
+{
+
+/**
+ * A single file containing many SPIR-V modules along with their reflection,
+ * produced at build time by etna_shader_packer. The whole file is mapped once
+ * and modules are handed to Vulkan straight from the mapping, so startup does
+ * neither per-file IO nor SPIR-V reflection.
+ *
+ * Layout: header, index (module paths relative to the packing root, each
+ * referencing a blob), then 8-byte aligned SPIR-V blobs. Identical modules
+ * are stored only once, as blobs are keyed by their content hash.
+ */
+class ShaderPack
+{
+public:
+  struct Module
+  {
+    std::span<std::byte const> code;
+    uint64_t contentHash;
+    const ShaderReflection* reflection;
+  };
+
+  // Returns nullopt if the pack is missing, broken or was written by an
+  // incompatible version of etna. Lookups are done relative to `root`.
+  static std::optional<ShaderPack> open(
+    const std::filesystem::path& pack_path, std::filesystem::path root);
+
+  // Thread-safe, as the pack is immutable once opened
+  std::optional<Module> find(const std::filesystem::path& shader_path) const;
+
+  std::size_t getModuleCount() const { return entries.size(); }
+
+private:
+  explicit ShaderPack(MappedFile&& in_file)
+    : file{std::move(in_file)}
+  {
+  }
+
+  struct Blob
+  {
+    std::span<std::byte const> code;
+    uint64_t contentHash;
+    ShaderReflection reflection;
+  };
+
+  MappedFile file;
+  std::filesystem::path root;
+  std::vector<Blob> blobs;
+  std::unordered_map<std::string, uint32_t> entries;
+};
+
+// Reads, reflects and packs the modules. Returns false on failure, after
+// printing the reason.
+bool write_shader_pack(
+  const std::filesystem::path& pack_path,
+  const std::filesystem::path& root,
+  std::span<std::filesystem::path const> shaders);
+
+} // namespace etna
+
+#endif // ETNA_SHADER_PACK_HPP_INCLUDED
@@ -1,139 +1,232 @@
 #include <etna/ShaderProgram.hpp>
 
-#include <fstream>
-#include <spirv_reflect.h>
+#include <algorithm>
 #include <fmt/std.h>
+#include <tracy/Tracy.hpp>
+#include <vulkan/vulkan_format_traits.hpp>
 
 #include <etna/GlobalContext.hpp>
+#include <etna/PipelineManager.hpp>
+#include "BinaryIo.hpp"
+#include "DeferredDestroyQueue.hpp"
+#include "MappedFile.hpp"
+#include "ShaderCompiler.hpp"
+#include "ShaderFileWatcher.hpp"
+#include "ShaderPack.hpp"
+#include "SpirvReflection.hpp"
+#include "WorkerPool.hpp"
 
 
 namespace etna
 {
 
-ShaderModule::ShaderModule(vk::Device device, std::filesystem::path shader_path)
-  : path{shader_path}
+ShaderProgramManager::ShaderProgramManager(CreateInfo info)
+  : compiler{std::make_unique<ShaderCompiler>(
+      std::move(info.compiledShaderCachePath),
+      info.compiledShaderCacheSizeLimit,
+      std::move(info.shaderSourceRoot),
+      std::move(info.shaderIncludeDirectories))}
+  , keepShaderCode{info.keepShaderCode}
 {
-  reload(device);
+  if (!info.reflectionCachePath.empty())
+    reflectionCache = std::make_unique<ShaderReflectionCache>(std::move(info.reflectionCachePath));
+  if (info.watchFiles)
+    fileWatcher = std::make_unique<ShaderFileWatcher>();
 }
 
-static std::vector<char> read_file(std::filesystem::path filename)
+ShaderProgramManager::~ShaderProgramManager()
 {
-  std::ifstream file(filename, std::ios::ate | std::ios::binary);
-
-  if (!file.is_open())
-  {
-    ETNA_PANIC("Failed to open file {}", filename);
-  }
+  clear();
+}
 
-  size_t fileSize = (size_t)file.tellg();
-  std::vector<char> buffer(fileSize);
+void ShaderProgramManager::saveReflectionCache()
+{
+  if (reflectionCache != nullptr)
+    reflectionCache->save();
+}
 
-  file.seekg(0);
-  file.read(buffer.data(), fileSize);
-  file.close();
-  return buffer;
+void ShaderProgramManager::trimCompiledShaderCache()
+{
+  compiler->trimCache();
 }
 
-struct SpvModDeleter
+bool ShaderProgramManager::mountShaderPack(
+  const std::filesystem::path& pack_path, std::filesystem::path root)
 {
-  SpvModDeleter() {}
-  void operator()(SpvReflectShaderModule* mod) const
+  if (root.empty())
+    root = pack_path.parent_path();
+
+  auto pack = ShaderPack::open(pack_path, std::move(root));
+  if (!pack.has_value())
   {
-    spvReflectDestroyShaderModule(mod);
-    delete mod;
+    spdlog::warn("Failed to mount shader pack {}, loading shaders from files", pack_path);
+    return false;
   }
-};
 
+  spdlog::info("Mounted shader pack {} with {} shaders", pack_path, pack->getModuleCount());
+  shaderPacks.push_back(std::make_unique<ShaderPack>(std::move(*pack)));
+  return true;
+}
 
-#define ETNA_SPV_REFLECT_VERIFY(res, path)                                                         \
-  ETNA_VERIFYF((res) == SPV_REFLECT_RESULT_SUCCESS, "SPIR-V parse error in {}", (path))
+std::unique_ptr<ShaderModule> ShaderProgramManager::createModule(
+  vk::Device device, const ModuleKey& key)
+{
+  // Packs only contain precompiled SPIR-V, so permutations never come from them
+  if (key.defines.empty())
+    for (const auto& pack : shaderPacks)
+      if (auto packed = pack->find(key.path); packed.has_value())
+        return std::make_unique<ShaderModule>(
+          device, key.path, packed->code, packed->contentHash, *packed->reflection);
+
+  return std::make_unique<ShaderModule>(device, key.path, key.defines, getLoaders());
+}
 
-void ShaderModule::reload(vk::Device device)
+void ShaderProgramManager::watchModule(const ShaderModule& shader_module)
 {
-  vkModule = {};
+  // Packed modules never change, so there's no point in watching them
+  if (fileWatcher == nullptr || shader_module.isImmutable())
+    return;
+
+  fileWatcher->watch(shader_module.getPath());
+  for (const auto& dependency : shader_module.getDependencies())
+    fileWatcher->watch(dependency);
+}
 
-  auto code = read_file(path);
+ShaderModule::ShaderModule(
+  vk::Device device,
+  std::filesystem::path shader_path,
+  std::vector<std::string> in_defines,
+  Loaders loaders)
+  : path{std::move(shader_path)}
+  , defines{std::move(in_defines)}
+{
+  reload(device, loaders);
+}
+
+ShaderModule::ShaderModule(
+  vk::Device device,
+  std::filesystem::path shader_path,
+  std::span<std::byte const> packed_code,
+  uint64_t content_hash,
+  ShaderReflection precomputed_reflection)
+  : path{std::move(shader_path)}
+  , contentHash{content_hash}
+  , immutable{true}
+  , code{packed_code}
+  , reflection{std::move(precomputed_reflection)}
+{
+  // The pack stays mapped for the lifetime of the manager, so the code is free to keep
   vk::ShaderModuleCreateInfo info{};
   info.setPCode(reinterpret_cast<const uint32_t*>(code.data()));
   info.setCodeSize(code.size());
-
-  if (code.size() % 4 != 0)
-    ETNA_PANIC("SPIRV {} broken", path);
-
   vkModule = unwrap_vk_result(device.createShaderModuleUnique(info));
+}
 
-  std::unique_ptr<SpvReflectShaderModule, SpvModDeleter> spvModule;
-  spvModule.reset(new SpvReflectShaderModule{});
+bool ShaderModule::reload(vk::Device device, Loaders loaders)
+{
+  if (immutable)
+    return false;
 
-  ETNA_SPV_REFLECT_VERIFY(
-    spvReflectCreateShaderModule(code.size(), code.data(), spvModule.get()), path);
+  if (ShaderCompiler::isSourceFile(path))
+  {
+    ETNA_VERIFY(loaders.compiler != nullptr);
+    auto compiled = loaders.compiler->compile(path, defines);
+    if (!compiled.has_value())
+    {
+      // A typo in a shader that is being edited should not kill the app
+      if (!vkModule)
+        ETNA_PANIC("Failed to compile shader {}", path);
+      return false;
+    }
 
-  stage = static_cast<vk::ShaderStageFlagBits>(spvModule->shader_stage);
-  entryPoint = spvModule->entry_point_name;
+    dependencies = std::move(compiled->dependencies);
+    return setCode(device, std::as_bytes(std::span{compiled->spirv}), loaders);
+  }
 
-  resources.clear();
+  // On the initial load the file is mapped straight into memory and handed to
+  // both Vulkan and SPIRV-Reflect without any copies. A reloaded file is likely
+  // still being rewritten by the shader compiler, and truncating a mapped file
+  // raises SIGBUS, so it is read into memory instead and validated.
+  std::optional<MappedFile> mapped;
+  std::optional<std::vector<std::byte>> contents;
+  std::span<std::byte const> bytes;
+  if (!vkModule)
+  {
+    mapped = MappedFile::open(path);
+    if (mapped.has_value())
+      bytes = mapped->getData();
+  }
+  else
+  {
+    contents = read_binary_file(path);
+    if (contents.has_value())
+      bytes = *contents;
+  }
 
-  uint32_t count = 0;
-  ETNA_SPV_REFLECT_VERIFY(
-    spvReflectEnumerateDescriptorSets(spvModule.get(), &count, nullptr), path);
+  if (!is_valid_spirv(bytes))
+  {
+    // The file might be replaced or still be written by the shader compiler
+    if (!vkModule)
+      ETNA_PANIC("Failed to load SPIRV {}", path);
+    spdlog::error("Failed to reload SPIRV {}, keeping the old version", path);
+    return false;
+  }
 
-  std::vector<SpvReflectDescriptorSet*> sets(count);
-  ETNA_SPV_REFLECT_VERIFY(
-    spvReflectEnumerateDescriptorSets(spvModule.get(), &count, sets.data()), path);
+  return setCode(device, bytes, loaders);
+}
 
-  resources.reserve(sets.size());
+bool ShaderModule::setCode(vk::Device device, std::span<std::byte const> bytes, Loaders loaders)
+{
+  const uint64_t newHash = content_hash(bytes);
+  if (vkModule && newHash == contentHash)
+    return false;
+  contentHash = newHash;
 
-  for (auto pSet : sets)
-  {
-    DescriptorSetInfo dsInfo;
-    dsInfo.clear();
-    dsInfo.parseShader(stage, *pSet);
-    resources.push_back({pSet->set, dsInfo});
-  }
+  // NOTE: modules may be destroyed while pipelines created from them are still in use
+  vk::ShaderModuleCreateInfo info{};
+  info.setPCode(reinterpret_cast<const uint32_t*>(bytes.data()));
+  info.setCodeSize(bytes.size());
+  vkModule = unwrap_vk_result(device.createShaderModuleUnique(info));
 
-  if (spvModule->push_constant_block_count == 1)
+  if (loaders.keepCode)
   {
-    auto& blk = spvModule->push_constant_blocks[0];
-    if (blk.offset != 0)
-    {
-      ETNA_PANIC("SPIRV {} parse error: PushConst offset is not zero", path);
-    }
-    pushConst.stageFlags = stage;
-    pushConst.offset = 0u;
-    pushConst.size = blk.size;
+    ownedCode.assign(bytes.begin(), bytes.end());
+    code = ownedCode;
   }
-  else if (spvModule->push_constant_block_count > 1)
+
+  auto* reflectionCache = loaders.reflectionCache;
+  std::optional<ShaderReflection> cached;
+  if (reflectionCache != nullptr)
+    cached = reflectionCache->find(contentHash, bytes.size());
+
+  if (cached.has_value())
   {
-    ETNA_PANIC("SPIRV {} parse error: only 1 push_const block per shader supported", path);
+    reflection = std::move(*cached);
   }
   else
   {
-    pushConst.size = 0u;
-    pushConst.offset = 0u;
-    pushConst.stageFlags = vk::ShaderStageFlags{};
+    reflection = reflect_spirv(bytes, path);
+    if (reflectionCache != nullptr)
+      reflectionCache->insert(contentHash, bytes.size(), reflection);
   }
-}
 
-uint32_t ShaderProgramManager::registerModule(std::filesystem::path path)
-{
-  auto it = shaderModuleNames.find(path);
-  if (it != shaderModuleNames.end())
-    return it->second;
-
-  uint32_t modId = static_cast<uint32_t>(shaderModules.size());
-  std::unique_ptr<ShaderModule> newMod;
-  newMod.reset(new ShaderModule{get_context().getDevice(), path});
-  shaderModules.push_back(std::move(newMod));
-  return modId;
+  return true;
 }
 
+static constexpr vk::ShaderStageFlags RAYTRACE_STAGES = vk::ShaderStageFlagBits::eRaygenKHR |
+  vk::ShaderStageFlagBits::eMissKHR | vk::ShaderStageFlagBits::eClosestHitKHR |
+  vk::ShaderStageFlagBits::eAnyHitKHR | vk::ShaderStageFlagBits::eIntersectionKHR |
+  vk::ShaderStageFlagBits::eCallableKHR;
+
 static void validate_program_shaders(
   const std::string& name, const std::vector<vk::ShaderStageFlagBits>& stages)
 {
   auto supportedShaders = vk::ShaderStageFlagBits::eVertex |
     vk::ShaderStageFlagBits::eTessellationControl |
     vk::ShaderStageFlagBits::eTessellationEvaluation | vk::ShaderStageFlagBits::eGeometry |
-    vk::ShaderStageFlagBits::eFragment | vk::ShaderStageFlagBits::eCompute;
+    vk::ShaderStageFlagBits::eFragment | vk::ShaderStageFlagBits::eCompute |
+    vk::ShaderStageFlagBits::eTaskEXT | vk::ShaderStageFlagBits::eMeshEXT |
+    RAYTRACE_STAGES;
 
   bool isComputePipeline = false;
   vk::ShaderStageFlags usageMask = static_cast<vk::ShaderStageFlags>(0);
@@ -148,7 +241,8 @@ static void validate_program_shaders(
         vk::to_string(stage));
     }
 
-    if (stage & usageMask)
+    // Ray tracing pipelines can have any number of shaders of the same kind
+    if ((stage & usageMask) && !(stage & RAYTRACE_STAGES))
     {
       ETNA_PANIC(
         "Shader program {} creating error, multiple usage of {} shader stage",
@@ -164,32 +258,120 @@ static void validate_program_shaders(
   {
     ETNA_PANIC("Shader program {} creating error, usage of compute shader with other stages", name);
   }
+
+  // Mesh shaders replace the whole vertex processing part of the pipeline
+  const auto vertexProcessing = vk::ShaderStageFlagBits::eVertex |
+    vk::ShaderStageFlagBits::eTessellationControl |
+    vk::ShaderStageFlagBits::eTessellationEvaluation | vk::ShaderStageFlagBits::eGeometry;
+  if ((usageMask & vk::ShaderStageFlagBits::eMeshEXT) && (usageMask & vertexProcessing))
+  {
+    ETNA_PANIC(
+      "Shader program {} creating error, mesh shader can not be combined with vertex, "
+      "tessellation or geometry shaders",
+      name);
+  }
+
+  if (
+    (usageMask & vk::ShaderStageFlagBits::eTaskEXT) &&
+    !(usageMask & vk::ShaderStageFlagBits::eMeshEXT))
+  {
+    ETNA_PANIC("Shader program {} creating error, task shader without a mesh shader", name);
+  }
+
+  if ((usageMask & RAYTRACE_STAGES) && (usageMask & ~RAYTRACE_STAGES))
+  {
+    ETNA_PANIC(
+      "Shader program {} creating error, ray tracing shaders can not be combined with others",
+      name);
+  }
+
+  if ((usageMask & RAYTRACE_STAGES) && !(usageMask & vk::ShaderStageFlagBits::eRaygenKHR))
+  {
+    ETNA_PANIC("Shader program {} creating error, no ray generation shader", name);
+  }
 }
 
 ShaderProgramId ShaderProgramManager::loadProgram(
   const char* name, std::span<std::filesystem::path const> shaders_path)
 {
-  if (programNames.find(name) != programNames.end())
-    ETNA_PANIC("Shader program {} redefenition", name);
+  const ShaderProgramDescription description{
+    .name = name,
+    .shaders = {shaders_path.begin(), shaders_path.end()},
+  };
+  return loadPrograms({&description, 1}).front();
+}
+
+std::vector<ShaderProgramId> ShaderProgramManager::loadPrograms(
+  std::span<ShaderProgramDescription const> descriptions)
+{
+  ZoneScoped;
 
-  std::vector<uint32_t> moduleIds;
-  std::vector<vk::ShaderStageFlagBits> stages;
-  for (const auto& path : shaders_path)
+  // Module ids are assigned in the order of first appearance,
+  // so that they don't depend on thread scheduling.
+  const uint32_t firstNewModule = static_cast<uint32_t>(shaderModules.size());
+  std::vector<ModuleKey> newModuleKeys;
+  std::vector<std::vector<uint32_t>> programModules;
+  programModules.reserve(descriptions.size());
+
+  for (const auto& desc : descriptions)
   {
-    auto id = registerModule(path);
-    auto stage = getModule(id).getStage();
+    if (programNames.contains(desc.name))
+      ETNA_PANIC("Shader program {} redefenition", desc.name);
+
+    // Order of defines does not matter, so permutations are shared as much as possible
+    std::vector<std::string> defines = desc.defines;
+    std::sort(defines.begin(), defines.end());
+    defines.erase(std::unique(defines.begin(), defines.end()), defines.end());
 
-    moduleIds.push_back(id);
-    stages.push_back(stage);
+    auto& moduleIds = programModules.emplace_back();
+    for (const auto& path : desc.shaders)
+    {
+      const auto newId = static_cast<uint32_t>(firstNewModule + newModuleKeys.size());
+      ModuleKey key{path, {}};
+      if (ShaderCompiler::isSourceFile(path))
+        key.defines = defines;
+      auto [it, inserted] = shaderModuleNames.emplace(key, newId);
+      if (inserted)
+        newModuleKeys.push_back(std::move(key));
+      moduleIds.push_back(it->second);
+    }
   }
 
-  validate_program_shaders(name, stages);
+  // Compiling, reading, reflecting and creating modules is independent for every
+  // module, so all permutations are processed in parallel
+  shaderModules.resize(firstNewModule + newModuleKeys.size());
+  const vk::Device device = get_context().getDevice();
+  get_context().getWorkerPool().parallelFor(newModuleKeys.size(), [&](std::size_t i) {
+    shaderModules[firstNewModule + i] = createModule(device, newModuleKeys[i]);
+  });
+
+  for (std::size_t i = firstNewModule; i < shaderModules.size(); ++i)
+    watchModule(*shaderModules[i]);
+
+  // Layout caches are not thread-safe, and merging is cheap anyway
+  std::vector<ShaderProgramId> result;
+  result.reserve(descriptions.size());
+  for (std::size_t i = 0; i < descriptions.size(); ++i)
+  {
+    const auto& name = descriptions[i].name;
+    if (programNames.contains(name))
+      ETNA_PANIC("Shader program {} redefenition", name);
+
+    std::vector<vk::ShaderStageFlagBits> stages;
+    stages.reserve(programModules[i].size());
+    for (auto id : programModules[i])
+      stages.push_back(getModule(id).getStage());
+
+    validate_program_shaders(name, stages);
+
+    ShaderProgramId progId = static_cast<ShaderProgramId>(programs.size());
+    programs.emplace_back(new ShaderProgramInternal{name, std::move(programModules[i])});
+    programs.back()->reload(*this);
+    programNames[name] = progId;
+    result.push_back(progId);
+  }
 
-  ShaderProgramId progId = static_cast<ShaderProgramId>(programs.size());
-  programs.emplace_back(new ShaderProgramInternal{name, std::move(moduleIds)});
-  programs[static_cast<std::underlying_type_t<ShaderProgramId>>(progId)]->reload(*this);
-  programNames[name] = progId;
-  return progId;
+  return result;
 }
 
 ShaderProgramId ShaderProgramManager::tryGetProgram(const char* name) const
@@ -208,11 +390,25 @@ ShaderProgramId ShaderProgramManager::getProgram(const char* name) const
   return it->second;
 }
 
-void ShaderProgramManager::ShaderProgramInternal::reload(ShaderProgramManager& manager)
+bool ShaderProgramManager::ShaderProgramInternal::reload(ShaderProgramManager& manager)
 {
-  progLayout = {};
+  // Set layouts are cached, so equal handles mean equal layouts
+  const auto oldSetLayouts = std::move(setLayouts);
+  const auto oldPushConstRanges = std::move(pushConstRanges);
+
+  // Pipelines using the old layout might still be in flight
+  if (progLayout)
+    get_context().getDeferredDestroyQueue().retire(std::move(progLayout));
+  if (!shaderObjects.empty())
+    get_context().getDeferredDestroyQueue().retire(std::move(shaderObjects));
+  shaderObjects.clear();
   usedDescriptors = {};
   pushConst = vk::PushConstantRange{};
+  pushConstRanges.clear();
+  specConstants.clear();
+  vertexInputs.clear();
+  meshOutput = {};
+  workgroupSize = {};
 
   std::array<DescriptorSetInfo, MAX_PROGRAM_DESCRIPTORS> dstDescriptors;
   auto& descriptorLayoutCache = get_context().getDescriptorSetLayouts();
@@ -226,24 +422,47 @@ void ShaderProgramManager::ShaderProgramInternal::reload(ShaderProgramManager& m
     if (shaderMod.getPushConst().size > 0) // merge push constants
     {
       auto modPushConst = shaderMod.getPushConst();
+      pushConstRanges.push_back(modPushConst);
+
       if (pushConst.size == 0u)
       {
         pushConst = modPushConst;
       }
       else
       {
-        ETNA_ASSERTF(
-          pushConst.size == modPushConst.size,
-          "ShaderProgram {}: push constant blocks differ between modules (stages), "
-          "expected {} bytes but got {} bytes in module {}",
-          name,
-          pushConst.size,
-          modPushConst.size,
-          shaderMod.getName());
+        const uint32_t end =
+          std::max(pushConst.offset + pushConst.size, modPushConst.offset + modPushConst.size);
+        pushConst.offset = std::min(pushConst.offset, modPushConst.offset);
+        pushConst.size = end - pushConst.offset;
         pushConst.stageFlags |= modPushConst.stageFlags;
       }
     }
 
+    if (shaderMod.getStage() == vk::ShaderStageFlagBits::eVertex)
+      vertexInputs = shaderMod.getVertexInputs();
+    if (shaderMod.getStage() == vk::ShaderStageFlagBits::eMeshEXT)
+      meshOutput = shaderMod.getMeshOutput();
+    if (shaderMod.getStage() == vk::ShaderStageFlagBits::eCompute)
+      workgroupSize = shaderMod.getWorkgroupSize();
+
+    for (const auto& constant : shaderMod.getSpecializationConstants()) // merge spec constants
+    {
+      auto same = std::find_if(specConstants.begin(), specConstants.end(), [&](const auto& c) {
+        return c.constantId == constant.constantId;
+      });
+      if (same == specConstants.end())
+      {
+        specConstants.push_back(constant);
+        continue;
+      }
+      ETNA_VERIFYF(
+        same->size == constant.size && same->name == constant.name,
+        "ShaderProgram {}: specialization constant {} is declared differently in module {}",
+        name,
+        constant.constantId,
+        shaderMod.getName());
+    }
+
     const auto& resources = shaderMod.getResources(); // merge descriptors
     for (auto& desc : resources)
     {
@@ -261,9 +480,33 @@ void ShaderProgramManager::ShaderProgramInternal::reload(ShaderProgramManager& m
     }
   }
 
+  // Overlapping ranges are merged, so that every byte belongs to a single range
+  // and vkCmdPushConstants can update a range with its stage flags. Ray tracing
+  // programs might have several shaders of one stage, while Vulkan allows a
+  // stage to appear in a single range only, so those are merged as well.
+  auto mustMerge = [](const vk::PushConstantRange& a, const vk::PushConstantRange& b) {
+    return (a.offset < b.offset + b.size && b.offset < a.offset + a.size) ||
+      static_cast<bool>(a.stageFlags & b.stageFlags);
+  };
+  for (std::size_t i = 0; i < pushConstRanges.size(); ++i)
+    for (std::size_t j = i + 1; j < pushConstRanges.size(); ++j)
+    {
+      auto& range = pushConstRanges[i];
+      const auto other = pushConstRanges[j];
+      if (!mustMerge(range, other))
+        continue;
+      const uint32_t end = std::max(range.offset + range.size, other.offset + other.size);
+      range.offset = std::min(range.offset, other.offset);
+      range.size = end - range.offset;
+      range.stageFlags |= other.stageFlags;
+      pushConstRanges.erase(pushConstRanges.begin() + static_cast<std::ptrdiff_t>(j));
+      // The grown range might overlap the ones that were checked already
+      j = i;
+    }
+
   static constexpr DescriptorSetInfo NULL_DSET_INFO{};
 
-  std::vector<vk::DescriptorSetLayout> vkLayouts;
+  setLayouts.clear();
 
   for (uint32_t i = 0; i < usedDescriptorSetRange; i++)
   {
@@ -271,32 +514,130 @@ void ShaderProgramManager::ShaderProgramInternal::reload(ShaderProgramManager& m
       usedDescriptors.test(i) ? dstDescriptors[i] : NULL_DSET_INFO;
     auto res = descriptorLayoutCache.get(get_context().getDevice(), dsetInfo);
     descriptorIds[i] = res.first;
-    vkLayouts.push_back(res.second);
+    setLayouts.push_back(res.second);
   }
 
   vk::PipelineLayoutCreateInfo info{};
-  info.setSetLayouts(vkLayouts);
+  info.setSetLayouts(setLayouts);
 
   if (pushConst.size > 0)
   {
-    info.setPPushConstantRanges(&pushConst);
-    info.setPushConstantRangeCount(1u);
+    const uint32_t maxSize =
+      get_context().getPhysicalDevice().getProperties().limits.maxPushConstantsSize;
+    ETNA_VERIFYF(
+      pushConst.offset + pushConst.size <= maxSize,
+      "ShaderProgram {}: push constants end at byte {}, but the device only supports {}",
+      name,
+      pushConst.offset + pushConst.size,
+      maxSize);
   }
+  info.setPushConstantRanges(pushConstRanges);
 
   progLayout = unwrap_vk_result(get_context().getDevice().createPipelineLayoutUnique(info));
+
+  return setLayouts != oldSetLayouts || pushConstRanges != oldPushConstRanges;
 }
 
-void ShaderProgramManager::reloadPrograms()
+ShaderProgramManager::ReloadedPrograms ShaderProgramManager::reloadPrograms()
 {
-  for (auto& mod : shaderModules)
+  ZoneScoped;
+
+  // Pipelines compiling in the background reference the modules that are about to change
+  get_context().getPipelineManager().waitForAllPipelines();
+
+  // NOTE: not std::vector<bool>, as it is written to from several threads
+  std::vector<uint8_t> moduleChanged(shaderModules.size(), 0);
+  const vk::Device device = get_context().getDevice();
+  get_context().getWorkerPool().parallelFor(shaderModules.size(), [&](std::size_t i) {
+    moduleChanged[i] = shaderModules[i]->reload(device, getLoaders()) ? 1 : 0;
+  });
+
+  // Layouts are rebuilt for every program, but pipelines only depend on the code.
+  // Set layouts were recreated from scratch, so their handles can not be compared,
+  // and every program whose code changed is assumed to have a new layout.
+  ReloadedPrograms result;
+  for (std::size_t i = 0; i < programs.size(); ++i)
   {
-    mod->reload(get_context().getDevice());
+    auto& prog = *programs[i];
+    prog.reload(*this);
+    const bool codeChanged =
+      std::any_of(prog.moduleIds.begin(), prog.moduleIds.end(), [&](uint32_t id) {
+        return moduleChanged[id] != 0;
+      });
+    if (codeChanged)
+      result.programs.push_back(static_cast<ShaderProgramId>(i));
   }
+  result.layoutChanged = result.programs;
+
+  return result;
+}
+
+ShaderProgramManager::ReloadedPrograms ShaderProgramManager::reloadChangedPrograms()
+{
+  ZoneScoped;
+
+  std::vector<uint32_t> candidates;
+  if (fileWatcher != nullptr)
+  {
+    const auto changedFiles = fileWatcher->poll();
+    auto isChanged = [&changedFiles](const std::filesystem::path& path) {
+      return std::find(changedFiles.begin(), changedFiles.end(), path) != changedFiles.end();
+    };
+
+    // A change to an include affects every permutation of every source including it
+    if (!changedFiles.empty())
+      for (uint32_t i = 0; i < shaderModules.size(); ++i)
+      {
+        const auto& deps = shaderModules[i]->getDependencies();
+        if (
+          isChanged(shaderModules[i]->getPath()) ||
+          std::any_of(deps.begin(), deps.end(), isChanged))
+          candidates.push_back(i);
+      }
+  }
+  else
+  {
+    candidates.resize(shaderModules.size());
+    for (uint32_t i = 0; i < candidates.size(); ++i)
+      candidates[i] = i;
+  }
+
+  if (candidates.empty())
+    return {};
+
+  get_context().getPipelineManager().waitForAllPipelines();
 
-  for (auto& progPtr : programs)
+  // NOTE: not std::vector<bool>, as it is written to from several threads
+  std::vector<uint8_t> moduleChanged(shaderModules.size(), 0);
+  const vk::Device device = get_context().getDevice();
+  get_context().getWorkerPool().parallelFor(candidates.size(), [&](std::size_t i) {
+    const uint32_t modId = candidates[i];
+    moduleChanged[modId] = shaderModules[modId]->reload(device, getLoaders()) ? 1 : 0;
+  });
+
+  // Sources might have started including new files
+  for (auto modId : candidates)
+    watchModule(*shaderModules[modId]);
+
+  ReloadedPrograms reloaded;
+  for (std::size_t i = 0; i < programs.size(); ++i)
   {
-    progPtr->reload(*this);
+    auto& prog = *programs[i];
+    const bool changed =
+      std::any_of(prog.moduleIds.begin(), prog.moduleIds.end(), [&](uint32_t id) {
+        return moduleChanged[id] != 0;
+      });
+    if (!changed)
+      continue;
+
+    const auto id = static_cast<ShaderProgramId>(i);
+    reloaded.programs.push_back(id);
+    if (prog.reload(*this))
+      reloaded.layoutChanged.push_back(id);
+    spdlog::info("Reloaded shader program {}", prog.name);
   }
+
+  return reloaded;
 }
 
 void ShaderProgramManager::clear()
@@ -327,6 +668,110 @@ std::vector<vk::PipelineShaderStageCreateInfo> ShaderProgramManager::getShaderSt
   return stages;
 }
 
+// Position of a stage in the graphics pipeline. Stage bits are not ordered
+// that way, task and mesh bits come after the fragment one.
+static uint32_t pipeline_stage_rank(vk::ShaderStageFlagBits stage)
+{
+  switch (stage)
+  {
+  case vk::ShaderStageFlagBits::eTaskEXT:
+    return 0;
+  case vk::ShaderStageFlagBits::eMeshEXT:
+    return 1;
+  case vk::ShaderStageFlagBits::eVertex:
+    return 2;
+  case vk::ShaderStageFlagBits::eTessellationControl:
+    return 3;
+  case vk::ShaderStageFlagBits::eTessellationEvaluation:
+    return 4;
+  case vk::ShaderStageFlagBits::eGeometry:
+    return 5;
+  case vk::ShaderStageFlagBits::eFragment:
+    return 6;
+  default:
+    return 7;
+  }
+}
+
+const ShaderObjects& ShaderProgramManager::getShaderObjects(
+  ShaderProgramId id, const SpecializationConstants& constants)
+{
+  auto& prog = *programs.at(static_cast<std::underlying_type_t<ShaderProgramId>>(id));
+  for (const auto& variant : prog.shaderObjects)
+    if (variant->constants == constants)
+      return variant->objects;
+
+  ZoneScoped;
+
+  std::vector<vk::SpecializationMapEntry> entries;
+  std::vector<std::byte> data;
+  vk::SpecializationInfo specialization{};
+  if (!constants.empty())
+  {
+    constants.resolve(prog.specConstants, prog.name, entries, data);
+    specialization.setMapEntries(entries);
+    specialization.setDataSize(data.size());
+    specialization.setPData(data.data());
+  }
+
+  // Shader objects have to be created in the order the stages run in
+  std::vector<const ShaderModule*> modules;
+  for (auto modId : prog.moduleIds)
+    modules.push_back(&getModule(modId));
+  std::sort(modules.begin(), modules.end(), [](const auto* a, const auto* b) {
+    return pipeline_stage_rank(a->getStage()) < pipeline_stage_rank(b->getStage());
+  });
+
+  const bool isCompute = modules.front()->getStage() == vk::ShaderStageFlagBits::eCompute;
+  const bool hasFragment = modules.back()->getStage() == vk::ShaderStageFlagBits::eFragment;
+
+  std::vector<vk::ShaderCreateInfoEXT> infos;
+  infos.reserve(modules.size());
+  for (std::size_t i = 0; i < modules.size(); ++i)
+  {
+    const auto& shaderMod = *modules[i];
+    ETNA_VERIFYF(
+      !shaderMod.getCode().empty(),
+      "ShaderProgram {}: SPIR-V of {} was not kept, enable VK_EXT_shader_object in "
+      "InitParams::deviceExtensions to use shader objects",
+      prog.name,
+      shaderMod.getPath());
+
+    vk::ShaderStageFlags nextStage{};
+    if (i + 1 < modules.size())
+      nextStage = modules[i + 1]->getStage();
+    else if (!isCompute && !hasFragment)
+      nextStage = vk::ShaderStageFlagBits::eFragment; // might be bound separately later
+
+    vk::ShaderCreateInfoEXT info{
+      .flags = modules.size() > 1 ? vk::ShaderCreateFlagBitsEXT::eLinkStage
+                                  : vk::ShaderCreateFlagsEXT{},
+      .stage = shaderMod.getStage(),
+      .nextStage = nextStage,
+      .codeType = vk::ShaderCodeTypeEXT::eSpirv,
+      .codeSize = shaderMod.getCode().size(),
+      .pCode = shaderMod.getCode().data(),
+      .pName = shaderMod.getName().c_str(),
+      .pSpecializationInfo = constants.empty() ? nullptr : &specialization,
+    };
+    info.setSetLayouts(prog.setLayouts);
+    info.setPushConstantRanges(prog.pushConstRanges);
+    infos.push_back(info);
+  }
+
+  auto variant = std::make_unique<ShaderProgramInternal::ShaderObjectVariant>();
+  variant->constants = constants;
+  variant->owned = unwrap_vk_result(get_context().getDevice().createShadersEXTUnique(infos));
+  for (std::size_t i = 0; i < modules.size(); ++i)
+  {
+    variant->objects.stages.push_back(modules[i]->getStage());
+    variant->objects.shaders.push_back(variant->owned[i].get());
+  }
+
+  prog.shaderObjects.push_back(std::move(variant));
+  return prog.shaderObjects.back()->objects;
+}
+
 vk::DescriptorSetLayout ShaderProgramManager::getDescriptorLayout(
   ShaderProgramId id, uint32_t set) const
 {
@@ -334,12 +779,94 @@ vk::DescriptorSetLayout ShaderProgramManager::getDescriptorLayout(
   return get_context().getDescriptorSetLayouts().getVkLayout(layoutId);
 }
 
+const std::string& ShaderProgramInfo::getName() const
+{
+  return mgr.getProgInternal(id).name;
+}
+
 vk::PushConstantRange ShaderProgramInfo::getPushConst() const
 {
   auto& prog = mgr.getProgInternal(id);
+  ETNA_VERIFYF(
+    prog.pushConstRanges.size() <= 1,
+    "ShaderProgram {}: stages use {} separate push constant ranges, use getPushConstRanges",
+    prog.name,
+    prog.pushConstRanges.size());
   return prog.pushConst;
 }
 
+std::span<const SpecializationConstantInfo> ShaderProgramInfo::getSpecializationConstants() const
+{
+  return mgr.getProgInternal(id).specConstants;
+}
+
+std::span<const VertexInputInfo> ShaderProgramInfo::getVertexInputs() const
+{
+  return mgr.getProgInternal(id).vertexInputs;
+}
+
+MeshOutputInfo ShaderProgramInfo::getMeshOutput() const
+{
+  return mgr.getProgInternal(id).meshOutput;
+}
+
+WorkgroupSizeInfo ShaderProgramInfo::getWorkgroupSize() const
+{
+  return mgr.getProgInternal(id).workgroupSize;
+}
+
+uint32_t get_vertex_input_location_count(vk::Format format)
+{
+  if (format == vk::Format::eUndefined)
+    return 1;
+  return vk::componentBits(format, 0) == 64 && vk::componentCount(format) > 2 ? 2 : 1;
+}
+
+VertexShaderInputDescription ShaderProgramInfo::getDefaultVertexShaderInput() const
+{
+  const auto& prog = mgr.getProgInternal(id);
+  if (prog.vertexInputs.empty())
+    return {};
+
+  using Binding = VertexShaderInputDescription::Binding;
+  Binding binding{};
+  binding.attributeMapping.assign(prog.vertexInputs.back().location + 1, Binding::UNUSED_LOCATION);
+
+  auto& stream = binding.byteStreamDescription;
+  stream.stride = 0;
+  for (const auto& input : prog.vertexInputs)
+  {
+    ETNA_VERIFYF(
+      input.format != vk::Format::eUndefined,
+      "ShaderProgram {}: vertex input '{}' has an unsupported type, describe the input manually",
+      prog.name,
+      input.name);
+
+    binding.attributeMapping[input.location] = static_cast<uint32_t>(stream.attributes.size());
+    stream.attributes.push_back({.format = input.format, .offset = stream.stride});
+    stream.stride += static_cast<uint32_t>(vk::blockSize(input.format));
+  }
+
+  VertexShaderInputDescription result;
+  result.bindings.emplace_back(std::move(binding));
+  return result;
+}
+
+std::span<const vk::PushConstantRange> ShaderProgramInfo::getPushConstRanges() const
+{
+  return mgr.getProgInternal(id).pushConstRanges;
+}
+
+vk::ShaderStageFlags ShaderProgramInfo::getPushConstStages(uint32_t offset, uint32_t size) const
+{
+  // Vulkan requires stage flags of all ranges overlapping the updated bytes
+  vk::ShaderStageFlags result{};
+  for (const auto& range : mgr.getProgInternal(id).pushConstRanges)
+    if (range.offset < offset + size && offset < range.offset + range.size)
+      result |= range.stageFlags;
+  return result;
+}
+
 vk::PipelineLayout ShaderProgramInfo::getPipelineLayout() const
 {
   auto& prog = mgr.getProgInternal(id);
@@ -0,0 +1,134 @@
+#include <etna/SpecializationConstants.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+
+#include <etna/Assert.hpp>
+
+
+namespace etna
+{
+
+void SpecializationConstants::setRaw(
+  std::string name, uint32_t constant_id, uint64_t bits, uint32_t size)
+{
+  auto less = [](const Value& a, const Value& b) {
+    return std::tie(a.name, a.constantId) < std::tie(b.name, b.constantId);
+  };
+
+  Value value{std::move(name), constant_id, bits, size};
+  auto it = std::lower_bound(values.begin(), values.end(), value, less);
+  if (it != values.end() && it->name == value.name && it->constantId == value.constantId)
+    *it = std::move(value);
+  else
+    values.insert(it, std::move(value));
+}
+
+using Value = SpecializationConstants::Value;
+
+static const SpecializationConstantInfo* find_reflected(
+  std::span<const SpecializationConstantInfo> reflected, const Value& value)
+{
+  auto it = std::find_if(reflected.begin(), reflected.end(), [&value](const auto& info) {
+    return value.name.empty() ? info.constantId == value.constantId : info.name == value.name;
+  });
+  return it == reflected.end() ? nullptr : &*it;
+}
+
+// Narrowed explicitly, so that the low bytes get written regardless of endianness
+template <class T>
+static void write_bits(std::byte* dst, uint64_t bits)
+{
+  const auto narrowed = static_cast<T>(bits);
+  std::memcpy(dst, &narrowed, sizeof(T));
+}
+
+void SpecializationConstants::resolve(
+  std::span<const SpecializationConstantInfo> reflected,
+  std::string_view program_name,
+  std::vector<vk::SpecializationMapEntry>& out_entries,
+  std::vector<std::byte>& out_data) const
+{
+  out_entries.clear();
+  out_data.clear();
+
+  for (const auto& value : values)
+  {
+    const auto* it = find_reflected(reflected, value);
+    if (it == nullptr)
+    {
+      if (value.name.empty())
+        ETNA_PANIC(
+          "Shader program {} has no specialization constant with id {}",
+          program_name,
+          value.constantId);
+      else
+        ETNA_PANIC(
+          "Shader program {} has no specialization constant named {}", program_name, value.name);
+    }
+
+    ETNA_VERIFYF(
+      it->size == value.size,
+      "Shader program {}: specialization constant {} is {} bytes wide, but a {} byte value "
+      "was provided",
+      program_name,
+      it->name,
+      it->size,
+      value.size);
+
+    // Values are sorted by name, so there is no telling which one was set last
+    const bool duplicate =
+      std::any_of(out_entries.begin(), out_entries.end(), [it](const auto& entry) {
+        return entry.constantID == it->constantId;
+      });
+    ETNA_VERIFYF(
+      !duplicate,
+      "Shader program {}: specialization constant {} ({}) is set both by name and by id",
+      program_name,
+      it->name,
+      it->constantId);
+
+    out_entries.push_back(vk::SpecializationMapEntry{
+      .constantID = it->constantId,
+      .offset = static_cast<uint32_t>(out_data.size()),
+      .size = value.size,
+    });
+
+    const auto offset = out_data.size();
+    out_data.resize(offset + value.size);
+    auto* dst = out_data.data() + offset;
+    switch (value.size)
+    {
+    case 1:
+      write_bits<uint8_t>(dst, value.bits);
+      break;
+    case 2:
+      write_bits<uint16_t>(dst, value.bits);
+      break;
+    case 4:
+      write_bits<uint32_t>(dst, value.bits);
+      break;
+    default:
+      write_bits<uint64_t>(dst, value.bits);
+      break;
+    }
+  }
+}
+
+bool SpecializationConstants::matches(std::span<const SpecializationConstantInfo> reflected) const
+{
+  std::vector<uint32_t> ids;
+  for (const auto& value : values)
+  {
+    const auto* info = find_reflected(reflected, value);
+    if (info == nullptr || info->size != value.size)
+      return false;
+    if (std::find(ids.begin(), ids.end(), info->constantId) != ids.end())
+      return false;
+    ids.push_back(info->constantId);
+  }
+  return true;
+}
+
+} // namespace etna
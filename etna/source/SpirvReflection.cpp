@@ -0,0 +1,612 @@
+#include "SpirvReflection.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+
+#include <spirv_reflect.h>
+#include <fmt/std.h>
+#include <tracy/Tracy.hpp>
+
+
+namespace etna
+{
+
+struct SpvModDeleter
+{
+  SpvModDeleter() {}
+  void operator()(SpvReflectShaderModule* mod) const
+  {
+    spvReflectDestroyShaderModule(mod);
+    delete mod;
+  }
+};
+
+
+// SPIRV-Reflect only reports ids and names of specialization constants,
+// so their widths and default values are read from the instructions directly.
+// Widths come from the result types, as 8 and 16 bit literals take a whole word.
+static void read_spec_constant_values(
+  std::span<std::byte const> code,
+  std::span<SpecializationConstantInfo> constants,
+  std::span<uint32_t const> spirv_ids)
+{
+  static constexpr uint32_t SPIRV_HEADER_WORDS = 5;
+  static constexpr uint32_t OP_TYPE_INT = 21;
+  static constexpr uint32_t OP_TYPE_FLOAT = 22;
+  static constexpr uint32_t OP_SPEC_CONSTANT_TRUE = 48;
+  static constexpr uint32_t OP_SPEC_CONSTANT_FALSE = 49;
+  static constexpr uint32_t OP_SPEC_CONSTANT = 50;
+
+  const std::span words{
+    reinterpret_cast<const uint32_t*>(code.data()), code.size() / sizeof(uint32_t)};
+
+  // Bit widths of scalar types by their result ids
+  std::unordered_map<uint32_t, uint32_t> typeWidths;
+
+  for (std::size_t i = SPIRV_HEADER_WORDS; i < words.size();)
+  {
+    const uint32_t opcode = words[i] & 0xFFFF;
+    const uint32_t wordCount = words[i] >> 16;
+    if (wordCount == 0 || i + wordCount > words.size())
+      break;
+
+    // Types are always declared before the constants that use them
+    if ((opcode == OP_TYPE_INT || opcode == OP_TYPE_FLOAT) && wordCount >= 3)
+      typeWidths[words[i + 1]] = words[i + 2];
+
+    const bool isSpecConstant = opcode == OP_SPEC_CONSTANT_TRUE ||
+      opcode == OP_SPEC_CONSTANT_FALSE || (opcode == OP_SPEC_CONSTANT && wordCount >= 4);
+    if (isSpecConstant && wordCount >= 3)
+    {
+      const uint32_t resultId = words[i + 2];
+      auto it = std::find(spirv_ids.begin(), spirv_ids.end(), resultId);
+      if (it != spirv_ids.end())
+      {
+        auto& info = constants[static_cast<std::size_t>(it - spirv_ids.begin())];
+        if (opcode == OP_SPEC_CONSTANT)
+        {
+          auto width = typeWidths.find(words[i + 1]);
+          const uint32_t bits = width != typeWidths.end() ? width->second : 32;
+          info.size = bits / 8;
+          info.defaultValue = words[i + 3];
+          if (info.size == 8 && wordCount >= 5)
+            info.defaultValue |= static_cast<uint64_t>(words[i + 4]) << 32;
+          // Narrow signed literals are sign-extended to the whole word
+          else if (info.size < 4)
+            info.defaultValue &= (uint64_t{1} << bits) - 1;
+        }
+        else
+        {
+          info.size = sizeof(vk::Bool32);
+          info.defaultValue = opcode == OP_SPEC_CONSTANT_TRUE ? 1 : 0;
+        }
+      }
+    }
+
+    i += wordCount;
+  }
+}
+
+// SPIRV-Reflect does not report the operands of execution modes, so the output
+// limits of mesh shaders are read from OpExecutionMode instructions directly.
+static MeshOutputInfo read_mesh_output(std::span<std::byte const> code)
+{
+  static constexpr uint32_t SPIRV_HEADER_WORDS = 5;
+  static constexpr uint32_t OP_EXECUTION_MODE = 16;
+  static constexpr uint32_t MODE_OUTPUT_VERTICES = 26;
+  static constexpr uint32_t MODE_OUTPUT_POINTS = 27;
+  static constexpr uint32_t MODE_OUTPUT_LINES = 5269;
+  static constexpr uint32_t MODE_OUTPUT_PRIMITIVES = 5270;
+  static constexpr uint32_t MODE_OUTPUT_TRIANGLES = 5298;
+
+  const std::span words{
+    reinterpret_cast<const uint32_t*>(code.data()), code.size() / sizeof(uint32_t)};
+
+  MeshOutputInfo result;
+  for (std::size_t i = SPIRV_HEADER_WORDS; i < words.size();)
+  {
+    const uint32_t opcode = words[i] & 0xFFFF;
+    const uint32_t wordCount = words[i] >> 16;
+    if (wordCount == 0 || i + wordCount > words.size())
+      break;
+
+    if (opcode == OP_EXECUTION_MODE && wordCount >= 3)
+    {
+      const uint32_t mode = words[i + 2];
+      const uint32_t operand = wordCount >= 4 ? words[i + 3] : 0;
+      switch (mode)
+      {
+      case MODE_OUTPUT_VERTICES:
+        result.maxVertices = operand;
+        break;
+      case MODE_OUTPUT_PRIMITIVES:
+        result.maxPrimitives = operand;
+        break;
+      case MODE_OUTPUT_POINTS:
+        result.topology = vk::PrimitiveTopology::ePointList;
+        break;
+      case MODE_OUTPUT_LINES:
+        result.topology = vk::PrimitiveTopology::eLineList;
+        break;
+      case MODE_OUTPUT_TRIANGLES:
+        result.topology = vk::PrimitiveTopology::eTriangleList;
+        break;
+      default:
+        break;
+      }
+    }
+
+    i += wordCount;
+  }
+  return result;
+}
+
+// SPIRV-Reflect only reports literal workgroup sizes, so they are read from the
+// instructions directly. A WorkgroupSize built-in overrides the execution mode,
+// and both it and LocalSizeId might refer to specialization constants.
+static WorkgroupSizeInfo read_workgroup_size(std::span<std::byte const> code)
+{
+  static constexpr uint32_t SPIRV_HEADER_WORDS = 5;
+  static constexpr uint32_t OP_EXECUTION_MODE = 16;
+  static constexpr uint32_t OP_CONSTANT = 43;
+  static constexpr uint32_t OP_CONSTANT_COMPOSITE = 44;
+  static constexpr uint32_t OP_SPEC_CONSTANT = 50;
+  static constexpr uint32_t OP_SPEC_CONSTANT_COMPOSITE = 51;
+  static constexpr uint32_t OP_DECORATE = 71;
+  static constexpr uint32_t OP_EXECUTION_MODE_ID = 331;
+  static constexpr uint32_t MODE_LOCAL_SIZE = 17;
+  static constexpr uint32_t MODE_LOCAL_SIZE_ID = 38;
+  static constexpr uint32_t DECORATION_SPEC_ID = 1;
+  static constexpr uint32_t DECORATION_BUILT_IN = 11;
+  static constexpr uint32_t BUILT_IN_WORKGROUP_SIZE = 25;
+
+  const std::span words{
+    reinterpret_cast<const uint32_t*>(code.data()), code.size() / sizeof(uint32_t)};
+
+  WorkgroupSizeInfo result;
+  std::unordered_map<uint32_t, uint32_t> constantValues;
+  std::unordered_map<uint32_t, uint32_t> specIds;
+  std::unordered_map<uint32_t, std::array<uint32_t, 3>> composites;
+  std::optional<std::array<uint32_t, 3>> sizeIds;
+  std::optional<uint32_t> builtInId;
+  for (std::size_t i = SPIRV_HEADER_WORDS; i < words.size();)
+  {
+    const uint32_t opcode = words[i] & 0xFFFF;
+    const uint32_t wordCount = words[i] >> 16;
+    if (wordCount == 0 || i + wordCount > words.size())
+      break;
+
+    switch (opcode)
+    {
+    case OP_EXECUTION_MODE:
+      if (wordCount >= 6 && words[i + 2] == MODE_LOCAL_SIZE)
+        result.size = {words[i + 3], words[i + 4], words[i + 5]};
+      break;
+    case OP_EXECUTION_MODE_ID:
+      if (wordCount >= 6 && words[i + 2] == MODE_LOCAL_SIZE_ID)
+        sizeIds = {words[i + 3], words[i + 4], words[i + 5]};
+      break;
+    case OP_DECORATE:
+      if (wordCount >= 4 && words[i + 2] == DECORATION_SPEC_ID)
+        specIds[words[i + 1]] = words[i + 3];
+      if (
+        wordCount >= 4 && words[i + 2] == DECORATION_BUILT_IN &&
+        words[i + 3] == BUILT_IN_WORKGROUP_SIZE)
+        builtInId = words[i + 1];
+      break;
+    case OP_CONSTANT:
+    case OP_SPEC_CONSTANT:
+      if (wordCount >= 4)
+        constantValues[words[i + 2]] = words[i + 3];
+      break;
+    case OP_CONSTANT_COMPOSITE:
+    case OP_SPEC_CONSTANT_COMPOSITE:
+      if (wordCount >= 6)
+        composites[words[i + 2]] = {words[i + 3], words[i + 4], words[i + 5]};
+      break;
+    default:
+      break;
+    }
+
+    i += wordCount;
+  }
+
+  if (builtInId.has_value() && composites.contains(*builtInId))
+    sizeIds = composites[*builtInId];
+
+  if (sizeIds.has_value())
+    for (std::size_t dim = 0; dim < 3; ++dim)
+    {
+      const uint32_t id = (*sizeIds)[dim];
+      if (auto it = constantValues.find(id); it != constantValues.end())
+        result.size[dim] = it->second;
+      if (auto it = specIds.find(id); it != specIds.end())
+        result.constantIds[dim] = it->second;
+    }
+
+  return result;
+}
+
+// SPIRV-Reflect does not provide formats for matrices, so they are reported
+// per column. Only 32-bit float matrices can be vertex inputs in practice.
+static vk::Format matrix_column_format(const SpvReflectNumericTraits& numeric)
+{
+  if (numeric.scalar.width != 32)
+    return vk::Format::eUndefined;
+
+  switch (numeric.matrix.row_count)
+  {
+  case 2:
+    return vk::Format::eR32G32Sfloat;
+  case 3:
+    return vk::Format::eR32G32B32Sfloat;
+  case 4:
+    return vk::Format::eR32G32B32A32Sfloat;
+  default:
+    return vk::Format::eUndefined;
+  }
+}
+
+static std::vector<VertexInputInfo> reflect_vertex_inputs(
+  std::span<SpvReflectInterfaceVariable* const> variables)
+{
+  std::vector<VertexInputInfo> result;
+  for (const auto* var : variables)
+  {
+    if ((var->decoration_flags & SPV_REFLECT_DECORATION_BUILT_IN) != 0)
+      continue;
+
+    const bool isMatrix = var->type_description != nullptr &&
+      (var->type_description->type_flags & SPV_REFLECT_TYPE_FLAG_MATRIX) != 0;
+    const uint32_t columns = isMatrix ? var->numeric.matrix.column_count : 1;
+    const vk::Format format =
+      isMatrix ? matrix_column_format(var->numeric) : static_cast<vk::Format>(var->format);
+
+    uint32_t elements = 1;
+    for (uint32_t i = 0; i < var->array.dims_count; ++i)
+      elements *= var->array.dims[i];
+
+    const std::string name = var->name != nullptr ? var->name : "";
+    const uint32_t locations = get_vertex_input_location_count(format);
+    for (uint32_t i = 0; i < elements * columns; ++i)
+      result.push_back(VertexInputInfo{
+        .name = elements * columns == 1 ? name : fmt::format("{}[{}]", name, i),
+        .location = var->location + i * locations,
+        .format = format,
+      });
+  }
+
+  std::sort(result.begin(), result.end(), [](const auto& a, const auto& b) {
+    return a.location < b.location;
+  });
+  return result;
+}
+
+#define ETNA_SPV_REFLECT_VERIFY(res, path)                                                         \
+  ETNA_VERIFYF((res) == SPV_REFLECT_RESULT_SUCCESS, "SPIR-V parse error in {}", (path))
+
+bool is_valid_spirv(std::span<std::byte const> code)
+{
+  if (code.empty() || code.size() % sizeof(uint32_t) != 0)
+    return false;
+
+  std::unique_ptr<SpvReflectShaderModule, SpvModDeleter> spvModule;
+  spvModule.reset(new SpvReflectShaderModule{});
+  return spvReflectCreateShaderModule2(
+           SPV_REFLECT_MODULE_FLAG_NO_COPY, code.size(), code.data(), spvModule.get()) ==
+    SPV_REFLECT_RESULT_SUCCESS;
+}
+
+ShaderReflection reflect_spirv(std::span<std::byte const> code, const std::filesystem::path& path)
+{
+  ZoneScoped;
+
+  std::unique_ptr<SpvReflectShaderModule, SpvModDeleter> spvModule;
+  spvModule.reset(new SpvReflectShaderModule{});
+
+  // The code outlives the reflection module, so there's no need for SPIRV-Reflect to copy it
+  ETNA_SPV_REFLECT_VERIFY(
+    spvReflectCreateShaderModule2(
+      SPV_REFLECT_MODULE_FLAG_NO_COPY, code.size(), code.data(), spvModule.get()),
+    path);
+
+  ShaderReflection result;
+  result.stage = static_cast<vk::ShaderStageFlagBits>(spvModule->shader_stage);
+  result.entryPoint = spvModule->entry_point_name;
+
+  uint32_t count = 0;
+  ETNA_SPV_REFLECT_VERIFY(
+    spvReflectEnumerateDescriptorSets(spvModule.get(), &count, nullptr), path);
+
+  std::vector<SpvReflectDescriptorSet*> sets(count);
+  ETNA_SPV_REFLECT_VERIFY(
+    spvReflectEnumerateDescriptorSets(spvModule.get(), &count, sets.data()), path);
+
+  result.resources.reserve(sets.size());
+
+  for (auto pSet : sets)
+  {
+    DescriptorSetInfo dsInfo;
+    dsInfo.clear();
+    dsInfo.parseShader(result.stage, *pSet);
+    result.resources.push_back({pSet->set, dsInfo});
+  }
+
+  ETNA_SPV_REFLECT_VERIFY(
+    spvReflectEnumerateSpecializationConstants(spvModule.get(), &count, nullptr), path);
+
+  std::vector<SpvReflectSpecializationConstant*> specConstants(count);
+  ETNA_SPV_REFLECT_VERIFY(
+    spvReflectEnumerateSpecializationConstants(spvModule.get(), &count, specConstants.data()),
+    path);
+
+  std::vector<uint32_t> specConstantSpirvIds;
+  for (auto pConstant : specConstants)
+  {
+    result.specializationConstants.push_back(SpecializationConstantInfo{
+      .name = pConstant->name != nullptr ? pConstant->name : "",
+      .constantId = pConstant->constant_id,
+      .size = 4,
+      .defaultValue = 0,
+    });
+    specConstantSpirvIds.push_back(pConstant->spirv_id);
+  }
+  read_spec_constant_values(code, result.specializationConstants, specConstantSpirvIds);
+
+  if (result.stage == vk::ShaderStageFlagBits::eVertex)
+  {
+    ETNA_SPV_REFLECT_VERIFY(
+      spvReflectEnumerateInputVariables(spvModule.get(), &count, nullptr), path);
+
+    std::vector<SpvReflectInterfaceVariable*> inputs(count);
+    ETNA_SPV_REFLECT_VERIFY(
+      spvReflectEnumerateInputVariables(spvModule.get(), &count, inputs.data()), path);
+
+    result.vertexInputs = reflect_vertex_inputs(inputs);
+  }
+
+  if (result.stage == vk::ShaderStageFlagBits::eMeshEXT)
+    result.meshOutput = read_mesh_output(code);
+
+  if (result.stage == vk::ShaderStageFlagBits::eCompute)
+    result.workgroupSize = read_workgroup_size(code);
+
+  if (spvModule->push_constant_block_count == 1)
+  {
+    // Stages may use disjoint parts of the push constant space via explicit
+    // member offsets, so the range is computed from the members actually declared
+    auto& blk = spvModule->push_constant_blocks[0];
+    uint32_t begin = ~0u;
+    uint32_t end = 0;
+    for (uint32_t i = 0; i < blk.member_count; ++i)
+    {
+      begin = std::min(begin, blk.members[i].offset);
+      end = std::max(end, blk.members[i].offset + blk.members[i].size);
+    }
+    if (blk.member_count == 0)
+      begin = end = 0;
+
+    // Vulkan requires both to be multiples of 4
+    begin &= ~3u;
+    end = (end + 3u) & ~3u;
+
+    result.pushConst.stageFlags = result.stage;
+    result.pushConst.offset = begin;
+    result.pushConst.size = end - begin;
+  }
+  else if (spvModule->push_constant_block_count > 1)
+  {
+    ETNA_PANIC("SPIRV {} parse error: only 1 push_const block per shader supported", path);
+  }
+
+  return result;
+}
+
+static void write_descriptor_set_info(BinaryWriter& writer, const DescriptorSetInfo& info)
+{
+  uint32_t usedCount = 0;
+  for (uint32_t binding = 0; binding < MAX_DESCRIPTOR_BINDINGS; ++binding)
+    if (info.isBindingUsed(binding))
+      ++usedCount;
+
+  writer.write(usedCount);
+  for (uint32_t binding = 0; binding < MAX_DESCRIPTOR_BINDINGS; ++binding)
+  {
+    if (!info.isBindingUsed(binding))
+      continue;
+    const auto& vkBinding = info.getBinding(binding);
+    writer.write(vkBinding.binding);
+    writer.write(vkBinding.descriptorType);
+    writer.write(vkBinding.descriptorCount);
+    writer.write(vkBinding.stageFlags);
+    writer.write(info.getBindingFlags(binding));
+  }
+}
+
+static bool read_descriptor_set_info(BinaryReader& reader, DescriptorSetInfo& info)
+{
+  info.clear();
+
+  uint32_t usedCount = 0;
+  if (!reader.read(usedCount) || usedCount > MAX_DESCRIPTOR_BINDINGS)
+    return false;
+
+  for (uint32_t i = 0; i < usedCount; ++i)
+  {
+    vk::DescriptorSetLayoutBinding binding{};
+    vk::DescriptorBindingFlags flags{};
+    if (
+      !reader.read(binding.binding) || !reader.read(binding.descriptorType) ||
+      !reader.read(binding.descriptorCount) || !reader.read(binding.stageFlags) ||
+      !reader.read(flags) || binding.binding >= MAX_DESCRIPTOR_BINDINGS)
+      return false;
+    info.addResource(binding, flags);
+  }
+
+  return true;
+}
+
+void write_reflection(BinaryWriter& writer, const ShaderReflection& reflection)
+{
+  writer.write(reflection.stage);
+  writer.writeString(reflection.entryPoint);
+
+  writer.write(static_cast<uint32_t>(reflection.resources.size()));
+  for (const auto& [set, info] : reflection.resources)
+  {
+    writer.write(set);
+    write_descriptor_set_info(writer, info);
+  }
+
+  writer.write(reflection.pushConst);
+
+  writer.write(static_cast<uint32_t>(reflection.specializationConstants.size()));
+  for (const auto& constant : reflection.specializationConstants)
+  {
+    writer.writeString(constant.name);
+    writer.write(constant.constantId);
+    writer.write(constant.size);
+    writer.write(constant.defaultValue);
+  }
+
+  writer.write(static_cast<uint32_t>(reflection.vertexInputs.size()));
+  for (const auto& input : reflection.vertexInputs)
+  {
+    writer.writeString(input.name);
+    writer.write(input.location);
+    writer.write(input.format);
+  }
+
+  writer.write(reflection.meshOutput);
+  writer.write(reflection.workgroupSize);
+}
+
+bool read_reflection(BinaryReader& reader, ShaderReflection& reflection)
+{
+  uint32_t setCount = 0;
+  if (
+    !reader.read(reflection.stage) || !reader.readString(reflection.entryPoint) ||
+    !reader.read(setCount) || setCount > MAX_PROGRAM_DESCRIPTORS * 16)
+    return false;
+
+  reflection.resources.resize(setCount);
+  for (auto& [set, info] : reflection.resources)
+    if (!reader.read(set) || !read_descriptor_set_info(reader, info))
+      return false;
+
+  uint32_t specConstantCount = 0;
+  if (!reader.read(reflection.pushConst) || !reader.read(specConstantCount))
+    return false;
+
+  // Arbitrary limit just to not allocate garbage amounts of memory on broken files
+  if (specConstantCount > 4096)
+    return false;
+
+  reflection.specializationConstants.resize(specConstantCount);
+  for (auto& constant : reflection.specializationConstants)
+    if (
+      !reader.readString(constant.name) || !reader.read(constant.constantId) ||
+      !reader.read(constant.size) || !reader.read(constant.defaultValue))
+      return false;
+
+  uint32_t vertexInputCount = 0;
+  if (!reader.read(vertexInputCount) || vertexInputCount > 4096)
+    return false;
+
+  reflection.vertexInputs.resize(vertexInputCount);
+  for (auto& input : reflection.vertexInputs)
+    if (
+      !reader.readString(input.name) || !reader.read(input.location) ||
+      !reader.read(input.format))
+      return false;
+
+  return reader.read(reflection.meshOutput) && reader.read(reflection.workgroupSize);
+}
+
+static constexpr uint32_t REFLECTION_CACHE_MAGIC = 0x43525445; // "ETRC"
+
+ShaderReflectionCache::ShaderReflectionCache(std::filesystem::path cache_path)
+  : path{std::move(cache_path)}
+{
+  ZoneScoped;
+
+  auto data = read_binary_file(path);
+  if (!data.has_value())
+    return;
+
+  BinaryReader reader{*data};
+
+  uint32_t magic = 0;
+  uint32_t version = 0;
+  uint32_t count = 0;
+  if (
+    !reader.read(magic) || magic != REFLECTION_CACHE_MAGIC || !reader.read(version) ||
+    version != SHADER_REFLECTION_FORMAT_VERSION || !reader.read(count))
+  {
+    spdlog::warn("Shader reflection cache {} is outdated or broken, ignoring it", path);
+    return;
+  }
+
+  for (uint32_t i = 0; i < count; ++i)
+  {
+    Key key{};
+    ShaderReflection reflection;
+    if (!reader.read(key) || !read_reflection(reader, reflection))
+    {
+      spdlog::warn("Shader reflection cache {} is truncated, ignoring it", path);
+      entries.clear();
+      return;
+    }
+    entries.emplace(key, Entry{std::move(reflection), false});
+  }
+}
+
+std::optional<ShaderReflection> ShaderReflectionCache::find(
+  uint64_t code_hash, std::size_t code_size)
+{
+  std::unique_lock lock{mutex};
+  auto it = entries.find(Key{code_hash, code_size});
+  if (it == entries.end())
+    return std::nullopt;
+  it->second.used = true;
+  return it->second.reflection;
+}
+
+void ShaderReflectionCache::insert(
+  uint64_t code_hash, std::size_t code_size, const ShaderReflection& reflection)
+{
+  std::unique_lock lock{mutex};
+  entries.insert_or_assign(Key{code_hash, code_size}, Entry{reflection, true});
+  dirty = true;
+}
+
+void ShaderReflectionCache::save()
+{
+  ZoneScoped;
+
+  std::unique_lock lock{mutex};
+
+  // Entries of modules that were not loaded this session are stale versions of
+  // edited shaders or belong to shaders that are gone
+  if (std::erase_if(entries, [](const auto& entry) { return !entry.second.used; }) > 0)
+    dirty = true;
+  if (!dirty)
+    return;
+
+  BinaryWriter writer;
+  writer.write(REFLECTION_CACHE_MAGIC);
+  writer.write(SHADER_REFLECTION_FORMAT_VERSION);
+  writer.write(static_cast<uint32_t>(entries.size()));
+  for (const auto& [key, entry] : entries)
+  {
+    writer.write(key);
+    write_reflection(writer, entry.reflection);
+  }
+
+  if (write_binary_file_atomically(path, writer.getData()))
+    dirty = false;
+  else
+    spdlog::warn("Failed to write shader reflection cache to {}", path);
+}
+
+} // namespace etna
@@ -0,0 +1,82 @@
+#pragma once
+#ifndef ETNA_SPIRV_REFLECTION_HPP_INCLUDED
+#define ETNA_SPIRV_REFLECTION_HPP_INCLUDED
+
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <unordered_map>
+
+#include <etna/ShaderProgram.hpp>
+
+#include "BinaryIo.hpp"
+
+
+namespace etna
+{
+
+// Runs SPIRV-Reflect on the code, path is only used for error messages
+ShaderReflection reflect_spirv(std::span<std::byte const> code, const std::filesystem::path& path);
+// Whether SPIRV-Reflect can parse the code, e.g. to reject a file that is still being written
+bool is_valid_spirv(std::span<std::byte const> code);
+
+// Bump this whenever ShaderReflection or its serialization changes
+inline constexpr uint32_t SHADER_REFLECTION_FORMAT_VERSION = 8;
+
+void write_reflection(BinaryWriter& writer, const ShaderReflection& reflection);
+[[nodiscard]] bool read_reflection(BinaryReader& reader, ShaderReflection& reflection);
+
+/**
+ * On-disk cache of reflection results keyed by the hash and size of the
+ * SPIR-V code, so that unchanged modules skip reflection entirely.
+ * Lookups and insertions are thread-safe, as modules are loaded in parallel.
+ * Only entries that were used during the session are saved, so versions of
+ * hot reloaded shaders do not pile up across sessions.
+ */
+class ShaderReflectionCache
+{
+public:
+  // Loads the cache from the file, silently starting from scratch if it is
+  // missing, broken or was written by an incompatible version of etna.
+  explicit ShaderReflectionCache(std::filesystem::path cache_path);
+
+  std::optional<ShaderReflection> find(uint64_t code_hash, std::size_t code_size);
+  void insert(uint64_t code_hash, std::size_t code_size, const ShaderReflection& reflection);
+
+  // Writes the entries used so far back to disk if anything has changed
+  void save();
+
+private:
+  struct Key
+  {
+    uint64_t hash;
+    uint64_t size;
+    bool operator==(const Key&) const = default;
+  };
+
+  struct KeyHash
+  {
+    std::size_t operator()(const Key& key) const noexcept
+    {
+      return static_cast<std::size_t>(key.hash ^ (key.size * 0x9e3779b97f4a7c15));
+    }
+  };
+
+  struct Entry
+  {
+    ShaderReflection reflection;
+    // Looked up or inserted during this session
+    bool used;
+  };
+
+  std::filesystem::path path;
+
+  std::mutex mutex;
+  std::unordered_map<Key, Entry, KeyHash> entries;
+  bool dirty = false;
+};
+
+} // namespace etna
+
+#endif // ETNA_SPIRV_REFLECTION_HPP_INCLUDED
@@ -0,0 +1,106 @@
+#include "WorkerPool.hpp"
+
+#include <atomic>
+
+#include <tracy/Tracy.hpp>
+
+
+namespace etna
+{
+
+WorkerPool::WorkerPool(std::size_t thread_count)
+{
+  threads.reserve(thread_count);
+  for (std::size_t i = 0; i < thread_count; ++i)
+    threads.emplace_back([this]() { workerLoop(); });
+}
+
+WorkerPool::~WorkerPool()
+{
+  {
+    std::unique_lock lock{mutex};
+    stopping = true;
+  }
+  hasWork.notify_all();
+
+  // Queued tasks are still executed, somebody might be waiting on their futures
+  for (auto& thread : threads)
+    thread.join();
+}
+
+void WorkerPool::push(std::function<void()> task)
+{
+  {
+    std::unique_lock lock{mutex};
+    tasks.push_back(std::move(task));
+  }
+  hasWork.notify_one();
+}
+
+void WorkerPool::workerLoop()
+{
+  for (;;)
+  {
+    std::function<void()> task;
+    {
+      std::unique_lock lock{mutex};
+      hasWork.wait(lock, [this]() { return stopping || !tasks.empty(); });
+      if (tasks.empty())
+        return;
+      task = std::move(tasks.front());
+      tasks.pop_front();
+    }
+    task();
+  }
+}
+
+void WorkerPool::parallelFor(std::size_t count, const std::function<void(std::size_t)>& func)
+{
+  ZoneScoped;
+
+  if (count == 0)
+    return;
+
+  // Helpers that get scheduled after all items were grabbed by other threads
+  // simply exit, so we only need to wait for items, not for helpers.
+  struct SharedState
+  {
+    const std::function<void(std::size_t)>* func;
+    std::size_t count;
+    std::atomic<std::size_t> nextItem{0};
+    std::atomic<std::size_t> itemsDone{0};
+    std::mutex mutex;
+    std::condition_variable allDone;
+  };
+
+  auto state = std::make_shared<SharedState>();
+  state->func = &func;
+  state->count = count;
+
+  auto work = [](SharedState& st) {
+    std::size_t done = 0;
+    for (std::size_t i = st.nextItem++; i < st.count; i = st.nextItem++)
+    {
+      (*st.func)(i);
+      ++done;
+    }
+    if (done == 0)
+      return;
+    if (st.itemsDone.fetch_add(done) + done == st.count)
+    {
+      std::unique_lock lock{st.mutex};
+      st.allDone.notify_all();
+    }
+  };
+
+  const std::size_t helpers = std::min(threads.size(), count - 1);
+  for (std::size_t i = 0; i < helpers; ++i)
+    push([state, work]() { work(*state); });
+
+  work(*state);
+
+  std::unique_lock lock{state->mutex};
+  state->allDone.wait(lock, [&state]() { return state->itemsDone.load() == state->count; });
+}
+
+} // namespace etna
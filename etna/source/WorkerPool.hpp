@@ -0,0 +1,71 @@
+#pragma once
+#ifndef ETNA_WORKER_POOL_HPP_INCLUDED
+#define ETNA_WORKER_POOL_HPP_INCLUDED
+
+#include <concepts>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace etna
+{
+
+/**
+ * A fixed set of worker threads for CPU-heavy things etna does on behalf of
+ * the user, like loading shaders or compiling pipelines. Tasks are only
+ * allowed to touch state that is explicitly thread-safe (the vk::Device
+ * object creation functions, immutable data prepared by the caller, etc).
+ */
+class WorkerPool
+{
+public:
+  explicit WorkerPool(std::size_t thread_count);
+  ~WorkerPool();
+
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+  WorkerPool(WorkerPool&&) = delete;
+  WorkerPool& operator=(WorkerPool&&) = delete;
+
+  template <std::invocable<> F>
+  std::future<std::invoke_result_t<F>> submit(F&& func)
+  {
+    using Result = std::invoke_result_t<F>;
+    // packaged_task is move-only, while std::function requires copyability
+    auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(func));
+    auto result = task->get_future();
+    push([task]() { (*task)(); });
+    return result;
+  }
+
+  /**
+   * Calls func(i) for every i in [0, count) and blocks until all of the calls
+   * are done. The calling thread does work too, so this never deadlocks, even
+   * when the workers are busy or when called from inside a task.
+   */
+  void parallelFor(std::size_t count, const std::function<void(std::size_t)>& func);
+
+  std::size_t getThreadCount() const { return threads.size(); }
+
+private:
+  void push(std::function<void()> task);
+  void workerLoop();
+
+private:
+  std::mutex mutex;
+  std::condition_variable hasWork;
+  std::deque<std::function<void()>> tasks;
+  bool stopping = false;
+
+  std::vector<std::thread> threads;
+};
+
+} // namespace etna
+
+#endif // ETNA_WORKER_POOL_HPP_INCLUDED
@@ -0,0 +1,46 @@
+// Packs compiled SPIR-V shaders and their reflection into a single file that
+// can be mounted at runtime with etna::mount_shader_pack.
+//
+// Usage: etna_shader_packer <output> <root> <shader.spv | @list_file>...
+// Shader paths are stored relative to <root>, list files contain one path per line.
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "ShaderPack.hpp"
+
+
+int main(int argc, char** argv)
+{
+  if (argc < 4)
+  {
+    spdlog::error("Usage: {} <output> <root> <shader.spv | @list_file>...", argv[0]);
+    return 1;
+  }
+
+  std::vector<std::filesystem::path> shaders;
+  for (int i = 3; i < argc; ++i)
+  {
+    const std::string_view arg = argv[i];
+    if (!arg.starts_with('@'))
+    {
+      shaders.emplace_back(arg);
+      continue;
+    }
+
+    std::ifstream list{std::filesystem::path{arg.substr(1)}};
+    if (!list.is_open())
+    {
+      spdlog::error("Failed to open shader list {}", arg.substr(1));
+      return 1;
+    }
+    for (std::string line; std::getline(list, line);)
+      if (!line.empty())
+        shaders.emplace_back(line);
+  }
+
+  return etna::write_shader_pack(argv[1], argv[2], shaders) ? 0 : 1;
+}
@@ -3,6 +3,13 @@ cmake_minimum_required(VERSION 3.25)
 
 find_package(Vulkan 1.4.328 REQUIRED)
 
+if (ETNA_ENABLE_SHADER_COMPILER)
+  find_package(Vulkan REQUIRED COMPONENTS shaderc_combined)
+endif ()
+
+# Etna uses a few worker threads for loading shaders and such
+find_package(Threads REQUIRED)
+
 # GPU-side allocator for Vulkan by AMD
 CPMAddPackage(
   NAME VulkanMemoryAllocator